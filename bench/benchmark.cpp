@@ -0,0 +1,598 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <gp_system.h>
+#include <eval_cache.h>
+#include <fast_math.h>
+#include <image_expr.h>
+#include <image_filters.h>
+#include <image_kernels.h>
+#include <image_noise.h>
+#include <image_pool.h>
+#include <image_storage.h>
+#include <reference_cache.h>
+#include <blt/logging/logging.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Micro benchmarks of the pieces the evaluation engine is built from and macro benchmarks of whole generations. Every input
+ * is generated from a fixed seed. Each micro benchmark is calibrated to a minimum batch time and repeated, the median batch is
+ * reported. Whole generations are run in a forked child per configuration, since the GP system can only be set up once per
+ * process.
+ */
+
+struct bench_options_t
+{
+	std::string json_path;
+	std::string filter;
+	std::string reference_path = "../silly.png";
+	blt::i32 resolution = 256;
+	blt::u64 seed = 42;
+	std::vector<blt::size_t> populations{64, 256};
+	// 0 leaves it to set_thread_count's default
+	std::vector<blt::size_t> threads{1, 0};
+	// run_step is measured with the channels running concurrently, one after another, or both
+	std::vector<bool> channel_modes{true, false};
+	blt::u32 generations = 10;
+	bool quick = false;
+};
+
+struct bench_result_t
+{
+	std::string name;
+	blt::u64 iterations = 0;
+	double median_ns = 0;
+	double min_ns = 0;
+	double max_ns = 0;
+	// bytes touched per iteration, 0 if throughput doesn't apply
+	blt::u64 bytes = 0;
+	// extra figures for the macro benchmarks, written to the JSON as they are
+	std::vector<std::pair<std::string, double>> extra;
+};
+
+// keeps the compiler from proving a result unused and dropping the work that produced it
+template <typename T>
+void do_not_optimize(const T& value)
+{
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class bench_runner_t
+{
+public:
+	explicit bench_runner_t(const bench_options_t& options): options(options)
+	{}
+
+	[[nodiscard]] bool selected(const std::string_view name) const
+	{
+		return options.filter.empty() || name.find(options.filter) != std::string_view::npos;
+	}
+
+	template <typename Func>
+	void run(const std::string& name, const blt::u64 bytes, Func&& func)
+	{
+		if (!selected(name))
+			return;
+		using clock = std::chrono::steady_clock;
+		const auto target = std::chrono::milliseconds(options.quick ? 5 : 25);
+		const auto repetitions = options.quick ? 3 : 7;
+
+		func();
+		blt::u64 iterations = 1;
+		while (true)
+		{
+			const auto start = clock::now();
+			for (blt::u64 i = 0; i < iterations; ++i)
+				func();
+			if (clock::now() - start >= target || iterations >= (1ull << 30))
+				break;
+			iterations *= 2;
+		}
+
+		std::vector<double> samples;
+		for (int repetition = 0; repetition < repetitions; ++repetition)
+		{
+			const auto start = clock::now();
+			for (blt::u64 i = 0; i < iterations; ++i)
+				func();
+			samples.push_back(std::chrono::duration<double, std::nano>(clock::now() - start).count() / static_cast<double>(iterations));
+		}
+		std::sort(samples.begin(), samples.end());
+
+		bench_result_t result;
+		result.name = name;
+		result.iterations = iterations;
+		result.median_ns = samples[samples.size() / 2];
+		result.min_ns = samples.front();
+		result.max_ns = samples.back();
+		result.bytes = bytes;
+		report(result);
+		results.push_back(std::move(result));
+	}
+
+	void add(bench_result_t result)
+	{
+		report(result);
+		results.push_back(std::move(result));
+	}
+
+	bool write_json(const std::string& path) const
+	{
+		std::ofstream out(path);
+		if (!out)
+		{
+			BLT_ERROR("Unable to open '{}' for writing", path);
+			return false;
+		}
+		out << "{\n\t\"context\": {\"resolution\": " << options.resolution << ", \"seed\": " << options.seed << ", \"kernels\": \"" <<
+			get_kernels().name << "\", \"threads\": " << std::thread::hardware_concurrency() << ", \"quick\": " << (options.quick ?
+				"true" : "false") << "},\n\t\"benchmarks\": [";
+		for (const auto& [i, result] : blt::enumerate(results))
+		{
+			out << (i == 0 ? "\n" : ",\n") << "\t\t{\"name\": \"" << result.name << "\", \"iterations\": " << result.iterations <<
+				", \"median_ns\": " << result.median_ns << ", \"min_ns\": " << result.min_ns << ", \"max_ns\": " << result.max_ns <<
+				", \"bytes\": " << result.bytes;
+			for (const auto& [key, value] : result.extra)
+				out << ", \"" << key << "\": " << value;
+			out << "}";
+		}
+		out << "\n\t]\n}\n";
+		return static_cast<bool>(out);
+	}
+
+	const bench_options_t& options;
+
+private:
+	static void report(const bench_result_t& result)
+	{
+		if (result.bytes != 0)
+			BLT_INFO("{:<44} {:>14.1f} ns  {:>8.2f} GB/s", result.name, result.median_ns,
+					static_cast<double>(result.bytes) / result.median_ns);
+		else
+			BLT_INFO("{:<44} {:>14.1f} ns", result.name, result.median_ns);
+	}
+
+	std::vector<bench_result_t> results;
+};
+
+std::vector<blt::u32> random_pixels(const blt::u64 seed)
+{
+	std::mt19937_64 engine{seed};
+	std::vector<blt::u32> pixels(image_size());
+	for (auto& pixel : pixels)
+		pixel = static_cast<blt::u32>(engine() >> 32);
+	return pixels;
+}
+
+// a pinned image is never overwritten in place, so repeated operators on it always see the same input
+image_t pinned_image(const blt::u64 seed)
+{
+	image_t image{};
+	const auto pixels = random_pixels(seed);
+	std::copy(pixels.begin(), pixels.end(), image.get_data().data.begin());
+	image.set_key(combine_keys(op_tag("bench"), seed));
+	image.pin();
+	return image;
+}
+
+bool cpu_supports(const std::string_view isa)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	if (isa == "sse4")
+		return __builtin_cpu_supports("sse4.1");
+	if (isa == "avx2")
+		return __builtin_cpu_supports("avx2");
+	if (isa == "avx512")
+		return __builtin_cpu_supports("avx512f");
+#endif
+	return isa == "scalar";
+}
+
+void bench_kernels(bench_runner_t& runner)
+{
+	const auto a = random_pixels(runner.options.seed);
+	const auto b = random_pixels(runner.options.seed + 1);
+	std::vector<blt::u32> out(image_size());
+	std::vector<float> reference(image_size());
+	std::mt19937_64 engine{runner.options.seed + 2};
+	std::uniform_real_distribution<float> unit{0, 1};
+	for (auto& value : reference)
+		value = unit(engine);
+	std::vector<float> lut(GAMMA_LUT_SIZE);
+	for (blt::size_t i = 0; i < GAMMA_LUT_SIZE; ++i)
+		lut[i] = static_cast<float>(std::pow(static_cast<double>(i) / static_cast<double>(GAMMA_LUT_SIZE - 1), 1.0 / 2.2));
+
+	const auto pixels = image_size();
+	const std::array<std::pair<std::string_view, const kernel_table_t* (*)()>, 4> sets{
+		{{"scalar", make_scalar_kernels}, {"sse4", make_sse4_kernels}, {"avx2", make_avx2_kernels}, {"avx512", make_avx512_kernels}}
+	};
+	for (const auto& [isa, make] : sets)
+	{
+		if (!cpu_supports(isa))
+			continue;
+		const auto& kernels = *make();
+		const auto prefix = "kernel/" + std::string(isa) + "/";
+		const std::array<std::pair<std::string_view, binary_kernel_t>, 6> binary{
+			{{"add", kernels.add}, {"mul", kernels.mul}, {"div", kernels.div}, {"mod", kernels.mod}, {"bit_xor", kernels.bit_xor},
+				{"max", kernels.max}}
+		};
+		for (const auto& [name, kernel] : binary)
+		{
+			runner.run(prefix + std::string(name), pixels * 12, [&, kernel = kernel]() {
+				kernel(out.data(), a.data(), b.data(), pixels);
+				do_not_optimize(out.data());
+			});
+		}
+		runner.run(prefix + "bit_not", pixels * 8, [&]() {
+			kernels.bit_not(out.data(), a.data(), pixels);
+			do_not_optimize(out.data());
+		});
+		// the per-target inner loop of the fitness function
+		runner.run(prefix + "squared_error", pixels * 8, [&]() {
+			do_not_optimize(kernels.squared_error(a.data(), reference.data(), pixels));
+		});
+		runner.run(prefix + "squared_error_gamma", pixels * 8, [&]() {
+			do_not_optimize(kernels.squared_error_lut(a.data(), reference.data(), lut.data(), pixels));
+		});
+	}
+}
+
+void bench_operators(bench_runner_t& runner)
+{
+	const auto pixels = image_size();
+	const auto dimensions = image_dimensions();
+	const auto a = random_pixels(runner.options.seed);
+	std::vector<blt::u32> out(pixels);
+
+	runner.run("filter/erode_7", pixels * 8, [&]() {
+		erode_rect(a.data(), out.data(), dimensions, 7);
+		do_not_optimize(out.data());
+	});
+	runner.run("filter/dilate_cross_7", pixels * 8, [&]() {
+		dilate_cross(a.data(), out.data(), dimensions, 7);
+		do_not_optimize(out.data());
+	});
+	runner.run("filter/band_pass_5", pixels * 8, [&]() {
+		band_pass(a.data(), out.data(), dimensions, 5, 1.0f, 6.0f);
+		do_not_optimize(out.data());
+	});
+	runner.run("noise/perlin_plane", pixels * 4, [&]() {
+		perlin_plane(out.data(), dimensions, 4.0f, 4.0f, 12.5f, 7);
+		do_not_optimize(out.data());
+	});
+	runner.run("noise/perlin_fbm_4", pixels * 4, [&]() {
+		perlin_fbm_plane(out.data(), dimensions, 4.0f, 12.5f, 4, 0.5f, 2.0f);
+		do_not_optimize(out.data());
+	});
+	runner.run("noise/perlin_from_image", pixels * 8, [&]() {
+		perlin_from_image(a.data(), out.data(), dimensions, 1.0 / (static_cast<double>(std::numeric_limits<blt::u32>::max()) * 0.1));
+		do_not_optimize(out.data());
+	});
+}
+
+void bench_image_arithmetic(bench_runner_t& runner)
+{
+	auto a = pinned_image(runner.options.seed);
+	auto b = pinned_image(runner.options.seed + 1);
+	const auto pixels = image_size();
+
+	for (const bool lazy : {true, false})
+	{
+		set_lazy_evaluation(lazy);
+		const std::string prefix = lazy ? "image_t/lazy/" : "image_t/eager/";
+		runner.run(prefix + "add", pixels * 12, [&]() {
+			auto c = a + b;
+			do_not_optimize(c.get_data().data.data());
+			c.drop();
+		});
+		// a chain the point-wise fusion is meant for: four operators, two leaves, one materialisation
+		runner.run(prefix + "chain_4", pixels * 12, [&]() {
+			auto sum = a + b;
+			auto product = sum * a;
+			auto difference = product - b;
+			auto sine = pointwise_image(pixel_op_t::sin, 0, difference);
+			do_not_optimize(sine.get_data().data.data());
+			for (auto image : {&sum, &product, &difference, &sine})
+				image->drop();
+		});
+		runner.run(prefix + "log_exp", pixels * 8, [&]() {
+			auto log = pointwise_image(pixel_op_t::log, 0, a);
+			auto exp = pointwise_image(pixel_op_t::exp, 0, log);
+			do_not_optimize(exp.get_data().data.data());
+			log.drop();
+			exp.drop();
+		});
+	}
+	set_lazy_evaluation(true);
+	a.drop();
+	b.drop();
+}
+
+void bench_image_pool(bench_runner_t& runner)
+{
+	runner.run("image_pool/acquire_release", 0, []() {
+		const auto storage = acquire_image_storage();
+		do_not_optimize(storage);
+		release_image_storage(storage);
+	});
+	// enough buffers to overflow the thread cache, so the global free list is exercised as well
+	runner.run("image_pool/acquire_release_64", 0, []() {
+		std::array<image_istorage_t*, 64> storage{};
+		for (auto& buffer : storage)
+			buffer = acquire_image_storage();
+		do_not_optimize(storage.data());
+		for (const auto buffer : storage)
+			release_image_storage(buffer);
+	});
+}
+
+void bench_references(bench_runner_t& runner)
+{
+	const auto& path = runner.options.reference_path;
+	if (!std::filesystem::exists(path))
+	{
+		BLT_WARN("Reference '{}' doesn't exist, skipping the reference benchmarks", path);
+		return;
+	}
+	runner.run("reference/decode", std::filesystem::file_size(path), [&]() {
+		do_not_optimize(image_storage_t::from_file(path)[0].data.data());
+	});
+
+	const auto cache = std::filesystem::temp_directory_path() / ("image-gp-bench-" + std::to_string(getpid()));
+	set_reference_cache_directory(cache.string());
+	load_reference_image(path);
+	runner.run("reference/cache_hit", image_size() * 3 * sizeof(image_pixel_t), [&]() {
+		do_not_optimize(load_reference_image(path)->at(0).data.data());
+	});
+	set_reference_cache_directory("");
+	std::error_code error;
+	std::filesystem::remove_all(cache, error);
+}
+
+// sent from the child running a generation benchmark back to the parent
+struct generation_result_t
+{
+	bool ok;
+	double median_ns;
+	double min_ns;
+	double max_ns;
+	double create_ns;
+	double next_ns;
+	double evaluate_ns;
+	double statistics_ns;
+};
+
+generation_result_t run_generations(const bench_options_t& options, const blt::size_t population, const blt::size_t threads,
+									const bool concurrent)
+{
+	generation_result_t result{};
+	set_thread_count(threads);
+	set_concurrent_channels(concurrent);
+	set_eval_cache_budget(512ull * 1024 * 1024);
+	if (!setup_gp_system(population, options.seed, {options.reference_path}))
+		return result;
+
+	// the first generations build the evaluation cache and pool up from nothing
+	for (int i = 0; i < 2; ++i)
+		run_step();
+	const auto before = get_phase_timings();
+	std::vector<double> samples;
+	for (blt::u32 i = 0; i < options.generations; ++i)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		run_step();
+		samples.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+	}
+	const auto& after = get_phase_timings();
+	std::sort(samples.begin(), samples.end());
+	const auto generations = static_cast<double>(options.generations);
+	result.ok = !samples.empty();
+	result.median_ns = samples.empty() ? 0 : samples[samples.size() / 2];
+	result.min_ns = samples.empty() ? 0 : samples.front();
+	result.max_ns = samples.empty() ? 0 : samples.back();
+	result.create_ns = static_cast<double>(after.create_generation_ns - before.create_generation_ns) / generations;
+	result.next_ns = static_cast<double>(after.next_generation_ns - before.next_generation_ns) / generations;
+	result.evaluate_ns = static_cast<double>(after.evaluate_fitness_ns - before.evaluate_fitness_ns) / generations;
+	result.statistics_ns = static_cast<double>(after.statistics_ns - before.statistics_ns) / generations;
+	cleanup();
+	return result;
+}
+
+void bench_generations(bench_runner_t& runner)
+{
+	const auto& options = runner.options;
+	for (const auto population : options.populations)
+	{
+		for (const auto threads : options.threads)
+		{
+			for (const bool concurrent : options.channel_modes)
+			{
+				const auto name = "run_step/population_" + std::to_string(population) + "/threads_" + (threads == 0
+																										? std::string("default")
+																										: std::to_string(threads)) +
+					(concurrent ? "/concurrent" : "/sequential");
+				if (!runner.selected(name))
+					continue;
+
+				int channel[2];
+				if (pipe(channel) != 0)
+				{
+					BLT_ERROR("Unable to create a pipe for {}", name);
+					continue;
+				}
+				const auto pid = fork();
+				if (pid == 0)
+				{
+					close(channel[0]);
+					const auto result = run_generations(options, population, threads, concurrent);
+					[[maybe_unused]] const auto written = write(channel[1], &result, sizeof(result));
+					close(channel[1]);
+					_exit(result.ok ? EXIT_SUCCESS : EXIT_FAILURE);
+				}
+				close(channel[1]);
+				generation_result_t result{};
+				const auto received = pid > 0 ? read(channel[0], &result, sizeof(result)) : 0;
+				close(channel[0]);
+				if (pid > 0)
+					waitpid(pid, nullptr, 0);
+				if (received != sizeof(result) || !result.ok)
+				{
+					BLT_ERROR("{} failed", name);
+					continue;
+				}
+
+				bench_result_t bench;
+				bench.name = name;
+				bench.iterations = options.generations;
+				bench.median_ns = result.median_ns;
+				bench.min_ns = result.min_ns;
+				bench.max_ns = result.max_ns;
+				bench.extra = {
+					{"create_generation_ns", result.create_ns}, {"next_generation_ns", result.next_ns},
+					{"evaluate_fitness_ns", result.evaluate_ns}, {"statistics_ns", result.statistics_ns}
+				};
+				runner.add(std::move(bench));
+			}
+		}
+	}
+}
+
+std::vector<blt::size_t> parse_list(const std::string& list)
+{
+	std::vector<blt::size_t> values;
+	std::size_t start = 0;
+	while (start <= list.size())
+	{
+		const auto end = std::min(list.find(',', start), list.size());
+		if (end > start)
+			values.push_back(std::stoull(list.substr(start, end - start)));
+		start = end + 1;
+	}
+	return values;
+}
+
+void print_usage(const char* program_name)
+{
+	BLT_INFO("Usage: {} [--json PATH] [--filter TEXT] [--quick] [--resolution N] [--seed N] [--reference PATH] [--populations N,...] [--threads N,...] [--channels concurrent|sequential|both] [--generations N]",
+			program_name);
+	BLT_INFO("\t--json PATH       also write the results to PATH as JSON");
+	BLT_INFO("\t--filter TEXT     only run benchmarks whose name contains TEXT");
+	BLT_INFO("\t--quick           shorter batches and fewer repetitions, for a quick look");
+	BLT_INFO("\t--resolution N    side length of the images (default 256)");
+	BLT_INFO("\t--seed N          seed of every generated input and of the GP runs (default 42)");
+	BLT_INFO("\t--reference PATH  reference image for the reference and run_step benchmarks (default ../silly.png)");
+	BLT_INFO("\t--populations L   comma separated population sizes run_step is measured at (default 64,256)");
+	BLT_INFO("\t--threads L       comma separated threads per program run_step is measured with, 0 is set_thread_count's default (default 1,0)");
+	BLT_INFO("\t--channels MODE   measure run_step with the channels concurrent, sequential or both (default both)");
+	BLT_INFO("\t--generations N   generations timed per run_step configuration (default 10)");
+}
+
+int main(const int argc, const char** argv)
+{
+	bench_options_t options;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string_view arg = argv[i];
+		const auto next_value = [&]() -> std::string {
+			if (i + 1 >= argc)
+			{
+				BLT_ERROR("Missing value for argument '{}'", arg);
+				print_usage(argv[0]);
+				std::exit(EXIT_FAILURE);
+			}
+			return argv[++i];
+		};
+		if (arg == "--json")
+			options.json_path = next_value();
+		else if (arg == "--filter")
+			options.filter = next_value();
+		else if (arg == "--quick")
+			options.quick = true;
+		else if (arg == "--resolution")
+			options.resolution = std::stoi(next_value());
+		else if (arg == "--seed")
+			options.seed = std::stoull(next_value());
+		else if (arg == "--reference")
+			options.reference_path = next_value();
+		else if (arg == "--populations")
+			options.populations = parse_list(next_value());
+		else if (arg == "--threads")
+			options.threads = parse_list(next_value());
+		else if (arg == "--channels")
+		{
+			const auto mode = next_value();
+			if (mode == "concurrent")
+				options.channel_modes = {true};
+			else if (mode == "sequential")
+				options.channel_modes = {false};
+			else if (mode == "both")
+				options.channel_modes = {true, false};
+			else
+			{
+				BLT_ERROR("Unknown channel mode '{}'", mode);
+				print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (arg == "--generations")
+			options.generations = static_cast<blt::u32>(std::stoul(next_value()));
+		else if (arg == "--help" || arg == "-h")
+		{
+			print_usage(argv[0]);
+			return EXIT_SUCCESS;
+		} else
+		{
+			BLT_ERROR("Unknown argument '{}'", arg);
+			print_usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!set_image_dimensions(options.resolution))
+		return EXIT_FAILURE;
+	set_transcendental_accuracy(DEFAULT_TRANSCENDENTAL_TABLE_BITS);
+	set_reference_cache_directory("");
+
+	bench_runner_t runner{options};
+	// forked before anything else has started a thread
+	bench_generations(runner);
+
+	// repeated inputs would otherwise be answered from the evaluation cache after the first iteration
+	set_eval_cache_budget(0);
+	bench_kernels(runner);
+	bench_operators(runner);
+	bench_image_arithmetic(runner);
+	bench_image_pool(runner);
+	bench_references(runner);
+
+	if (!options.json_path.empty() && !runner.write_json(options.json_path))
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
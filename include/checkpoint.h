@@ -0,0 +1,205 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <blt/fs/fwddecl.h>
+#include <blt/std/types.h>
+
+/*
+ * Checkpoint files are a fixed header with a table of sections followed by the sections themselves, each starting on a 64 byte
+ * boundary. Everything is stored in native byte order, which the header records, so loading a checkpoint is an mmap and
+ * plain array views into it rather than a parse. The reference cache reuses the same container.
+ */
+
+constexpr char CHECKPOINT_MAGIC[8] = {'I', 'G', 'P', 'C', 'K', 'P', 'T', '\0'};
+// bump whenever the layout of the header or of any section changes, older files are then rejected
+constexpr blt::u32 CHECKPOINT_VERSION = 3;
+constexpr blt::u32 CHECKPOINT_BYTE_ORDER = 0x01020304;
+constexpr blt::size_t CHECKPOINT_ALIGNMENT = 64;
+constexpr blt::size_t MAX_CHECKPOINT_SECTIONS = 32;
+
+struct checkpoint_section_t
+{
+	blt::u32 id = 0;
+	blt::u32 reserved = 0;
+	blt::u64 offset = 0;
+	blt::u64 size = 0;
+};
+
+struct checkpoint_header_t
+{
+	char magic[8]{};
+	blt::u32 version = 0;
+	blt::u32 byte_order = 0;
+	blt::u64 file_size = 0;
+	blt::u32 section_count = 0;
+	blt::u32 reserved = 0;
+	checkpoint_section_t sections[MAX_CHECKPOINT_SECTIONS]{};
+};
+
+/**
+ * Builds a checkpoint in memory. Sections are either appended whole or streamed through the writer interface (used for
+ * the portable population serialisation, see tree_io.h) between begin_section and end_section.
+ */
+class checkpoint_builder_t final : public blt::fs::writer_t
+{
+public:
+	checkpoint_builder_t();
+
+	void begin_section(blt::u32 id);
+
+	void end_section();
+
+	void add_section(blt::u32 id, const void* data, blt::size_t bytes);
+
+	template <typename T>
+	void add_section(const blt::u32 id, const std::vector<T>& values)
+	{
+		add_section(id, values.data(), values.size() * sizeof(T));
+	}
+
+	blt::i64 write(const char* buffer, blt::size_t bytes) override;
+
+	/**
+	 * @return the finished file, the builder is empty afterwards
+	 */
+	std::vector<char> finish();
+
+private:
+	std::vector<char> bytes;
+	blt::size_t section_start = 0;
+	blt::u32 section_count = 0;
+	bool in_section = false;
+};
+
+/**
+ * Collects whatever is written to it, for serialising single objects such as one tree.
+ */
+class byte_writer_t final : public blt::fs::writer_t
+{
+public:
+	blt::i64 write(const char* buffer, const blt::size_t size) override
+	{
+		bytes.insert(bytes.end(), buffer, buffer + size);
+		return static_cast<blt::i64>(size);
+	}
+
+	std::vector<char> bytes;
+};
+
+/**
+ * A read only mapping of a checkpoint file. Sections are views into the mapping, valid for the lifetime of the file object.
+ */
+class checkpoint_file_t
+{
+public:
+	class section_reader_t final : public blt::fs::reader_t
+	{
+	public:
+		explicit section_reader_t(const std::string_view data): data(data)
+		{}
+
+		blt::i64 read(char* buffer, blt::size_t bytes) override;
+
+		[[nodiscard]] bool at_end() const
+		{
+			return position == data.size();
+		}
+
+	private:
+		std::string_view data;
+		blt::size_t position = 0;
+	};
+
+	checkpoint_file_t() = default;
+
+	checkpoint_file_t(const checkpoint_file_t&) = delete;
+
+	checkpoint_file_t& operator=(const checkpoint_file_t&) = delete;
+
+	~checkpoint_file_t();
+
+	/**
+	 * Maps and validates the file, logging why it was rejected on failure.
+	 */
+	bool open(const std::string& path);
+
+	/**
+	 * @return the section's bytes, empty if the file has no such section
+	 */
+	[[nodiscard]] std::string_view section(blt::u32 id) const;
+
+	/**
+	 * Copies a section holding an array of T, false if it is missing or not a whole number of T.
+	 */
+	template <typename T>
+	bool read_array(const blt::u32 id, std::vector<T>& out) const
+	{
+		const auto data = section(id);
+		if (data.data() == nullptr || data.size() % sizeof(T) != 0)
+			return false;
+		out.resize(data.size() / sizeof(T));
+		std::memcpy(out.data(), data.data(), data.size());
+		return true;
+	}
+
+	template <typename T>
+	bool read_value(const blt::u32 id, T& out) const
+	{
+		const auto data = section(id);
+		if (data.size() != sizeof(T))
+			return false;
+		std::memcpy(&out, data.data(), sizeof(T));
+		return true;
+	}
+
+	[[nodiscard]] section_reader_t reader(const blt::u32 id) const
+	{
+		return section_reader_t{section(id)};
+	}
+
+private:
+	const char* mapping = nullptr;
+	blt::size_t mapping_size = 0;
+	const checkpoint_header_t* header = nullptr;
+};
+
+/**
+ * Writes a finished file on the calling thread, with the same write-then-rename as write_checkpoint_async.
+ */
+bool write_checkpoint_file(const std::string& path, const std::vector<char>& file);
+
+/**
+ * Hands a finished checkpoint to the background writer thread. It is written next to path and renamed over it once flushed,
+ * so an interrupted write never leaves a truncated checkpoint behind. If the writer is still busy with an older checkpoint only
+ * the newest pending one is kept.
+ */
+void write_checkpoint_async(const std::string& path, std::vector<char> file);
+
+/**
+ * Blocks until every checkpoint handed to write_checkpoint_async is on disk.
+ */
+void wait_for_checkpoint_writes();
+
+#endif //CHECKPOINT_H
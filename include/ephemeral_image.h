@@ -0,0 +1,66 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef EPHEMERAL_IMAGE_H
+#define EPHEMERAL_IMAGE_H
+
+#include <image_storage.h>
+
+/*
+ * Ephemeral terminals draw their parameters once and keep the generated image for as long as the tree lives. Only those
+ * parameters are worth sending to another process, so the image is described by an ephemeral_recipe_t and rebuilt from it
+ * there, see tree_io.h.
+ */
+
+ephemeral_recipe_t noise_recipe(blt::u64 state);
+
+ephemeral_recipe_t constant_recipe(blt::u32 value);
+
+ephemeral_recipe_t perlin_recipe(float variety, blt::i32 x_warp, blt::i32 y_warp, blt::i32 z_warp, float offset_x, float offset_y);
+
+ephemeral_recipe_t perlin_fbm_recipe(float rand, blt::i32 octaves, float gain, float lacunarity, float offset);
+
+/**
+ * Generates the pinned image a recipe describes, with the same pixels and evaluation cache key as when its parameters were
+ * first drawn. A recipe of kind none gives a blank image with no key.
+ */
+image_t make_ephemeral_image(const ephemeral_recipe_t& recipe);
+
+/**
+ * The recipe the ephemeral operator about to be called on this thread should use instead of drawing new parameters, or nullptr.
+ * blt::gp calls ephemeral operators itself when an operator is put into a tree, so this is how a loaded tree gets its images back.
+ */
+const ephemeral_recipe_t* replayed_ephemeral();
+
+/**
+ * Makes replayed_ephemeral() return recipe on this thread until the scope ends.
+ */
+class ephemeral_replay_t
+{
+public:
+	explicit ephemeral_replay_t(const ephemeral_recipe_t& recipe);
+
+	ephemeral_replay_t(const ephemeral_replay_t&) = delete;
+	ephemeral_replay_t& operator=(const ephemeral_replay_t&) = delete;
+
+	~ephemeral_replay_t();
+
+private:
+	const ephemeral_recipe_t* previous;
+};
+
+#endif //EPHEMERAL_IMAGE_H
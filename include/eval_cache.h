@@ -0,0 +1,110 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVAL_CACHE_H
+#define EVAL_CACHE_H
+
+#include <cstring>
+#include <string_view>
+#include <blt/std/types.h>
+
+struct image_istorage_t;
+
+/*
+ * Every image_t carries a structural key: a hash of the operator that produced it, that operator's parameters and the keys of
+ * its arguments. Identical subtrees anywhere in any population therefore produce identical keys. A key of 0 means the image
+ * depends on evaluation-time randomness and must never be cached, and it poisons every key built on top of it.
+ */
+
+constexpr blt::u64 mix_key(blt::u64 x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebull;
+	x ^= x >> 31;
+	return x;
+}
+
+constexpr blt::u64 op_tag(const std::string_view name)
+{
+	blt::u64 hash = 0xcbf29ce484222325ull;
+	for (const char c : name)
+	{
+		hash ^= static_cast<blt::u8>(c);
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+/**
+ * Combines an operator tag with argument keys or raw parameter values. Returns 0 if any argument key is 0.
+ */
+template <typename... Keys>
+constexpr blt::u64 combine_keys(const blt::u64 tag, const Keys... keys)
+{
+	blt::u64 hash = mix_key(tag);
+	bool valid = true;
+	((valid = valid && keys != 0, hash = mix_key(hash ^ (keys + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2)))), ...);
+	return valid ? (hash == 0 ? 1 : hash) : 0;
+}
+
+template <typename T>
+blt::u64 key_of_value(const T& value)
+{
+	static_assert(sizeof(T) <= sizeof(blt::u64), "Parameters must fit into a key");
+	blt::u64 bits = 0;
+	std::memcpy(&bits, &value, sizeof(T));
+	// keeps a zero parameter from poisoning the key
+	return bits ^ 0xa0761d6478bd642full;
+}
+
+struct eval_cache_stats_t
+{
+	blt::u64 hits = 0;
+	blt::u64 misses = 0;
+	blt::u64 insertions = 0;
+	blt::u64 evictions = 0;
+	blt::u64 entries = 0;
+	blt::u64 bytes = 0;
+	blt::u64 budget_bytes = 0;
+};
+
+/**
+ * Sets the memory budget of the cache, 0 disables it. Shrinking the budget evicts immediately.
+ */
+void set_eval_cache_budget(blt::size_t bytes);
+
+/**
+ * Looks up key and marks the entry as most recently used. Cached buffers are pinned and shared rather than copied.
+ * @return a buffer holding a new reference for the caller, or nullptr if the key is 0, the cache is disabled or the key is
+ * not present
+ */
+image_istorage_t* eval_cache_acquire(blt::u64 key);
+
+/**
+ * Shares data with the cache under key, pinning it so it is never overwritten in place. Evicts the least recently used
+ * entries of its shard to stay within budget.
+ */
+void eval_cache_store(blt::u64 key, image_istorage_t& data);
+
+void clear_eval_cache();
+
+eval_cache_stats_t get_eval_cache_stats();
+
+#endif //EVAL_CACHE_H
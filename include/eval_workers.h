@@ -0,0 +1,180 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVAL_WORKERS_H
+#define EVAL_WORKERS_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <blt/std/types.h>
+#include <sys/types.h>
+
+/*
+ * Fitness evaluation can be handed to separate worker processes, each with its own allocator, evaluation cache and OpenCV
+ * state. Every worker owns one slot of a POSIX shared memory object: the coordinator writes a request into it and posts the
+ * slot's request semaphore, the worker writes a fixed size response next to it and posts the response semaphore. A worker that
+ * crashes or takes longer than the timeout is killed and replaced, and only that one evaluation fails.
+ *
+ * A worker posts the slot's ready semaphore once it has set itself up, along with a hash of the configuration it evaluates
+ * with. Nothing is sent to it before that, so the timeout only covers evaluation, and a worker whose configuration differs from
+ * the coordinator's is retired rather than used. So is one that dies before it is ready or can't be restarted. Once every
+ * worker is retired the pool reports itself unavailable instead of blocking.
+ */
+
+enum class eval_outcome_t : blt::u8
+{
+	answered,
+	// the worker crashed or timed out and has been replaced, or the request was too large
+	failed,
+	// every worker has been retired, nothing will ever answer
+	unavailable
+};
+
+struct eval_worker_stats_t
+{
+	blt::u64 evaluations = 0;
+	// workers that died or were killed, each one costing a single evaluation
+	blt::u64 crashed = 0;
+	blt::u64 timed_out = 0;
+	// workers that can't be used any more, see the top of this file
+	blt::u64 retired = 0;
+};
+
+class eval_worker_pool_t
+{
+public:
+	eval_worker_pool_t(const eval_worker_pool_t&) = delete;
+
+	eval_worker_pool_t& operator=(const eval_worker_pool_t&) = delete;
+
+	/**
+	 * Stops the workers and removes the shared memory.
+	 */
+	~eval_worker_pool_t();
+
+	/**
+	 * Creates the shared memory and starts the workers by executing this program again with command followed by
+	 * --eval-worker NAME INDEX, see eval_worker_t.
+	 * @param request_bytes largest request a slot holds
+	 * @param response_bytes size of every response
+	 */
+	static std::unique_ptr<eval_worker_pool_t> start(const std::string& name, blt::u32 workers, blt::size_t request_bytes,
+													blt::size_t response_bytes, std::vector<std::string> command,
+													double timeout_seconds);
+
+	/**
+	 * The configuration hash workers must report to be used, see eval_worker_t::serve. Workers are checked against it before
+	 * every request, so it may change between generations.
+	 */
+	void set_configuration(blt::u64 configuration);
+
+	/**
+	 * Blocks until a worker is free and ready, hands it the request and waits for its response. Safe to call from any number of
+	 * threads.
+	 * @param response receives response_bytes if the outcome is answered
+	 */
+	eval_outcome_t evaluate(std::string_view request, char* response);
+
+	[[nodiscard]] blt::u32 size() const
+	{
+		return static_cast<blt::u32>(pids.size());
+	}
+
+	[[nodiscard]] eval_worker_stats_t get_stats();
+
+private:
+	eval_worker_pool_t() = default;
+
+	bool spawn(blt::u32 worker);
+
+	// kills a worker that is stuck or gone and starts another in its slot, false if that failed
+	bool replace(blt::u32 worker);
+
+	// waits for a freshly started worker to finish setting up, false if it died first
+	bool await_ready(blt::u32 worker);
+
+	// kills the worker for good, it never goes back into the idle list
+	void retire(blt::u32 worker);
+
+	std::string name;
+	void* mapping = nullptr;
+	blt::size_t mapping_size = 0;
+	std::vector<std::string> command;
+	double timeout_seconds = 0;
+	std::vector<pid_t> pids;
+	// per worker, only touched by the thread that took it from the idle list
+	std::vector<blt::u8> ready;
+	std::vector<blt::u64> worker_configuration;
+
+	std::mutex mutex;
+	std::condition_variable worker_idle;
+	std::vector<blt::u32> idle;
+	// workers not retired yet
+	blt::u32 live = 0;
+	blt::u64 configuration = 0;
+	eval_worker_stats_t stats;
+};
+
+class eval_worker_t
+{
+public:
+	eval_worker_t(const eval_worker_t&) = delete;
+
+	eval_worker_t& operator=(const eval_worker_t&) = delete;
+
+	~eval_worker_t();
+
+	static std::unique_ptr<eval_worker_t> attach(const std::string& name, blt::u32 index);
+
+	/**
+	 * Tells the coordinator this worker is ready and evaluates with the given configuration hash, then calls
+	 * func(request, response) for every request until the pool stops or the coordinator goes away. func must fill
+	 * response_bytes of response.
+	 */
+	template <typename Func>
+	void serve(const blt::u64 configuration, Func&& func)
+	{
+		announce(configuration);
+		std::string_view request;
+		char* response = nullptr;
+		while (next_request(request, response))
+		{
+			func(request, response);
+			respond();
+		}
+	}
+
+private:
+	eval_worker_t() = default;
+
+	void announce(blt::u64 configuration);
+
+	bool next_request(std::string_view& request, char*& response);
+
+	void respond();
+
+	void* mapping = nullptr;
+	blt::size_t mapping_size = 0;
+	blt::u32 index = 0;
+};
+
+#endif //EVAL_WORKERS_H
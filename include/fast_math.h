@@ -0,0 +1,170 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FAST_MATH_H
+#define FAST_MATH_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+#include <blt/std/types.h>
+
+// tables have 2^bits + 1 entries, see set_transcendental_accuracy
+constexpr blt::u32 DEFAULT_TRANSCENDENTAL_TABLE_BITS = 12;
+constexpr blt::u32 MAX_TRANSCENDENTAL_TABLE_BITS = 20;
+
+/**
+ * The log and exp operators produce values outside of [0, u32 max]. They have always been converted by truncating to 64 bits
+ * and keeping the low 32, this spells that out instead of relying on what the compiler emits for an out of range cast.
+ */
+inline blt::u32 wrap_to_u32(const double value)
+{
+	return static_cast<blt::u32>(static_cast<blt::i64>(value));
+}
+
+/**
+ * Linearly interpolated tables for the functions used by the transcendental image operators. Every input is a quantised u32
+ * divided by u32 max, so each function only has to be accurate over a fixed range. Functions that are unbounded or have an
+ * unbounded derivative near 0 (log, pow) are split into a binary exponent and a mantissa in [1, 2) so the table only covers
+ * the well behaved part. Built with 0 bits every function calls into libm instead.
+ */
+class transcendental_tables_t
+{
+public:
+	static constexpr double LIMIT = std::numeric_limits<blt::u32>::max();
+	static constexpr double SRGB_GAMMA = 1.0 / 2.2;
+
+	explicit transcendental_tables_t(blt::u32 table_bits);
+
+	[[nodiscard]] blt::u32 table_bits() const
+	{
+		return bits;
+	}
+
+	/**
+	 * @return sin(2 * pi * turns), for any turns
+	 */
+	[[nodiscard]] double sin_turns(const double turns) const
+	{
+		if (bits == 0)
+			return std::sin(turns * 2 * PI);
+		return interpolate(sine, turns - std::floor(turns));
+	}
+
+	/**
+	 * @return exp(x) for x in [0, 1]
+	 */
+	[[nodiscard]] double exp_unit(const double x) const
+	{
+		if (bits == 0)
+			return std::exp(x);
+		return interpolate(exponential, x);
+	}
+
+	/**
+	 * @return log(v / u32 max), v must not be 0
+	 */
+	[[nodiscard]] double log_pixel(const blt::u32 v) const
+	{
+		if (bits == 0)
+			return std::log(v / LIMIT);
+		const auto [exponent, mantissa] = split_pixel(v);
+		return exponent * LN_2 + interpolate(log_mantissa, mantissa) - LOG_LIMIT;
+	}
+
+	/**
+	 * @return pow(v / u32 max, 1 / 2.2)
+	 */
+	[[nodiscard]] double srgb_pixel(const blt::u32 v) const
+	{
+		if (bits == 0)
+			return std::pow(v / LIMIT, SRGB_GAMMA);
+		if (v == 0)
+			return 0;
+		const auto [exponent, mantissa] = split_pixel(v);
+		return srgb_exponent[exponent] * interpolate(srgb_mantissa, mantissa);
+	}
+
+	/**
+	 * @return the sRGB to linear transfer function of x in [0, 1]
+	 */
+	[[nodiscard]] float linear_unit(const float x) const
+	{
+		if (bits == 0)
+			return srgb_to_linear(x);
+		return static_cast<float>(interpolate(linear, x));
+	}
+
+	static float srgb_to_linear(const float v) noexcept
+	{
+		return (v <= 0.04045f) ? (v / 12.92f) : std::pow((v + 0.055f) / 1.055f, 2.4f);
+	}
+
+private:
+	static constexpr double PI = 3.14159265358979323846;
+	static constexpr double LN_2 = 0.69314718055994530942;
+	// log(u32 max), not quite 32 * ln 2
+	static const double LOG_LIMIT;
+
+	// v = 2^exponent * (1 + mantissa) with mantissa in [0, 1), v must not be 0
+	static std::pair<blt::i32, double> split_pixel(const blt::u32 v)
+	{
+		const auto leading_zeros = __builtin_clz(v);
+		const auto normalized = v << leading_zeros;
+		return {31 - leading_zeros, static_cast<double>(normalized & 0x7fffffffu) * (1.0 / 2147483648.0)};
+	}
+
+	// x in [0, 1], clamped so rounding at the top of the range can't read past the end
+	[[nodiscard]] double interpolate(const std::vector<float>& table, const double x) const
+	{
+		const auto scaled = x * scale;
+		const auto index = std::min(static_cast<blt::size_t>(scaled), table.size() - 2);
+		const auto fraction = scaled - static_cast<double>(index);
+		return table[index] + (table[index + 1] - table[index]) * fraction;
+	}
+
+	blt::u32 bits;
+	double scale = 0;
+	std::vector<float> sine;
+	std::vector<float> exponential;
+	std::vector<float> log_mantissa;
+	std::vector<float> srgb_mantissa;
+	std::vector<float> linear;
+	// pow(2^e / u32 max, 1 / 2.2) for each binary exponent of a u32
+	std::array<double, 32> srgb_exponent{};
+};
+
+/**
+ * Rebuilds the tables with 2^table_bits + 1 entries each, 0 switches the operators back to libm. More bits trade cache
+ * footprint for accuracy, see report_approximation_error. Clears the evaluation cache since cached results depend on it, so it
+ * must not be called while a generation is running.
+ */
+void set_transcendental_accuracy(blt::u32 table_bits);
+
+const transcendental_tables_t& get_transcendental_tables();
+
+/**
+ * Logs the largest error of each approximated operator against libm over a sweep of inputs, in units of the operator's output
+ * range, using the currently configured accuracy.
+ */
+void report_approximation_error();
+
+#endif //FAST_MATH_H
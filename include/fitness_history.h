@@ -0,0 +1,101 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef FITNESS_HISTORY_H
+#define FITNESS_HISTORY_H
+
+#include <array>
+#include <vector>
+#include <blt/std/types.h>
+
+/*
+ * A per-generation statistic kept at several resolutions in constant memory. Level 0 holds the last HISTORY_LEVEL_POINTS values
+ * as they were recorded, each level above holds the last HISTORY_LEVEL_POINTS buckets of HISTORY_LEVEL_FACTOR buckets of the
+ * level below, summarised by their min, max and mean. Reading a range picks the finest level that covers it in the points
+ * asked for, so drawing the whole run costs the same at generation 100 as at generation 100 million.
+ */
+
+constexpr blt::size_t HISTORY_LEVEL_POINTS = 1024;
+constexpr blt::size_t HISTORY_LEVEL_FACTOR = 4;
+// the top level spans 1024 * 4^11 generations, past that only the newest part of the run is kept
+constexpr blt::size_t HISTORY_LEVELS = 12;
+
+struct history_point_t
+{
+	// centre of the generations the point summarises
+	double generation;
+	float min;
+	float max;
+	float mean;
+};
+
+class history_series_t
+{
+public:
+	void push(float value);
+
+	/**
+	 * Replaces out with at most max_points points covering [first, last) of the recorded values, the newest of which may
+	 * summarise fewer values than the others. Whatever part of the range has already been dropped is left out.
+	 */
+	void read(blt::u64 first, blt::u64 last, blt::size_t max_points, std::vector<history_point_t>& out) const;
+
+	[[nodiscard]] blt::u64 size() const
+	{
+		return count;
+	}
+
+	void clear()
+	{
+		// buckets are always written before they are read again
+		count = 0;
+		for (auto& level : levels)
+			level.pending = {};
+	}
+
+private:
+	// the values of a bucket that isn't complete yet
+	struct accumulator_t
+	{
+		float min;
+		float max;
+		double sum;
+		blt::u64 values;
+
+		void add(float min_value, float max_value, double value_sum, blt::u64 value_count);
+	};
+
+	struct bucket_t
+	{
+		float min;
+		float max;
+		float mean;
+	};
+
+	struct level_t
+	{
+		// ring of completed buckets, bucket i is at i % HISTORY_LEVEL_POINTS
+		std::array<bucket_t, HISTORY_LEVEL_POINTS> buckets;
+		// unused on level 0, whose buckets are single values
+		accumulator_t pending;
+	};
+
+	blt::u64 count = 0;
+	std::array<level_t, HISTORY_LEVELS> levels{};
+};
+
+#endif //FITNESS_HISTORY_H
@@ -18,11 +18,49 @@
 
 #ifndef GP_SYSTEM_H
 #define GP_SYSTEM_H
+#include <eval_workers.h>
+#include <fitness_history.h>
 #include <image_storage.h>
+#include <island.h>
+#include <preview_snapshot.h>
+#include <reference_set.h>
 #include <blt/gp/tree.h>
 #include <blt/std/types.h>
 
-void setup_gp_system(blt::size_t population_size);
+// statistics recorded for each channel every generation
+enum class history_stat_t : blt::u8
+{
+	average,
+	best,
+	worst,
+	overall,
+	// mean and variance of the adjusted fitness
+	mean,
+	variance,
+	count
+};
+
+struct phase_timings_t
+{
+	blt::u64 create_generation_ns = 0;
+	blt::u64 next_generation_ns = 0;
+	blt::u64 evaluate_fitness_ns = 0;
+	blt::u64 statistics_ns = 0;
+	blt::u64 generations = 0;
+};
+
+struct screening_stats_t
+{
+	// individuals whose fitness was extrapolated from the row subsample / individuals scored on every pixel
+	blt::u64 screened = 0;
+	blt::u64 full = 0;
+};
+
+/**
+ * @param reference_paths images (or directories of images) the programs are scored against, see set_fitness_targets
+ * @return false if none of the references could be loaded
+ */
+bool setup_gp_system(blt::size_t population_size, blt::u64 seed = 0, const std::vector<std::string>& reference_paths = {"../silly.png"});
 
 void run_step();
 
@@ -36,22 +74,145 @@ void regenerate_image(blt::size_t index, float& image_storage, blt::i32 width, b
 
 void set_population_size(blt::u32 size);
 
-std::array<image_ipixel_t, IMAGE_DIMENSIONS * IMAGE_DIMENSIONS * 3>& get_image(blt::size_t index);
-
 void cleanup();
 
 const std::array<image_storage_t, 3>& get_reference_image();
 
 std::array<size_t, 3> get_best_image_index();
 
-std::array<image_pixel_t, IMAGE_DIMENSIONS * IMAGE_DIMENSIONS * 3> to_gl_image(const std::array<image_storage_t, 3>& image);
+std::vector<image_pixel_t> to_gl_image(const std::array<image_storage_t, 3>& image);
 
-std::tuple<const std::vector<float>&, const std::vector<float>&, const std::vector<float>&, const std::vector<float>&> get_fitness_history();
+/**
+ * Replaces out with at most max_points points of a channel's statistic over generations [first, last), at the finest
+ * resolution still kept that fits, see history_series_t. Safe to call from any thread.
+ */
+void read_fitness_history(blt::size_t channel, history_stat_t stat, blt::u64 first, blt::u64 last, blt::size_t max_points,
+						std::vector<history_point_t>& out);
 
 std::array<blt::gp::population_t*, 3> get_populations();
 
 void set_use_gamma_correction(bool use);
 
-std::pair<std::array<std::vector<float>, 3>&, std::array<std::vector<float>, 3>&> get_mean_and_variance();
+const phase_timings_t& get_phase_timings();
+
+/**
+ * When disabled setup_gp_system only builds the programs' operators and loads the references, without generating or
+ * evaluating an initial population. That is all an evaluation worker needs, and it keeps a restarted worker's setup short.
+ * Must be called before setup_gp_system.
+ */
+void set_population_generation(bool generate);
+
+/**
+ * When enabled (the default) run_step runs the red, green and blue programs' generations concurrently rather than one after
+ * another. Must not be changed while run_step is executing.
+ */
+void set_concurrent_channels(bool concurrent);
+
+/**
+ * Worker threads used by each channel's program, 0 uses every core. Only takes effect if called before setup_gp_system.
+ * With concurrent channels the three pools have more threads than there are cores, but only as many evaluations as there
+ * are cores run at once across all of them, so the cores of a channel that finished early go to the channels still running.
+ */
+void set_thread_count(blt::size_t threads);
+
+/**
+ * Enables multi-fidelity fitness. Individuals are first scored on every 16th row (the rows rotate each generation) and only
+ * those whose partial error is still below the error at the given quantile of the previous generation get scored on every
+ * pixel, the rest keep the extrapolated estimate. Since the partial error is a lower bound, anything at or better than the
+ * cutoff is always scored exactly. 0 (the default) scores everything exactly.
+ */
+void set_fitness_screening(double quantile);
+
+screening_stats_t get_screening_stats();
+
+/**
+ * With several references an individual's error is the mean or the max of its errors against each of them. Each output is
+ * compared against every target a chunk at a time, so the cost of evaluating the tree is shared between the targets.
+ * A target of 0 or more scores against that reference alone. Must be called before setup_gp_system.
+ */
+void set_fitness_targets(target_aggregate_t aggregate, blt::i64 target = -1);
+
+/**
+ * Saves a checkpoint to path every interval generations from run_step, 0 disables periodic checkpoints.
+ */
+void set_checkpointing(const std::string& path, blt::u32 interval);
+
+/**
+ * Captures the populations with their fitness, the fitness histories, the reference images, the random and screening state
+ * and the settings the run evolves under between generations, then writes them to path on a background thread. Ephemeral
+ * images are stored as the parameters they were generated from. cleanup waits for pending writes.
+ */
+void save_checkpoint(const std::string& path);
+
+/**
+ * Restores a checkpoint into the programs built by setup_gp_system, which must have been called with the same population
+ * size, resolution, screening quantile, table bits and gamma correction. The resumed run continues exactly as the original would have when each program runs on a single
+ * thread, with more threads the order in which they draw random numbers isn't reproducible in the first place. If this fails
+ * part way the state is inconsistent and the run should not continue.
+ */
+bool load_checkpoint(const std::string& path);
+
+/**
+ * Every interval generations run_step writes the best individual of each channel, composed into one RGB image, to
+ * directory/generation_NNNNNN.png. 0 disables periodic exports. The directory is created if needed.
+ */
+void set_image_export(const std::string& directory, blt::u32 interval);
+
+/**
+ * Snapshots the current best individual of each channel and hands it to the export thread, which encodes it as a PNG at path.
+ * Only the copy of the three channels happens on the calling thread. cleanup waits for queued exports.
+ */
+void export_best_image(const std::string& path);
+
+/**
+ * Makes this process one island of a multi-process run. Every interval generations run_step sends copies of the best migrants
+ * individuals of each channel, with their fitness, to the islands the topology connects it to, then replaces its worst
+ * individuals with whatever migrants have arrived since. The link must outlive the run, nullptr or an interval of 0 disables
+ * migration. Fitness is sent rather than recomputed, so every island must score against the same references.
+ */
+void set_island_migration(island_link_t* link, island_topology_t topology, blt::u32 interval, blt::u32 migrants);
+
+/**
+ * When enabled run_step packs the displayed previews and the best image into an RGBA8 snapshot at the end of each
+ * generation, for the UI to pick up with acquire_preview_snapshot. Off by default so headless runs don't pay for it.
+ */
+void set_preview_snapshots(bool enabled);
+
+/**
+ * Keeps previews of individuals [0, count) of each generation, the best output of each channel is always kept for
+ * export_best_image and the snapshot. 0 by default. Can be called at any time, it takes effect from the next generation.
+ */
+void set_preview_count(blt::size_t count);
+
+/**
+ * Only for the one thread displaying the previews, which doesn't have to synchronise with run_step in any way.
+ * @return the snapshot of the newest generation if there is one it hasn't seen yet, otherwise nullptr. It stays valid and
+ * unchanged until the next call
+ */
+preview_snapshot_t* acquire_preview_snapshot();
+
+/**
+ * Sends every fitness evaluation to a pool of worker processes started with evaluation_request_bytes and
+ * evaluation_response_bytes, nullptr evaluates in process again. The programs' threads then only wait on the workers, so
+ * the pool should have about as many workers as all three programs have threads. Without return_images the workers only
+ * send back fitness, the previews and exported images then stay blank. Must not be changed while a generation is running.
+ */
+void set_evaluation_workers(eval_worker_pool_t* pool, bool return_images = true);
+
+blt::size_t evaluation_request_bytes();
+
+blt::size_t evaluation_response_bytes();
+
+/**
+ * @return evaluations lost to a worker crashing or timing out, those individuals are given the worst possible fitness
+ */
+blt::u64 get_failed_evaluations();
+
+/**
+ * The body of an evaluation worker process, called instead of running the GP system once setup_gp_system has built the
+ * programs with the coordinator's options, without a population. Serves requests until the pool is stopped.
+ * @return process exit code
+ */
+int run_evaluation_worker(const std::string& pool_name, blt::u32 index);
 
 #endif //GP_SYSTEM_H
@@ -0,0 +1,121 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <optional>
+#include <string>
+#include <vector>
+#include <island.h>
+#include <reference_set.h>
+#include <blt/std/types.h>
+
+struct run_options_t
+{
+	bool headless = false;
+	blt::size_t population_size = 64;
+	// 0 means run until the programs report they should terminate
+	blt::u32 generation_limit = 100;
+	// 0 means pick a random seed
+	blt::u64 seed = 0;
+	// images or directories of images to evolve towards, repeating --reference adds more
+	std::vector<std::string> reference_paths{"../silly.png"};
+	// decoded references are cached here, empty disables the cache and nullopt uses the default. see set_reference_cache_directory
+	std::optional<std::string> reference_cache;
+	target_aggregate_t target_aggregate = target_aggregate_t::mean;
+	// only score against this reference, -1 uses all of them
+	blt::i64 fitness_target = -1;
+	bool use_gamma_correction = false;
+	bool concurrent_channels = true;
+	// worker threads per channel program, 0 uses every core. concurrent channels share the cores, see set_thread_count
+	blt::size_t threads = 0;
+	// memory budget of the subtree evaluation cache, 0 disables it
+	blt::size_t eval_cache_mib = 512;
+	// side length of the evolved images, a power of two. see set_image_dimensions
+	blt::i32 resolution = 256;
+	// fraction of each generation that is always scored on every pixel, 0 disables subsample screening
+	double screening_quantile = 0;
+	// log2 of the transcendental operators' table sizes, 0 uses libm. see set_transcendental_accuracy
+	blt::u32 transcendental_table_bits = 12;
+	// print the approximation error of the transcendental operators and exit
+	bool report_approximation = false;
+	// evaluate every point-wise operator over the whole image as soon as it is called. see set_lazy_evaluation
+	bool eager_pointwise = false;
+	// where checkpoints are written, empty disables them. see save_checkpoint
+	std::string checkpoint_path;
+	// generations between periodic checkpoints, 0 only writes one when the run ends
+	blt::u32 checkpoint_interval = 100;
+	// checkpoint to continue from instead of starting a new run
+	std::string resume_path;
+	// directory the best images are exported to, empty disables exporting. see set_image_export
+	std::string export_directory;
+	// generations between exported images, 0 only exports the final result
+	blt::u32 export_interval = 0;
+	// processes evolving separate populations that swap migrants, 1 runs a single population. see island.h
+	blt::u32 islands = 1;
+	// which island this process is, -1 forks every island from this process
+	blt::i64 island_index = -1;
+	// shared memory object the islands meet in, empty picks one from the process id when forking
+	std::string island_name;
+	island_topology_t island_topology = island_topology_t::ring;
+	// generations between migrations
+	blt::u32 migration_interval = 10;
+	// individuals sent per channel each migration
+	blt::u32 migrants = 2;
+	// processes fitness is evaluated in, 0 evaluates on the programs' own threads. see eval_workers.h
+	blt::u32 eval_workers = 0;
+	// seconds an evaluation may take before its worker is killed
+	double eval_timeout = 30;
+	// have workers send back the output images for the previews and exports
+	bool eval_worker_images = true;
+	// CSV file per-operator timings are written to every generation, empty disables profiling. see operator_profile.h
+	std::string operator_profile_path;
+	// false builds the programs without a population, which is all an evaluation worker needs. see set_population_generation
+	bool generate_population = true;
+	// set when this process was started as an evaluation worker
+	std::string eval_worker_pool;
+	blt::i64 eval_worker_index = -1;
+	// the command line this process was started with, workers are started with the same options
+	std::vector<std::string> arguments;
+};
+
+run_options_t parse_run_options(int argc, const char* const* argv);
+
+/**
+ * Applies the options and builds the programs. Shared by the window, headless runs and evaluation workers, which must all
+ * build identical programs from the same command line.
+ * @return false if the options are invalid or the references couldn't be loaded, the error has been logged
+ */
+bool configure_gp_system(const run_options_t& options);
+
+/**
+ * Runs the GP system in a tight loop without creating a window, then prints throughput and per-phase timings. With more than
+ * one island this is called once and forks the others, unless an island index was given.
+ * @return process exit code
+ */
+int run_headless(run_options_t options);
+
+/**
+ * Body of a process started with --eval-worker: builds the programs from the same options as the coordinator and evaluates
+ * whatever it is sent. See run_evaluation_worker.
+ * @return process exit code
+ */
+int run_eval_worker(run_options_t options);
+
+#endif //HEADLESS_H
@@ -0,0 +1,58 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_EXPORT_H
+#define IMAGE_EXPORT_H
+
+#include <string>
+#include <vector>
+#include <image_storage.h>
+
+// snapshots waiting to be encoded, anything beyond this is dropped rather than making the GP thread wait
+constexpr blt::size_t MAX_PENDING_EXPORTS = 8;
+
+struct image_export_t
+{
+	std::string path;
+	blt::i32 dimensions = 0;
+	// interleaved RGB8 in the layout of the evolved images: pixel column * dimensions + row is that column of the picture at
+	// that row counted from the bottom, the transposed and flipped layout image_storage_t::from_file loads references in
+	std::vector<blt::u8> pixels;
+};
+
+struct image_export_stats_t
+{
+	blt::u64 written = 0;
+	blt::u64 dropped = 0;
+	blt::u64 failed = 0;
+};
+
+/**
+ * Queues a snapshot to be written as a PNG by a background thread. Never blocks, if the queue is full the snapshot is dropped
+ * and counted.
+ */
+void submit_image_export(image_export_t image);
+
+/**
+ * Blocks until every queued snapshot has been written.
+ */
+void wait_for_image_exports();
+
+image_export_stats_t get_image_export_stats();
+
+#endif //IMAGE_EXPORT_H
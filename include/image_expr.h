@@ -0,0 +1,109 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_EXPR_H
+#define IMAGE_EXPR_H
+
+#include <vector>
+#include <image_storage.h>
+
+/*
+ * Operators whose output pixel only depends on the same pixel of their inputs are deferred. Each one appends itself to a postfix
+ * program over the buffers its inputs were last materialised into, and the program runs once something needs the pixels
+ * (a neighbourhood operator, the fitness function, ...). The program is then compiled to register bytecode with each
+ * operator's kernel resolved up front, and run over the image a chunk at a time so the leaves are read once, the intermediate
+ * results of the chain stay in L1 and only the final result is written out.
+ */
+
+enum class pixel_op_t : blt::u8
+{
+	leaf,
+	add,
+	sub,
+	mul,
+	div,
+	mod,
+	bit_or,
+	bit_and,
+	bit_xor,
+	bit_not,
+	max,
+	min,
+	sin,
+	sin_off,
+	cos,
+	cos_off,
+	log,
+	exp,
+	srgb,
+	linear,
+	grad
+};
+
+// bounds the per-chunk scratch space, longer chains are materialised part way
+constexpr blt::size_t MAX_EXPR_INSTRUCTIONS = 64;
+constexpr blt::size_t MAX_EXPR_DEPTH = 8;
+constexpr blt::size_t MAX_EXPR_LEAVES = 32;
+// pixels per chunk, 2 KiB per intermediate so a full set of registers fits in L1 next to the chunk of each leaf
+constexpr blt::size_t EXPR_CHUNK_PIXELS = 512;
+
+struct image_expr_t
+{
+	struct instruction_t
+	{
+		pixel_op_t op;
+		// index into leaves for pixel_op_t::leaf
+		blt::u8 leaf = 0;
+	};
+
+	std::vector<instruction_t> program;
+	// one reference held for each entry
+	std::vector<image_istorage_t*> leaves;
+	// set once evaluated, program and leaves are released at that point
+	image_istorage_t* result = nullptr;
+	blt::u32 refs = 1;
+	// most intermediates alive at once while running the program
+	blt::u32 depth = 1;
+	// the last operator is worth putting the result in the evaluation cache for
+	bool expensive = false;
+};
+
+struct image_expr_stats_t
+{
+	// expressions evaluated and the point-wise operators they contained
+	blt::u64 materialized = 0;
+	blt::u64 operations = 0;
+};
+
+/**
+ * Defers a point-wise operator on its inputs. Transcendental operators look their key up in the evaluation cache first and
+ * store their result there once evaluated.
+ */
+image_t pointwise_image(pixel_op_t op, blt::u64 key, const image_t& a);
+
+image_t pointwise_image(pixel_op_t op, blt::u64 key, const image_t& a, const image_t& b);
+
+/**
+ * When disabled every point-wise operator is evaluated on its own over the whole image as soon as it is called. Enabled by
+ * default, must not be changed while a generation is running.
+ */
+void set_lazy_evaluation(bool enabled);
+
+image_expr_stats_t get_image_expr_stats();
+
+#endif //IMAGE_EXPR_H
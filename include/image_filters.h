@@ -0,0 +1,49 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_FILTERS_H
+#define IMAGE_FILTERS_H
+
+#include <image_storage.h>
+
+/*
+ * Neighbourhood filters working directly on square u32 images, replacing the OpenCV float round trip the operators used to
+ * make. They follow OpenCV's conventions (centred anchor, size / 2 pixels before it) so evolved trees keep their meaning.
+ * Scratch space is kept per thread, and src may be the same buffer as dst.
+ */
+
+/**
+ * Erosion by a size x size rectangle, equivalent to cv::erode with MORPH_RECT. Pixels outside the image are ignored.
+ * Separable van Herk / Gil-Werman min filter, so the cost per pixel does not depend on size.
+ */
+void erode_rect(const image_ipixel_t* src, image_ipixel_t* dst, blt::i32 dimensions, blt::i32 size);
+
+/**
+ * Dilation by a size x size cross, equivalent to cv::dilate with MORPH_CROSS: the larger of a horizontal and a vertical
+ * van Herk max filter.
+ */
+void dilate_cross(const image_ipixel_t* src, image_ipixel_t* dst, blt::i32 dimensions, blt::i32 size);
+
+/**
+ * Difference of two Gaussian blurs (the sigma_high blur minus the sigma_low blur), both with an odd kernel_size and a
+ * reflect-101 border like cv::GaussianBlur, min-max normalised to the full pixel range.
+ */
+void band_pass(const image_ipixel_t* src, image_ipixel_t* dst, blt::i32 dimensions, blt::i32 kernel_size, float sigma_low,
+			float sigma_high);
+
+#endif //IMAGE_FILTERS_H
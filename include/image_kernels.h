@@ -0,0 +1,71 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_KERNELS_H
+#define IMAGE_KERNELS_H
+
+#include <blt/std/types.h>
+
+using binary_kernel_t = void (*)(blt::u32* out, const blt::u32* a, const blt::u32* b, blt::size_t count);
+using unary_kernel_t = void (*)(blt::u32* out, const blt::u32* a, blt::size_t count);
+using error_kernel_t = double (*)(const blt::u32* ours, const float* theirs, blt::size_t count);
+using error_lut_kernel_t = double (*)(const blt::u32* ours, const float* theirs, const float* lut, blt::size_t count);
+
+// the gamma lookup table is indexed by the top GAMMA_LUT_BITS of a pixel and linearly interpolated using the remaining bits
+constexpr blt::u32 GAMMA_LUT_BITS = 12;
+constexpr blt::size_t GAMMA_LUT_SIZE = (1u << GAMMA_LUT_BITS) + 1;
+
+/**
+ * Element-wise kernels over u32 pixel arrays. All kernels allow out to alias either input.
+ * Integer semantics match plain C++ on blt::u32, division and modulo by zero produce zero.
+ */
+struct kernel_table_t
+{
+	const char* name;
+
+	binary_kernel_t add;
+	binary_kernel_t sub;
+	binary_kernel_t mul;
+	binary_kernel_t div;
+	binary_kernel_t mod;
+	binary_kernel_t bit_or;
+	binary_kernel_t bit_and;
+	binary_kernel_t bit_xor;
+	binary_kernel_t max;
+	binary_kernel_t min;
+
+	unary_kernel_t bit_not;
+
+	// sum of (ours / u32 max - theirs)^2
+	error_kernel_t squared_error;
+	// sum of (lut(ours) - theirs)^2, lut must hold GAMMA_LUT_SIZE entries
+	error_lut_kernel_t squared_error_lut;
+};
+
+const kernel_table_t* make_scalar_kernels();
+const kernel_table_t* make_sse4_kernels();
+const kernel_table_t* make_avx2_kernels();
+const kernel_table_t* make_avx512_kernels();
+
+/**
+ * Returns the widest kernel set supported by the running CPU. The choice is made once and can be overridden by setting
+ * the IMAGE_GP_KERNELS environment variable to one of scalar, sse4, avx2 or avx512.
+ */
+const kernel_table_t& get_kernels();
+
+#endif //IMAGE_KERNELS_H
@@ -0,0 +1,45 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_NOISE_H
+#define IMAGE_NOISE_H
+
+#include <image_storage.h>
+
+/*
+ * Perlin noise images generated a whole image at a time by FastNoise2, which picks its SIMD level at runtime. Pixel i is
+ * sampled at x = (i % dimensions) / dimensions, y = i / dimensions^2, the coordinates the stb_perlin based operators used.
+ * Noise in [-1, 1] is scaled by u32 max and wrapped into a pixel like before, see wrap_to_u32.
+ */
+
+/**
+ * 3D Perlin noise where each pixel's z coordinate comes from the matching pixel of src, scaled by z_scale.
+ */
+void perlin_from_image(const image_ipixel_t* src, image_ipixel_t* dst, blt::i32 dimensions, double z_scale);
+
+/**
+ * A slice of 3D Perlin noise at depth z, with the x and y coordinates scaled independently.
+ */
+void perlin_plane(image_ipixel_t* dst, blt::i32 dimensions, float scale_x, float scale_y, float z, blt::i32 seed);
+
+/**
+ * A slice of fractal Brownian motion over Perlin noise at depth z.
+ */
+void perlin_fbm_plane(image_ipixel_t* dst, blt::i32 dimensions, float scale, float z, blt::i32 octaves, float gain, float lacunarity);
+
+#endif //IMAGE_NOISE_H
@@ -0,0 +1,91 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_POOL_H
+#define IMAGE_POOL_H
+
+#include <blt/std/types.h>
+
+struct image_istorage_t;
+
+struct image_pool_stats_t
+{
+	// buffers handed out / buffers whose last reference was released
+	blt::u64 allocated = 0;
+	blt::u64 deallocated = 0;
+	// operator results written into the buffer of an argument that was about to be dropped, see image_t::output_for
+	blt::u64 reused = 0;
+	// acquisitions served by the calling thread's cache
+	blt::u64 hits = 0;
+	// acquisitions that had to refill the thread cache from the global free list
+	blt::u64 refills = 0;
+	// acquisitions that had to allocate a new block
+	blt::u64 misses = 0;
+	// blocks released by a different thread than the one that acquired them
+	blt::u64 cross_thread_returns = 0;
+	// number of blocks ever allocated, blocks are only returned to the system when the resolution changes so this is the
+	// pool's high-water mark
+	blt::u64 blocks_created = 0;
+	// free blocks currently sitting in thread caches and in the global free list
+	blt::u64 thread_cached = 0;
+	blt::u64 global_free = 0;
+};
+
+/**
+ * Image buffers are recycled through a small per-thread cache. When a thread's cache runs dry it takes the entire lock-free
+ * global free list and gives back anything over its limit, and when a cache overflows half of it is pushed back to the
+ * global list so other threads can pick it up.
+ */
+image_istorage_t* acquire_image_storage();
+
+/**
+ * Buffers are reference counted. acquire_image_storage hands out a buffer holding one reference, release drops one and
+ * returns the buffer to the pool once none are left.
+ */
+void retain_image_storage(image_istorage_t* storage);
+
+void release_image_storage(image_istorage_t* storage);
+
+/**
+ * A pinned buffer is shared with something that outlives evaluation (a tree's ephemeral value or the evaluation cache) and
+ * must never be written to in place. The pin is cleared when the buffer goes back to the pool.
+ */
+void pin_image_storage(image_istorage_t* storage);
+
+/**
+ * @return true if the caller holds the only reference to an unpinned buffer, making it safe to overwrite
+ */
+bool is_image_storage_exclusive(const image_istorage_t* storage);
+
+/**
+ * Counts a buffer being reused as an operator's output, only used for statistics.
+ */
+void note_image_storage_reused();
+
+/**
+ * @return buffers the calling thread has acquired so far, cheap enough to sample around a single operator
+ */
+blt::u64 thread_image_acquisitions();
+
+/**
+ * Sums the per-thread counters. Counters are only written by their owning thread, so this is cheap but not an atomic
+ * snapshot.
+ */
+image_pool_stats_t get_image_pool_stats();
+
+#endif //IMAGE_POOL_H
@@ -20,12 +20,14 @@
 #define IMAGE_STORAGE_H
 
 #include <array>
-#include <atomic>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include <blt/logging/logging.h>
 #include <blt/std/types.h>
-#include <mutex>
 #include <blt/std/hashmap.h>
+#include <image_pool.h>
 
 #ifndef BLT_IMAGE_SIZE
 #define BLT_IMAGE_SIZE 256
@@ -33,112 +35,254 @@
 
 using image_pixel_t = float;
 using image_ipixel_t = blt::u32;
-constexpr blt::i32 IMAGE_DIMENSIONS = 256;
 constexpr blt::i32 IMAGE_CHANNELS = 1;
 
-constexpr blt::size_t IMAGE_SIZE = IMAGE_DIMENSIONS * IMAGE_DIMENSIONS;
-constexpr blt::size_t IMAGE_SIZE_CHANNELS = IMAGE_SIZE * IMAGE_CHANNELS;
-constexpr blt::size_t IMAGE_SIZE_BYTES = IMAGE_SIZE_CHANNELS * sizeof(image_ipixel_t);
+// side length of every image, picked at startup with set_image_dimensions. see image_dimensions()
+inline blt::i32 g_image_dimensions = BLT_IMAGE_SIZE;
+
+[[nodiscard]] inline blt::i32 image_dimensions()
+{
+	return g_image_dimensions;
+}
+
+[[nodiscard]] inline blt::size_t image_size()
+{
+	return static_cast<blt::size_t>(g_image_dimensions) * static_cast<blt::size_t>(g_image_dimensions);
+}
+
+[[nodiscard]] inline blt::size_t image_size_channels()
+{
+	return image_size() * IMAGE_CHANNELS;
+}
+
+[[nodiscard]] inline blt::size_t image_size_bytes()
+{
+	return image_size_channels() * sizeof(image_ipixel_t);
+}
+
+/**
+ * Changes the resolution every image is evaluated at. Must be called before setup_gp_system, images that are still alive keep
+ * the size they were created with and pooled buffers of the old size are freed as they come back out of the pool.
+ * @return false if the size is rejected (not a power of two between 16 and 4096)
+ */
+bool set_image_dimensions(blt::i32 dimensions);
+
+/**
+ * Calls func with the image dimensions as a std::integral_constant for the common sizes so coordinate maths can be folded
+ * by the compiler, and as a plain blt::i32 otherwise.
+ */
+template <typename Func>
+decltype(auto) dispatch_dimensions(Func&& func)
+{
+	switch (image_dimensions())
+	{
+		case 64:
+			return std::forward<Func>(func)(std::integral_constant<blt::i32, 64>{});
+		case 128:
+			return std::forward<Func>(func)(std::integral_constant<blt::i32, 128>{});
+		case 256:
+			return std::forward<Func>(func)(std::integral_constant<blt::i32, 256>{});
+		case 512:
+			return std::forward<Func>(func)(std::integral_constant<blt::i32, 512>{});
+		case 1024:
+			return std::forward<Func>(func)(std::integral_constant<blt::i32, 1024>{});
+		default:
+			return std::forward<Func>(func)(image_dimensions());
+	}
+}
+
+// non-owning view over a pixel buffer, enough of the std::array interface for the operators to not care
+template <typename T>
+struct pixel_span_t
+{
+	T* ptr = nullptr;
+	blt::size_t count = 0;
+
+	[[nodiscard]] T* data() const
+	{
+		return ptr;
+	}
+
+	[[nodiscard]] blt::size_t size() const
+	{
+		return count;
+	}
+
+	[[nodiscard]] T* begin() const
+	{
+		return ptr;
+	}
+
+	[[nodiscard]] T* end() const
+	{
+		return ptr + count;
+	}
+
+	T& operator[](const blt::size_t index) const
+	{
+		return ptr[index];
+	}
+};
 
 struct image_storage_t
 {
-	std::array<image_pixel_t, IMAGE_SIZE_CHANNELS> data;
+	image_storage_t(): dimensions(image_dimensions()), data(image_size_channels())
+	{}
+
+	blt::i32 dimensions;
+	std::vector<image_pixel_t> data;
 
 	static std::array<image_storage_t, 3> from_file(const std::string& path);
 
 	image_pixel_t& get(const blt::size_t x, const blt::size_t y)
 	{
-		return data[(y * IMAGE_DIMENSIONS + x) * IMAGE_CHANNELS];
+		return data[(y * dimensions + x) * IMAGE_CHANNELS];
 	}
 
 	[[nodiscard]] const image_pixel_t& get(const blt::size_t x, const blt::size_t y) const
 	{
-		return data[(y * IMAGE_DIMENSIONS + x) * IMAGE_CHANNELS];
+		return data[(y * dimensions + x) * IMAGE_CHANNELS];
 	}
 
 	void normalize();
 };
 
+/**
+ * Pixels live directly after the pool block holding this struct, see image_pool.cpp. The buffer is 64 byte aligned.
+ */
 struct image_istorage_t
 {
-	std::array<image_ipixel_t, IMAGE_SIZE_CHANNELS> data;
+	blt::i32 dimensions = 0;
+	pixel_span_t<image_ipixel_t> data;
 
 	static std::array<image_storage_t, 3> from_file(const std::string& path);
 
 	image_ipixel_t& get(const blt::size_t x, const blt::size_t y)
 	{
-		return data[(y * IMAGE_DIMENSIONS + x) * IMAGE_CHANNELS];
+		return data[(y * dimensions + x) * IMAGE_CHANNELS];
 	}
 
 	[[nodiscard]] const image_ipixel_t& get(const blt::size_t x, const blt::size_t y) const
 	{
-		return data[(y * IMAGE_DIMENSIONS + x) * IMAGE_CHANNELS];
+		return data[(y * dimensions + x) * IMAGE_CHANNELS];
 	}
 
 	void normalize();
 };
 
-inline std::atomic_uint64_t g_allocated_blocks = 0;
-inline std::atomic_uint64_t g_deallocated_blocks = 0;
+/*
+ * Point-wise operators don't compute their result straight away, they return an image holding an image_expr_t: the chain of
+ * point-wise operations since the last materialised buffers. The chain is evaluated the first time its pixels are needed, see
+ * image_expr.h. Copies of an image_t share the expression, so whichever copy materialises it does so for all of them.
+ */
+struct image_expr_t;
 
-inline std::mutex g_image_list_mutex;
+image_istorage_t* materialize_image_expr(image_expr_t* expr, blt::u64 key);
 
-struct image_cleaner_t
-{
-	~image_cleaner_t()
-	{
-		for (auto v : images)
-			delete v;
-	}
+void retain_image_expr(image_expr_t* expr);
+
+void release_image_expr(image_expr_t* expr);
 
-	std::vector<image_istorage_t*> images;
+bool is_image_expr_exclusive(const image_expr_t* expr);
+
+enum class ephemeral_kind_t : blt::u32
+{
+	none,
+	noise,
+	constant,
+	perlin,
+	perlin_fbm
 };
 
-inline image_cleaner_t g_image_list;
+/**
+ * The parameters an ephemeral image was generated from. The pointers in an image_t mean nothing outside the process that
+ * made it, so this is what ephemeral images are serialised as and regenerated from, see ephemeral_image.h.
+ */
+struct ephemeral_recipe_t
+{
+	ephemeral_kind_t kind = ephemeral_kind_t::none;
+	// floats are stored by their bits
+	std::array<blt::u32, 5> params{};
+};
 
 struct image_t
 {
-	explicit image_t()
-	{
-		image_istorage_t* front = nullptr;
-		{
-			std::scoped_lock lock(g_image_list_mutex);
-			if (!g_image_list.images.empty())
-			{
-				front = g_image_list.images.back();
-				g_image_list.images.pop_back();
-			}
-		}
-		if (front)
-			data = front;
+	explicit image_t(): data(acquire_image_storage())
+	{}
+
+	/**
+	 * Wraps a buffer the caller already holds a reference for, ownership of that reference moves to this image.
+	 */
+	explicit image_t(image_istorage_t* shared, const blt::u64 key): data(shared), key(key)
+	{}
+
+	/**
+	 * Wraps an unevaluated expression the caller holds a reference for.
+	 */
+	explicit image_t(image_expr_t* expr, const blt::u64 key): data(nullptr), expr(expr), key(key)
+	{}
+
+	/**
+	 * Returns an image for an operator to write its result into. Operator arguments are dropped by the GP system right after
+	 * the call, so if this image holds the only reference to an unpinned argument buffer that buffer is reused rather than
+	 * acquiring a new one. Every kernel reads and writes the same pixel index, so the result may alias its inputs.
+	 */
+	template <typename... Args>
+	static image_t output_for(const Args&... args)
+	{
+		image_istorage_t* reusable = nullptr;
+		((reusable = reusable == nullptr && args.is_exclusive() ? args.storage() : reusable), ...);
+		if (reusable == nullptr)
+			return image_t{};
+		retain_image_storage(reusable);
+		note_image_storage_reused();
+		return image_t{reusable, 0};
+	}
+
+	/**
+	 * @return another reference to the same pixels (or the same pending expression)
+	 */
+	[[nodiscard]] image_t share() const
+	{
+		if (expr)
+			retain_image_expr(expr);
 		else
-			data = new image_istorage_t{};
-		++g_allocated_blocks;
+			retain_image_storage(data);
+		image_t copy = *this;
+		return copy;
 	}
 
 	void drop()
 	{
-		{
-			std::scoped_lock lock(g_image_list_mutex);
-			g_image_list.images.push_back(data);
-		}
+		if (expr)
+			release_image_expr(expr);
+		else
+			release_image_storage(data);
 		data = nullptr;
-		++g_deallocated_blocks;
+		expr = nullptr;
+	}
+
+	/**
+	 * Marks the buffer as shared with something that outlives evaluation so it is never overwritten in place.
+	 */
+	void pin() const
+	{
+		pin_image_storage(storage());
 	}
 
 	[[nodiscard]] void* as_void_const() const
 	{
-		return const_cast<void*>(static_cast<const void*>(data->data.data()));
+		return const_cast<void*>(static_cast<const void*>(storage()->data.data()));
 	}
 
 	[[nodiscard]] void* as_void() const
 	{
-		return data->data.data();
+		return storage()->data.data();
 	}
 
 	void normalize() const
 	{
-		data->normalize();
+		storage()->normalize();
 	}
 
 	friend image_t operator+(const image_t& lhs, const image_t& rhs);
@@ -151,16 +295,69 @@ struct image_t
 
 	image_istorage_t& get_data()
 	{
-		return *data;
+		return *storage();
 	}
 
 	[[nodiscard]] const image_istorage_t& get_data() const
 	{
-		return *data;
+		return *storage();
+	}
+
+	/**
+	 * @return the buffer holding this image's pixels, evaluating a pending expression first
+	 */
+	[[nodiscard]] image_istorage_t* storage() const
+	{
+		if (expr)
+			return materialize_image_expr(expr, key);
+		return data;
+	}
+
+	/**
+	 * @return the pending expression or nullptr if the pixels are already in a buffer
+	 */
+	[[nodiscard]] image_expr_t* get_expr() const
+	{
+		return expr;
+	}
+
+	/**
+	 * @return true if nothing but this image references its pixels, which can then be overwritten in place
+	 */
+	[[nodiscard]] bool is_exclusive() const
+	{
+		if (expr && !is_image_expr_exclusive(expr))
+			return false;
+		return is_image_storage_exclusive(storage());
+	}
+
+	[[nodiscard]] blt::u64 get_key() const
+	{
+		return key;
+	}
+
+	void set_key(const blt::u64 new_key)
+	{
+		key = new_key;
+	}
+
+	[[nodiscard]] const ephemeral_recipe_t& get_recipe() const
+	{
+		return recipe;
+	}
+
+	void set_recipe(const ephemeral_recipe_t& new_recipe)
+	{
+		recipe = new_recipe;
 	}
 
 private:
 	image_istorage_t* data;
+	image_expr_t* expr = nullptr;
+	// structural hash of the subtree that produced this image, 0 if it can't be reproduced. see eval_cache.h
+	blt::u64 key = 0;
+	// kind none unless this is an ephemeral terminal's value
+	ephemeral_recipe_t recipe{};
 };
 
 #endif //IMAGE_STORAGE_H
@@ -0,0 +1,147 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ISLAND_H
+#define ISLAND_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <blt/std/types.h>
+
+/*
+ * Islands are separate processes evolving their own populations which periodically swap migrants. They talk through one POSIX
+ * shared memory object holding a single-producer single-consumer mailbox for every ordered pair of islands, so sending never
+ * contends with anything but the one receiver and nothing is ever locked. A mailbox that is full drops new messages, a slow
+ * island only loses migrants, it never stalls the others.
+ */
+
+enum class island_topology_t : blt::u8
+{
+	// island i sends to island i + 1
+	ring,
+	// every island sends to every other island
+	all
+};
+
+struct island_stats_t
+{
+	blt::u64 sent = 0;
+	// accepted by the receiver
+	blt::u64 received = 0;
+	// read but turned away by the receiver, e.g. because its population had no room left
+	blt::u64 rejected = 0;
+	// mailbox full or message larger than a slot
+	blt::u64 dropped = 0;
+};
+
+class island_link_t
+{
+public:
+	struct message_t
+	{
+		blt::u32 source;
+		blt::u32 channel;
+		std::string_view payload;
+	};
+
+	island_link_t(const island_link_t&) = delete;
+
+	island_link_t& operator=(const island_link_t&) = delete;
+
+	~island_link_t();
+
+	/**
+	 * Creates (replacing a stale one) the shared memory object for a group of islands and attaches to it as island 0.
+	 * @param slot_bytes largest message a mailbox slot holds
+	 */
+	static std::unique_ptr<island_link_t> create(const std::string& name, blt::u32 islands, blt::size_t slot_bytes);
+
+	/**
+	 * Attaches to a group created by island 0, waiting up to timeout_seconds for it to appear.
+	 */
+	static std::unique_ptr<island_link_t> attach(const std::string& name, blt::u32 index, double timeout_seconds = 30);
+
+	/**
+	 * After fork() the child shares the mapping already, it only needs to know which island it is.
+	 */
+	void set_index(blt::u32 index);
+
+	/**
+	 * Unlinks the shared memory object when this link is destroyed, the creator's job once every island is done.
+	 */
+	void set_owner(bool owner);
+
+	[[nodiscard]] blt::u32 index() const
+	{
+		return island;
+	}
+
+	[[nodiscard]] blt::u32 size() const;
+
+	[[nodiscard]] std::vector<blt::u32> destinations(island_topology_t topology) const;
+
+	/**
+	 * @return false if the message was dropped
+	 */
+	bool send(blt::u32 destination, blt::u32 channel, std::string_view payload);
+
+	/**
+	 * Calls func with every message waiting for this island, in the order each sender sent them. The payload is only valid
+	 * during the call. func returns whether it accepted the message, which is what the received and rejected stats count.
+	 */
+	template <typename Func>
+	void receive(Func&& func)
+	{
+		message_t message{};
+		for (blt::u32 source = 0; source < size(); ++source)
+		{
+			while (pop(source, message))
+			{
+				if (func(message))
+					++stats.received;
+				else
+					++stats.rejected;
+				release(source);
+			}
+		}
+	}
+
+	[[nodiscard]] island_stats_t get_stats() const
+	{
+		return stats;
+	}
+
+private:
+	island_link_t() = default;
+
+	bool pop(blt::u32 source, message_t& message);
+
+	void release(blt::u32 source);
+
+	std::string name;
+	void* mapping = nullptr;
+	blt::size_t mapping_size = 0;
+	blt::u32 island = 0;
+	bool owner = false;
+	island_stats_t stats;
+};
+
+#endif //ISLAND_H
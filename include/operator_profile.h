@@ -0,0 +1,165 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef OPERATOR_PROFILE_H
+#define OPERATOR_PROFILE_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <blt/std/types.h>
+
+/*
+ * Optional per-operator instrumentation. Every operator opens an operator_timer_t, which when profiling is enabled records the
+ * call, its time and the image buffers it acquired into counters owned by the calling thread. Time and buffers are exclusive:
+ * whatever a nested timer records (a pending point-wise expression materialised by its consumer, for instance) is taken out of
+ * the enclosing operator. run_step merges the threads' counters once per generation.
+ */
+
+enum class profiled_op_t : blt::u8
+{
+	image_x,
+	image_y,
+	random,
+	noise,
+	ephemeral,
+	add,
+	sub,
+	mul,
+	div,
+	sin,
+	sin_off,
+	cos,
+	cos_off,
+	log,
+	exp,
+	abs,
+	mod,
+	bit_or,
+	bit_and,
+	bit_xor,
+	bit_not,
+	srgb,
+	linear,
+	gt,
+	lt,
+	grad,
+	perlin,
+	perlin_eph,
+	perlin_oct,
+	passthrough,
+	erode,
+	dilate,
+	band_pass,
+	// running a compiled point-wise expression, see image_expr.h
+	fused_expression,
+	count
+};
+
+const char* profiled_op_name(profiled_op_t op);
+
+struct operator_profile_entry_t
+{
+	profiled_op_t op;
+	blt::u64 calls = 0;
+	blt::u64 total_ns = 0;
+	// estimated from a log-linear histogram, within 1/8 of the true value
+	blt::u64 p50_ns = 0;
+	blt::u64 p99_ns = 0;
+	blt::u64 image_acquisitions = 0;
+};
+
+struct operator_profile_t
+{
+	// the last generation merged into the profile and how many generations it covers
+	blt::u32 generation = 0;
+	blt::u32 generations = 0;
+	// one entry per operator that was called, most total time first
+	std::vector<operator_profile_entry_t> operators;
+};
+
+namespace detail
+{
+	extern std::atomic_bool operator_profiling;
+}
+
+class operator_timer_t
+{
+public:
+	explicit operator_timer_t(const profiled_op_t op)
+	{
+		if (detail::operator_profiling.load(std::memory_order_relaxed))
+			begin(op);
+	}
+
+	operator_timer_t(const operator_timer_t&) = delete;
+
+	operator_timer_t& operator=(const operator_timer_t&) = delete;
+
+	~operator_timer_t()
+	{
+		if (active)
+			end();
+	}
+
+private:
+	void begin(profiled_op_t op);
+
+	void end();
+
+	bool active = false;
+	profiled_op_t op = profiled_op_t::count;
+	std::chrono::steady_clock::time_point start;
+	blt::u64 start_acquisitions = 0;
+	// recorded by timers nested inside this one
+	blt::u64 nested_ns = 0;
+	blt::u64 nested_acquisitions = 0;
+	operator_timer_t* parent = nullptr;
+};
+
+/**
+ * Off by default. Can be toggled at any time, timers already running finish recording.
+ */
+void set_operator_profiling(bool enabled);
+
+bool is_operator_profiling();
+
+/**
+ * Folds everything recorded since the last merge into the latest generation's and the run's profile, and appends the
+ * generation to the CSV file if one is set. Must be called between generations, while no operator is running.
+ */
+void merge_operator_profile(blt::u32 generation);
+
+/**
+ * @param cumulative the whole run rather than the last merged generation
+ */
+operator_profile_t get_operator_profile(bool cumulative);
+
+/**
+ * Streams every merged generation to path as CSV. Setting another path, or an empty one, finishes the file with the whole
+ * run's totals.
+ */
+bool set_operator_profile_csv(const std::string& path);
+
+/**
+ * Writes the whole run's profile to path as CSV in one go.
+ */
+bool write_operator_profile_csv(const std::string& path);
+
+#endif //OPERATOR_PROFILE_H
@@ -0,0 +1,100 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PREVIEW_SNAPSHOT_H
+#define PREVIEW_SNAPSHOT_H
+
+#include <array>
+#include <atomic>
+#include <vector>
+#include <blt/std/types.h>
+
+/**
+ * The previews of one finished generation, packed as RGBA8 so the UI can upload them as they are. Immutable once published.
+ */
+struct preview_snapshot_t
+{
+	// number of generations run when this was taken, 0 for a snapshot that was never published
+	blt::u32 generation = 0;
+	blt::i32 dimensions = 0;
+	blt::size_t count = 0;
+	// count images of dimensions * dimensions RGBA pixels one after the other, followed by best_image
+	std::vector<blt::u8> pixels;
+	// best individual of each channel
+	std::array<blt::size_t, 3> best{};
+
+	[[nodiscard]] blt::u8* image(const blt::size_t index)
+	{
+		return pixels.data() + index * static_cast<blt::size_t>(dimensions) * static_cast<blt::size_t>(dimensions) * 4;
+	}
+
+	/**
+	 * @return the best output of each channel composed into one image, what gets exported
+	 */
+	[[nodiscard]] blt::u8* best_image()
+	{
+		return image(count);
+	}
+};
+
+/**
+ * Lock free handoff of the newest value from one writer thread to one reader thread. The writer fills back() and publishes it,
+ * the reader takes the newest published value with acquire(). Neither ever waits for the other: the third buffer is always
+ * free for whichever side needs one, and the buffers are reused so steady state doesn't allocate.
+ */
+template <typename T>
+class triple_buffer_t
+{
+public:
+	/**
+	 * @return the buffer the writer fills next, it holds whatever was published two publishes ago
+	 */
+	T& back()
+	{
+		return buffers[writing];
+	}
+
+	void publish()
+	{
+		writing = shared.exchange(writing | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	/**
+	 * @return the newest value if anything was published since the last call, otherwise nullptr. Belongs to the reader until
+	 * the next call.
+	 */
+	T* acquire()
+	{
+		if ((shared.load(std::memory_order_relaxed) & FRESH) == 0)
+			return nullptr;
+		reading = shared.exchange(reading, std::memory_order_acq_rel) & INDEX;
+		return &buffers[reading];
+	}
+
+private:
+	static constexpr blt::u8 INDEX = 3;
+	static constexpr blt::u8 FRESH = 4;
+
+	std::array<T, 3> buffers{};
+	blt::u8 writing = 0;
+	// the buffer between the two sides, flagged FRESH while the reader hasn't taken it
+	std::atomic<blt::u8> shared = 1;
+	blt::u8 reading = 2;
+};
+
+#endif //PREVIEW_SNAPSHOT_H
@@ -0,0 +1,88 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef PREVIEW_STORE_H
+#define PREVIEW_STORE_H
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <image_storage.h>
+
+/**
+ * What is kept of the evaluated images once the fitness function is done with them: individuals [0, displayed) packed as RGB8,
+ * and the single best output of each channel. Memory depends on how many previews are on screen rather than on the
+ * population size. Both keep the top 8 bits of each pixel, which is all the UI and the exported PNGs ever showed.
+ */
+class preview_store_t
+{
+public:
+	/**
+	 * Sizes the store for the first displayed individuals of images with pixels pixels each and clears it. Must not be called
+	 * while a generation is being evaluated.
+	 */
+	void resize(blt::size_t displayed, blt::size_t pixels);
+
+	/**
+	 * Forgets the best of a channel, called before the channel's population is evaluated.
+	 */
+	void reset_best(blt::size_t channel);
+
+	/**
+	 * Keeps the output of an individual if it is displayed or the best of its channel so far. Safe to call from every thread
+	 * evaluating a channel, as long as each index is only captured once per channel and generation. A null output blanks the
+	 * preview.
+	 */
+	void capture(blt::size_t channel, blt::size_t index, const image_ipixel_t* output, double adjusted_fitness);
+
+	[[nodiscard]] blt::size_t displayed() const
+	{
+		return displayed_count;
+	}
+
+	/**
+	 * @return the RGB8 pixels of a displayed individual
+	 */
+	[[nodiscard]] const blt::u8* image(const blt::size_t index) const
+	{
+		return rgb.data() + index * pixel_count * 3;
+	}
+
+	/**
+	 * @return the 8 bit pixels of the channel's best output, only stable between generations
+	 */
+	[[nodiscard]] const blt::u8* best(const blt::size_t channel) const
+	{
+		return bests[channel].pixels.data();
+	}
+
+private:
+	struct best_t
+	{
+		std::mutex mutex;
+		std::atomic<double> fitness = 0;
+		std::vector<blt::u8> pixels;
+	};
+
+	blt::size_t displayed_count = 0;
+	blt::size_t pixel_count = 0;
+	std::vector<blt::u8> rgb;
+	std::array<best_t, 3> bests;
+};
+
+#endif //PREVIEW_STORE_H
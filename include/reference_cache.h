@@ -0,0 +1,49 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef REFERENCE_CACHE_H
+#define REFERENCE_CACHE_H
+
+#include <array>
+#include <optional>
+#include <string>
+#include <image_storage.h>
+
+/*
+ * Decoding and resizing a large reference photo dominates startup. The finished planes are cached in a checkpoint container
+ * (see checkpoint.h) named after a hash of the source file's bytes and the resolution, so a cached reference is an mmap and a
+ * copy, and editing the source or changing the resolution simply misses the cache.
+ */
+
+/**
+ * Hash of a byte range, what cached references are named after.
+ */
+blt::u64 hash_bytes(const unsigned char* bytes, blt::size_t size);
+
+/**
+ * Where cached references are kept, empty disables the cache. Defaults to $XDG_CACHE_HOME/image-gp or ~/.cache/image-gp.
+ */
+void set_reference_cache_directory(const std::string& directory);
+
+/**
+ * Loads a reference at the current resolution, from the cache if it has been seen before.
+ * @return nothing if the file can't be read or decoded
+ */
+std::optional<std::array<image_storage_t, 3>> load_reference_image(const std::string& path);
+
+#endif //REFERENCE_CACHE_H
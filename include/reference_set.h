@@ -0,0 +1,97 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef REFERENCE_SET_H
+#define REFERENCE_SET_H
+
+#include <array>
+#include <string>
+#include <vector>
+#include <image_storage.h>
+
+/**
+ * How the errors against each target combine into an individual's fitness.
+ */
+enum class target_aggregate_t : blt::u8
+{
+	// average error over the targets, programs that do reasonably on all of them
+	mean,
+	// worst error over the targets, programs that do well on every one of them
+	max
+};
+
+/**
+ * The images evolved programs are scored against, decoded once at the current resolution. Every channel of every target lives
+ * in one contiguous buffer, channel major then target, so scoring a channel against all targets walks a single array. It is
+ * only written while setting up, after which the evaluation threads share it read-only.
+ */
+class reference_set_t
+{
+public:
+	reference_set_t() = default;
+
+	/**
+	 * Decodes every path in order, directories contribute the images they contain in name order. Paths that can't be decoded
+	 * are skipped with an error. Returns an empty set if nothing could be loaded.
+	 */
+	static reference_set_t load(const std::vector<std::string>& paths);
+
+	/**
+	 * Wraps pixels already in this class' layout, as returned by pixels().
+	 */
+	static reference_set_t from_pixels(std::vector<float> pixels);
+
+	[[nodiscard]] blt::size_t size() const
+	{
+		return targets;
+	}
+
+	[[nodiscard]] bool empty() const
+	{
+		return targets == 0;
+	}
+
+	/**
+	 * @return image_size() pixels of the given channel of the given target
+	 */
+	[[nodiscard]] const float* channel(const blt::size_t channel, const blt::size_t target) const
+	{
+		return data.data() + (channel * targets + target) * image_size();
+	}
+
+	[[nodiscard]] const std::vector<float>& pixels() const
+	{
+		return data;
+	}
+
+	/**
+	 * @return a hash of every target's pixels, equal for sets that score identically
+	 */
+	[[nodiscard]] blt::u64 hash() const;
+
+	/**
+	 * Copies one target back out as separate channel images, for display.
+	 */
+	[[nodiscard]] std::array<image_storage_t, 3> target_image(blt::size_t target) const;
+
+private:
+	std::vector<float> data;
+	blt::size_t targets = 0;
+};
+
+#endif //REFERENCE_SET_H
@@ -0,0 +1,42 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef TREE_IO_H
+#define TREE_IO_H
+
+#include <blt/gp/program.h>
+#include <blt/fs/fwddecl.h>
+
+/*
+ * blt::gp's own tree serialisation copies the value stack as raw bytes, which for image_t are pointers into the process that
+ * wrote them. Trees that leave the process (checkpoints, migrants, evaluation workers) are written as their operator ids
+ * instead, with the recipe of each ephemeral image so the reading side can regenerate it, see ephemeral_image.h. Both sides
+ * must have built their programs with the same operators.
+ */
+
+void write_tree(blt::fs::writer_t& writer, const blt::gp::tree_t& tree);
+
+/**
+ * Replaces tree with the one written by write_tree. The data comes from files and other processes, so it is checked before
+ * anything is built: every id must be one of the operator_count operators program was set up with, each operator must get
+ * arguments of the types it takes, and the whole sequence must reduce to a single image_t. Regenerating the ephemeral images
+ * draws no random numbers.
+ * @return false if the data is truncated or doesn't describe such a tree, tree is left empty then
+ */
+bool read_tree(blt::fs::reader_t& reader, blt::gp::tree_t& tree, blt::gp::gp_program& program, blt::size_t operator_count);
+
+#endif //TREE_IO_H
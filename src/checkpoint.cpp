@@ -0,0 +1,280 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <checkpoint.h>
+#include <blt/logging/logging.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+checkpoint_builder_t::checkpoint_builder_t(): bytes(sizeof(checkpoint_header_t))
+{}
+
+void checkpoint_builder_t::begin_section(const blt::u32 id)
+{
+	bytes.resize((bytes.size() + CHECKPOINT_ALIGNMENT - 1) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT);
+	section_start = bytes.size();
+	in_section = true;
+	if (section_count < MAX_CHECKPOINT_SECTIONS)
+	{
+		auto& header = *reinterpret_cast<checkpoint_header_t*>(bytes.data());
+		header.sections[section_count].id = id;
+	}
+}
+
+void checkpoint_builder_t::end_section()
+{
+	in_section = false;
+	if (section_count >= MAX_CHECKPOINT_SECTIONS)
+	{
+		BLT_ERROR("Checkpoint has more than {} sections, the rest are dropped", MAX_CHECKPOINT_SECTIONS);
+		bytes.resize(section_start);
+		return;
+	}
+	auto& section = reinterpret_cast<checkpoint_header_t*>(bytes.data())->sections[section_count++];
+	section.offset = section_start;
+	section.size = bytes.size() - section_start;
+}
+
+void checkpoint_builder_t::add_section(const blt::u32 id, const void* data, const blt::size_t size)
+{
+	begin_section(id);
+	write(static_cast<const char*>(data), size);
+	end_section();
+}
+
+blt::i64 checkpoint_builder_t::write(const char* buffer, const blt::size_t size)
+{
+	bytes.insert(bytes.end(), buffer, buffer + size);
+	return static_cast<blt::i64>(size);
+}
+
+std::vector<char> checkpoint_builder_t::finish()
+{
+	auto& header = *reinterpret_cast<checkpoint_header_t*>(bytes.data());
+	std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version = CHECKPOINT_VERSION;
+	header.byte_order = CHECKPOINT_BYTE_ORDER;
+	header.file_size = bytes.size();
+	header.section_count = section_count;
+
+	auto file = std::move(bytes);
+	bytes.assign(sizeof(checkpoint_header_t), 0);
+	section_count = 0;
+	return file;
+}
+
+blt::i64 checkpoint_file_t::section_reader_t::read(char* buffer, const blt::size_t bytes)
+{
+	const auto count = std::min(bytes, data.size() - position);
+	std::memcpy(buffer, data.data() + position, count);
+	position += count;
+	return static_cast<blt::i64>(count);
+}
+
+checkpoint_file_t::~checkpoint_file_t()
+{
+	if (mapping)
+		munmap(const_cast<char*>(mapping), mapping_size);
+}
+
+bool checkpoint_file_t::open(const std::string& path)
+{
+	const auto fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		BLT_ERROR("Unable to open checkpoint '{}'", path);
+		return false;
+	}
+	struct stat info{};
+	if (fstat(fd, &info) != 0 || static_cast<blt::size_t>(info.st_size) < sizeof(checkpoint_header_t))
+	{
+		BLT_ERROR("Checkpoint '{}' is too small to be a checkpoint", path);
+		close(fd);
+		return false;
+	}
+	mapping_size = static_cast<blt::size_t>(info.st_size);
+	const auto mapped = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+	{
+		BLT_ERROR("Unable to map checkpoint '{}'", path);
+		return false;
+	}
+	mapping = static_cast<const char*>(mapped);
+	header = reinterpret_cast<const checkpoint_header_t*>(mapping);
+
+	const auto reject = [&](const char* reason) {
+		BLT_ERROR("Rejecting checkpoint '{}': {}", path, reason);
+		munmap(const_cast<char*>(mapping), mapping_size);
+		mapping = nullptr;
+		header = nullptr;
+		return false;
+	};
+	if (std::memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0)
+		return reject("not a checkpoint file");
+	if (header->version != CHECKPOINT_VERSION)
+		return reject("written by an incompatible version");
+	if (header->byte_order != CHECKPOINT_BYTE_ORDER)
+		return reject("written on a machine with a different byte order");
+	if (header->file_size != mapping_size)
+		return reject("file is truncated");
+	if (header->section_count > MAX_CHECKPOINT_SECTIONS)
+		return reject("corrupt section table");
+	for (blt::u32 i = 0; i < header->section_count; ++i)
+	{
+		const auto& section = header->sections[i];
+		if (section.offset < sizeof(checkpoint_header_t) || section.offset > mapping_size || section.size > mapping_size - section.offset)
+			return reject("corrupt section table");
+	}
+	return true;
+}
+
+std::string_view checkpoint_file_t::section(const blt::u32 id) const
+{
+	if (header == nullptr)
+		return {};
+	for (blt::u32 i = 0; i < header->section_count; ++i)
+	{
+		if (header->sections[i].id == id)
+			return {mapping + header->sections[i].offset, header->sections[i].size};
+	}
+	return {};
+}
+
+bool write_checkpoint_file(const std::string& path, const std::vector<char>& file)
+{
+	const auto temp_path = path + ".tmp";
+	const auto fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+	blt::size_t written = 0;
+	while (written < file.size())
+	{
+		const auto result = ::write(fd, file.data() + written, file.size() - written);
+		if (result <= 0)
+		{
+			close(fd);
+			return false;
+		}
+		written += static_cast<blt::size_t>(result);
+	}
+	const bool synced = fsync(fd) == 0;
+	close(fd);
+	return synced && std::rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+namespace
+{
+	/*
+	 * A single background thread so serialising a checkpoint is the only part that happens between generations. Writes are
+	 * latest wins: a checkpoint that is superseded before the thread gets to it is never written.
+	 */
+	class checkpoint_writer_t
+	{
+	public:
+		~checkpoint_writer_t()
+		{
+			{
+				std::scoped_lock lock(mutex);
+				stopping = true;
+			}
+			work_ready.notify_all();
+			if (thread.joinable())
+				thread.join();
+		}
+
+		void submit(const std::string& path, std::vector<char> file)
+		{
+			{
+				std::scoped_lock lock(mutex);
+				if (pending)
+					BLT_WARN("Checkpoint writer is falling behind, dropping the checkpoint queued for '{}'", pending->first);
+				pending.emplace(path, std::move(file));
+				if (!thread.joinable())
+					thread = std::thread([this]() {
+						worker_loop();
+					});
+			}
+			work_ready.notify_all();
+		}
+
+		void wait()
+		{
+			std::unique_lock lock(mutex);
+			work_done.wait(lock, [this]() {
+				return !pending && !writing;
+			});
+		}
+
+	private:
+		void worker_loop()
+		{
+			std::unique_lock lock(mutex);
+			while (true)
+			{
+				work_ready.wait(lock, [this]() {
+					return stopping || pending.has_value();
+				});
+				// whatever is still pending when shutting down is written out first
+				if (!pending)
+					return;
+				auto [path, file] = std::move(*pending);
+				pending.reset();
+				writing = true;
+				lock.unlock();
+
+				if (write_checkpoint_file(path, file))
+					BLT_INFO("Wrote checkpoint '{}' ({} bytes)", path, file.size());
+				else
+					BLT_ERROR("Failed to write checkpoint '{}'", path);
+
+				lock.lock();
+				writing = false;
+				work_done.notify_all();
+			}
+		}
+
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable work_ready;
+		std::condition_variable work_done;
+		std::optional<std::pair<std::string, std::vector<char>>> pending;
+		bool writing = false;
+		bool stopping = false;
+	};
+
+	checkpoint_writer_t checkpoint_writer;
+}
+
+void write_checkpoint_async(const std::string& path, std::vector<char> file)
+{
+	checkpoint_writer.submit(path, std::move(file));
+}
+
+void wait_for_checkpoint_writes()
+{
+	checkpoint_writer.wait();
+}
@@ -0,0 +1,134 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <ephemeral_image.h>
+#include <eval_cache.h>
+#include <image_noise.h>
+#include <cstring>
+
+namespace
+{
+	thread_local const ephemeral_recipe_t* replayed = nullptr;
+
+	blt::u32 bits_of(const float value)
+	{
+		blt::u32 bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	float float_of(const blt::u32 bits)
+	{
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+}
+
+ephemeral_recipe_t noise_recipe(const blt::u64 state)
+{
+	return {ephemeral_kind_t::noise, {static_cast<blt::u32>(state), static_cast<blt::u32>(state >> 32)}};
+}
+
+ephemeral_recipe_t constant_recipe(const blt::u32 value)
+{
+	return {ephemeral_kind_t::constant, {value}};
+}
+
+ephemeral_recipe_t perlin_recipe(const float variety, const blt::i32 x_warp, const blt::i32 y_warp, const blt::i32 z_warp,
+								const float offset_x, const float offset_y)
+{
+	// the warps are drawn from [0, 255] so they fit next to each other, which is also how they become the noise seed
+	const auto warps = static_cast<blt::u32>(x_warp | y_warp << 8 | z_warp << 16);
+	return {ephemeral_kind_t::perlin, {bits_of(variety), warps, bits_of(offset_x), bits_of(offset_y)}};
+}
+
+ephemeral_recipe_t perlin_fbm_recipe(const float rand, const blt::i32 octaves, const float gain, const float lacunarity, const float offset)
+{
+	return {
+		ephemeral_kind_t::perlin_fbm, {bits_of(rand), static_cast<blt::u32>(octaves), bits_of(gain), bits_of(lacunarity), bits_of(offset)}
+	};
+}
+
+image_t make_ephemeral_image(const ephemeral_recipe_t& recipe)
+{
+	image_t ret{};
+	const auto& p = recipe.params;
+	switch (recipe.kind)
+	{
+		case ephemeral_kind_t::none:
+			break;
+		case ephemeral_kind_t::noise:
+		{
+			// expanded from a single seed so the image can be identified by it in the evaluation cache
+			auto state = static_cast<blt::u64>(p[1]) << 32 | p[0];
+			ret.set_key(combine_keys(op_tag("image_noise"), key_of_value(state)));
+			for (auto& v : ret.get_data().data)
+				v = static_cast<blt::u32>(mix_key(state += 0x9e3779b97f4a7c15ull) >> 32);
+			break;
+		}
+		case ephemeral_kind_t::constant:
+			for (auto& v : ret.get_data().data)
+				v = p[0];
+			ret.set_key(combine_keys(op_tag("image_ephemeral"), key_of_value(p[0])));
+			break;
+		case ephemeral_kind_t::perlin:
+		{
+			const auto variety = float_of(p[0]);
+			const auto x_warp = static_cast<blt::i32>(p[1] & 0xFF);
+			const auto y_warp = static_cast<blt::i32>(p[1] >> 8 & 0xFF);
+			const auto z_warp = static_cast<blt::i32>(p[1] >> 16 & 0xFF);
+			const auto offset_x = float_of(p[2]);
+			const auto offset_y = float_of(p[3]);
+			// the wrap parameters stb_perlin took become the noise seed
+			perlin_plane(ret.get_data().data.data(), image_dimensions(), offset_x, offset_y, variety, static_cast<blt::i32>(p[1]));
+			ret.set_key(combine_keys(op_tag("perlin_image_eph"), key_of_value(variety), key_of_value(x_warp), key_of_value(y_warp),
+									key_of_value(z_warp), key_of_value(offset_x), key_of_value(offset_y)));
+			break;
+		}
+		case ephemeral_kind_t::perlin_fbm:
+		{
+			const auto rand = float_of(p[0]);
+			const auto octaves = static_cast<blt::i32>(p[1]);
+			const auto gain = float_of(p[2]);
+			const auto lac = float_of(p[3]);
+			const auto offset = float_of(p[4]);
+			perlin_fbm_plane(ret.get_data().data.data(), image_dimensions(), offset, rand, octaves, gain, lac);
+			ret.set_key(combine_keys(op_tag("perlin_image_eph_oct"), key_of_value(rand), key_of_value(octaves), key_of_value(gain),
+									key_of_value(lac), key_of_value(offset)));
+			break;
+		}
+	}
+	ret.set_recipe(recipe);
+	ret.pin();
+	return ret;
+}
+
+const ephemeral_recipe_t* replayed_ephemeral()
+{
+	return replayed;
+}
+
+ephemeral_replay_t::ephemeral_replay_t(const ephemeral_recipe_t& recipe): previous(replayed)
+{
+	replayed = &recipe;
+}
+
+ephemeral_replay_t::~ephemeral_replay_t()
+{
+	replayed = previous;
+}
@@ -0,0 +1,159 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <eval_cache.h>
+#include <image_storage.h>
+#include <array>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace
+{
+	constexpr blt::size_t SHARD_COUNT = 32;
+	constexpr blt::size_t DEFAULT_BUDGET_BYTES = 512ull * 1024 * 1024;
+
+	/*
+	 * Every entry is one full image, so a plain LRU list per shard is already size-aware: the budget translates directly
+	 * into a per-shard entry limit. Entries hold a reference to their buffer, an evicted buffer that is still in use goes
+	 * back to the pool when its last image is dropped.
+	 */
+	struct alignas(64) cache_shard_t
+	{
+		struct entry_t
+		{
+			blt::u64 key;
+			image_istorage_t* data;
+		};
+
+		void evict_to(const blt::size_t max_entries)
+		{
+			while (lru.size() > max_entries)
+			{
+				const auto& victim = lru.back();
+				release_image_storage(victim.data);
+				index.erase(victim.key);
+				lru.pop_back();
+				++evictions;
+			}
+		}
+
+		std::mutex mutex;
+		std::list<entry_t> lru;
+		std::unordered_map<blt::u64, std::list<entry_t>::iterator> index;
+		blt::u64 hits = 0;
+		blt::u64 misses = 0;
+		blt::u64 insertions = 0;
+		blt::u64 evictions = 0;
+	};
+
+	// entries are intentionally not released on destruction, the thread-local pool caches are already gone by then
+	struct eval_cache_t
+	{
+		cache_shard_t& shard_for(const blt::u64 key)
+		{
+			return shards[mix_key(key) % SHARD_COUNT];
+		}
+
+		// derived from the budget on every use since the image size is only known at runtime
+		[[nodiscard]] blt::size_t entries_per_shard() const
+		{
+			return budget_bytes.load(std::memory_order_relaxed) / image_size_bytes() / SHARD_COUNT;
+		}
+
+		std::array<cache_shard_t, SHARD_COUNT> shards;
+		std::atomic<blt::size_t> budget_bytes = DEFAULT_BUDGET_BYTES;
+	};
+
+	eval_cache_t eval_cache;
+}
+
+void set_eval_cache_budget(const blt::size_t bytes)
+{
+	eval_cache.budget_bytes = bytes;
+	const auto per_shard = eval_cache.entries_per_shard();
+	for (auto& shard : eval_cache.shards)
+	{
+		std::scoped_lock lock(shard.mutex);
+		shard.evict_to(per_shard);
+	}
+}
+
+image_istorage_t* eval_cache_acquire(const blt::u64 key)
+{
+	if (key == 0 || eval_cache.entries_per_shard() == 0)
+		return nullptr;
+	auto& shard = eval_cache.shard_for(key);
+	std::scoped_lock lock(shard.mutex);
+	const auto it = shard.index.find(key);
+	if (it == shard.index.end())
+	{
+		++shard.misses;
+		return nullptr;
+	}
+	++shard.hits;
+	shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+	const auto data = it->second->data;
+	retain_image_storage(data);
+	return data;
+}
+
+void eval_cache_store(const blt::u64 key, image_istorage_t& data)
+{
+	const auto max_entries = eval_cache.entries_per_shard();
+	if (key == 0 || max_entries == 0)
+		return;
+
+	auto& shard = eval_cache.shard_for(key);
+	std::scoped_lock lock(shard.mutex);
+	// another thread evaluated the same subtree at the same time
+	if (shard.index.find(key) != shard.index.end())
+		return;
+	pin_image_storage(&data);
+	retain_image_storage(&data);
+	shard.lru.push_front({key, &data});
+	shard.index.emplace(key, shard.lru.begin());
+	++shard.insertions;
+	shard.evict_to(max_entries);
+}
+
+void clear_eval_cache()
+{
+	for (auto& shard : eval_cache.shards)
+	{
+		std::scoped_lock lock(shard.mutex);
+		shard.evict_to(0);
+	}
+}
+
+eval_cache_stats_t get_eval_cache_stats()
+{
+	eval_cache_stats_t stats;
+	for (auto& shard : eval_cache.shards)
+	{
+		std::scoped_lock lock(shard.mutex);
+		stats.hits += shard.hits;
+		stats.misses += shard.misses;
+		stats.insertions += shard.insertions;
+		stats.evictions += shard.evictions;
+		stats.entries += shard.lru.size();
+	}
+	stats.bytes = stats.entries * image_size_bytes();
+	stats.budget_bytes = eval_cache.budget_bytes;
+	return stats;
+}
@@ -0,0 +1,485 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <eval_workers.h>
+#include <blt/logging/logging.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+	constexpr blt::u32 EVAL_WORKER_MAGIC = 0x49475745;
+	// how often a waiting side checks whether the other one is still alive
+	constexpr long LIVENESS_INTERVAL_MS = 50;
+
+	struct pool_header_t
+	{
+		blt::u32 magic;
+		blt::u32 workers;
+		blt::u64 request_bytes;
+		blt::u64 response_bytes;
+		blt::u64 slot_bytes;
+		// workers exit once they see this, or once the coordinator is no longer their parent
+		std::atomic<blt::u32> stopping;
+		pid_t coordinator;
+	};
+
+	struct slot_header_t
+	{
+		sem_t request_ready;
+		sem_t response_ready;
+		// posted once by a worker that has finished setting up, configuration is written before it
+		sem_t worker_ready;
+		blt::u64 request_size;
+		blt::u64 configuration;
+	};
+
+	constexpr blt::size_t align_up(const blt::size_t value, const blt::size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	constexpr blt::size_t header_size()
+	{
+		return align_up(sizeof(pool_header_t), 64);
+	}
+
+	constexpr blt::size_t slot_header_size()
+	{
+		return align_up(sizeof(slot_header_t), 64);
+	}
+
+	pool_header_t& header_of(void* mapping)
+	{
+		return *static_cast<pool_header_t*>(mapping);
+	}
+
+	char* slot_of(void* mapping, const blt::u32 worker)
+	{
+		return static_cast<char*>(mapping) + header_size() + worker * header_of(mapping).slot_bytes;
+	}
+
+	slot_header_t& slot_header_of(void* mapping, const blt::u32 worker)
+	{
+		return *reinterpret_cast<slot_header_t*>(slot_of(mapping, worker));
+	}
+
+	char* request_of(void* mapping, const blt::u32 worker)
+	{
+		return slot_of(mapping, worker) + slot_header_size();
+	}
+
+	char* response_of(void* mapping, const blt::u32 worker)
+	{
+		return request_of(mapping, worker) + align_up(header_of(mapping).request_bytes, 64);
+	}
+
+	void init_slot(void* mapping, const blt::u32 worker)
+	{
+		auto& slot = slot_header_of(mapping, worker);
+		sem_init(&slot.request_ready, 1, 0);
+		sem_init(&slot.response_ready, 1, 0);
+		sem_init(&slot.worker_ready, 1, 0);
+		slot.request_size = 0;
+		slot.configuration = 0;
+	}
+
+	void destroy_slot(void* mapping, const blt::u32 worker)
+	{
+		auto& slot = slot_header_of(mapping, worker);
+		sem_destroy(&slot.request_ready);
+		sem_destroy(&slot.response_ready);
+		sem_destroy(&slot.worker_ready);
+	}
+
+	timespec deadline_after(const long milliseconds)
+	{
+		timespec time{};
+		clock_gettime(CLOCK_REALTIME, &time);
+		time.tv_nsec += (milliseconds % 1000) * 1000000;
+		time.tv_sec += milliseconds / 1000 + time.tv_nsec / 1000000000;
+		time.tv_nsec %= 1000000000;
+		return time;
+	}
+
+	// false once the deadline passed, retrying interrupted waits
+	bool timed_wait(sem_t* semaphore, const long milliseconds)
+	{
+		const auto deadline = deadline_after(milliseconds);
+		while (sem_timedwait(semaphore, &deadline) != 0)
+		{
+			if (errno != EINTR)
+				return false;
+		}
+		return true;
+	}
+
+	std::string shm_name(const std::string& name)
+	{
+		return "/" + name;
+	}
+}
+
+eval_worker_pool_t::~eval_worker_pool_t()
+{
+	if (mapping)
+	{
+		header_of(mapping).stopping.store(1, std::memory_order_release);
+		for (blt::u32 worker = 0; worker < pids.size(); ++worker)
+			sem_post(&slot_header_of(mapping, worker).request_ready);
+		for (const auto pid : pids)
+		{
+			if (pid > 0)
+				waitpid(pid, nullptr, 0);
+		}
+		for (blt::u32 worker = 0; worker < pids.size(); ++worker)
+			destroy_slot(mapping, worker);
+		munmap(mapping, mapping_size);
+	}
+	shm_unlink(shm_name(name).c_str());
+}
+
+std::unique_ptr<eval_worker_pool_t> eval_worker_pool_t::start(const std::string& name, const blt::u32 workers,
+															const blt::size_t request_bytes, const blt::size_t response_bytes,
+															std::vector<std::string> command, const double timeout_seconds)
+{
+	const auto path = shm_name(name);
+	shm_unlink(path.c_str());
+	const auto fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0)
+	{
+		BLT_ERROR("Unable to create evaluation worker shared memory '{}'", path);
+		return nullptr;
+	}
+	const auto slot_bytes = slot_header_size() + align_up(request_bytes, 64) + align_up(response_bytes, 64);
+	const auto size = header_size() + workers * slot_bytes;
+	if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+	{
+		BLT_ERROR("Unable to size evaluation worker shared memory '{}' to {} bytes", path, size);
+		close(fd);
+		shm_unlink(path.c_str());
+		return nullptr;
+	}
+	const auto mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+	{
+		BLT_ERROR("Unable to map evaluation worker shared memory '{}'", path);
+		shm_unlink(path.c_str());
+		return nullptr;
+	}
+
+	std::unique_ptr<eval_worker_pool_t> pool{new eval_worker_pool_t{}};
+	pool->name = name;
+	pool->mapping = mapped;
+	pool->mapping_size = size;
+	pool->command = std::move(command);
+	pool->timeout_seconds = timeout_seconds;
+
+	auto& header = *new (mapped) pool_header_t{};
+	header.magic = EVAL_WORKER_MAGIC;
+	header.workers = workers;
+	header.request_bytes = request_bytes;
+	header.response_bytes = response_bytes;
+	header.slot_bytes = slot_bytes;
+	header.coordinator = getpid();
+	pool->pids.resize(workers, -1);
+	pool->ready.resize(workers, 0);
+	pool->worker_configuration.resize(workers, 0);
+	for (blt::u32 worker = 0; worker < workers; ++worker)
+	{
+		init_slot(mapped, worker);
+		if (!pool->spawn(worker))
+			return nullptr;
+		pool->idle.push_back(worker);
+	}
+	pool->live = workers;
+	BLT_INFO("Started {} evaluation workers sharing '{}' ({} bytes)", workers, path, size);
+	return pool;
+}
+
+bool eval_worker_pool_t::spawn(const blt::u32 worker)
+{
+	// everything the child touches is prepared up front, between fork and exec only async-signal-safe calls are allowed
+	std::vector<std::string> arguments = command;
+	arguments.emplace_back("--eval-worker");
+	arguments.push_back(name);
+	arguments.push_back(std::to_string(worker));
+	std::vector<char*> argv;
+	for (auto& argument : arguments)
+		argv.push_back(argument.data());
+	argv.push_back(nullptr);
+
+	const auto pid = fork();
+	if (pid < 0)
+	{
+		BLT_ERROR("Unable to fork evaluation worker {}", worker);
+		return false;
+	}
+	if (pid == 0)
+	{
+		execv("/proc/self/exe", argv.data());
+		_exit(127);
+	}
+	pids[worker] = pid;
+	return true;
+}
+
+bool eval_worker_pool_t::replace(const blt::u32 worker)
+{
+	if (pids[worker] > 0)
+	{
+		kill(pids[worker], SIGKILL);
+		waitpid(pids[worker], nullptr, 0);
+		pids[worker] = -1;
+	}
+	// the dead worker may have left any semaphore in any state, nobody else uses this slot until it is idle again
+	destroy_slot(mapping, worker);
+	init_slot(mapping, worker);
+	ready[worker] = 0;
+	return spawn(worker);
+}
+
+bool eval_worker_pool_t::await_ready(const blt::u32 worker)
+{
+	// setting up reloads the references and builds the programs, which has nothing to do with the evaluation timeout
+	auto& slot = slot_header_of(mapping, worker);
+	while (!timed_wait(&slot.worker_ready, LIVENESS_INTERVAL_MS))
+	{
+		if (waitpid(pids[worker], nullptr, WNOHANG) == pids[worker])
+		{
+			pids[worker] = -1;
+			return false;
+		}
+	}
+	worker_configuration[worker] = slot.configuration;
+	ready[worker] = 1;
+	return true;
+}
+
+void eval_worker_pool_t::retire(const blt::u32 worker)
+{
+	if (pids[worker] > 0)
+	{
+		kill(pids[worker], SIGKILL);
+		waitpid(pids[worker], nullptr, 0);
+		pids[worker] = -1;
+	}
+	{
+		std::scoped_lock lock(mutex);
+		--live;
+		++stats.retired;
+		if (live == 0)
+			BLT_ERROR("Every evaluation worker has been retired");
+	}
+	// anyone waiting for a worker has to find out if that was the last one
+	worker_idle.notify_all();
+}
+
+void eval_worker_pool_t::set_configuration(const blt::u64 new_configuration)
+{
+	std::scoped_lock lock(mutex);
+	configuration = new_configuration;
+}
+
+eval_outcome_t eval_worker_pool_t::evaluate(const std::string_view request, char* response)
+{
+	const auto& header = header_of(mapping);
+	if (request.size() > header.request_bytes)
+	{
+		BLT_WARN("Evaluation request of {} bytes is larger than the {} a worker accepts", request.size(), header.request_bytes);
+		return eval_outcome_t::failed;
+	}
+
+	blt::u32 worker;
+	while (true)
+	{
+		blt::u64 expected;
+		{
+			std::unique_lock lock(mutex);
+			worker_idle.wait(lock, [this]() {
+				return !idle.empty() || live == 0;
+			});
+			if (idle.empty())
+				return eval_outcome_t::unavailable;
+			// a worker that is already set up answers sooner than a freshly restarted one
+			auto chosen = std::find_if(idle.rbegin(), idle.rend(), [this](const blt::u32 candidate) {
+				return ready[candidate] != 0;
+			});
+			if (chosen == idle.rend())
+				chosen = idle.rbegin();
+			worker = *chosen;
+			idle.erase(std::next(chosen).base());
+			expected = configuration;
+		}
+		if (!ready[worker] && !await_ready(worker))
+		{
+			// whatever killed it while setting up would kill its replacement too
+			BLT_ERROR("Evaluation worker {} died before it was ready", worker);
+			retire(worker);
+			continue;
+		}
+		if (worker_configuration[worker] != expected)
+		{
+			BLT_ERROR("Evaluation worker {} scores against different references or targets than this process", worker);
+			retire(worker);
+			continue;
+		}
+		break;
+	}
+
+	auto& slot = slot_header_of(mapping, worker);
+	std::memcpy(request_of(mapping, worker), request.data(), request.size());
+	slot.request_size = request.size();
+	sem_post(&slot.request_ready);
+
+	bool answered = false;
+	bool crashed = false;
+	const auto start = std::chrono::steady_clock::now();
+	while (pids[worker] > 0)
+	{
+		if (timed_wait(&slot.response_ready, LIVENESS_INTERVAL_MS))
+		{
+			answered = true;
+			break;
+		}
+		if (waitpid(pids[worker], nullptr, WNOHANG) == pids[worker])
+		{
+			// already reaped, replace must not wait for it again
+			pids[worker] = -1;
+			crashed = true;
+			break;
+		}
+		if (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > timeout_seconds)
+			break;
+	}
+	if (answered)
+		std::memcpy(response, response_of(mapping, worker), header.response_bytes);
+	const auto restarted = answered || replace(worker);
+
+	{
+		std::scoped_lock lock(mutex);
+		++stats.evaluations;
+		if (!answered)
+			++(crashed ? stats.crashed : stats.timed_out);
+	}
+	if (!restarted)
+	{
+		BLT_ERROR("Evaluation worker {} could not be restarted", worker);
+		retire(worker);
+		return eval_outcome_t::failed;
+	}
+	{
+		std::scoped_lock lock(mutex);
+		idle.push_back(worker);
+	}
+	worker_idle.notify_one();
+	return answered ? eval_outcome_t::answered : eval_outcome_t::failed;
+}
+
+eval_worker_stats_t eval_worker_pool_t::get_stats()
+{
+	std::scoped_lock lock(mutex);
+	return stats;
+}
+
+eval_worker_t::~eval_worker_t()
+{
+	if (mapping)
+		munmap(mapping, mapping_size);
+}
+
+std::unique_ptr<eval_worker_t> eval_worker_t::attach(const std::string& name, const blt::u32 index)
+{
+	const auto path = shm_name(name);
+	const auto fd = shm_open(path.c_str(), O_RDWR, 0600);
+	if (fd < 0)
+	{
+		BLT_ERROR("Evaluation worker shared memory '{}' doesn't exist", path);
+		return nullptr;
+	}
+	struct stat info{};
+	if (fstat(fd, &info) != 0 || static_cast<blt::size_t>(info.st_size) < header_size())
+	{
+		close(fd);
+		BLT_ERROR("Evaluation worker shared memory '{}' is truncated", path);
+		return nullptr;
+	}
+	const auto size = static_cast<blt::size_t>(info.st_size);
+	const auto mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+	{
+		BLT_ERROR("Unable to map evaluation worker shared memory '{}'", path);
+		return nullptr;
+	}
+	const auto& header = header_of(mapped);
+	if (header.magic != EVAL_WORKER_MAGIC || index >= header.workers || header_size() + header.workers * header.slot_bytes > size)
+	{
+		BLT_ERROR("Evaluation worker shared memory '{}' has no worker {}", path, index);
+		munmap(mapped, size);
+		return nullptr;
+	}
+
+	std::unique_ptr<eval_worker_t> worker{new eval_worker_t{}};
+	worker->mapping = mapped;
+	worker->mapping_size = size;
+	worker->index = index;
+	return worker;
+}
+
+void eval_worker_t::announce(const blt::u64 configuration)
+{
+	auto& slot = slot_header_of(mapping, index);
+	slot.configuration = configuration;
+	sem_post(&slot.worker_ready);
+}
+
+bool eval_worker_t::next_request(std::string_view& request, char*& response)
+{
+	const auto& header = header_of(mapping);
+	auto& slot = slot_header_of(mapping, index);
+	while (true)
+	{
+		if (header.stopping.load(std::memory_order_acquire) != 0 || getppid() != header.coordinator)
+			return false;
+		if (timed_wait(&slot.request_ready, 1000))
+			break;
+	}
+	if (header.stopping.load(std::memory_order_acquire) != 0)
+		return false;
+	request = {request_of(mapping, index), slot.request_size};
+	response = response_of(mapping, index);
+	return true;
+}
+
+void eval_worker_t::respond()
+{
+	sem_post(&slot_header_of(mapping, index).response_ready);
+}
@@ -0,0 +1,169 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <fast_math.h>
+#include <eval_cache.h>
+#include <blt/logging/logging.h>
+#include <functional>
+#include <string_view>
+
+const double transcendental_tables_t::LOG_LIMIT = std::log(transcendental_tables_t::LIMIT);
+
+namespace
+{
+	std::vector<float> build_table(const blt::u32 bits, const std::function<double(double)>& func)
+	{
+		if (bits == 0)
+			return {};
+		const blt::size_t intervals = 1ull << bits;
+		std::vector<float> table(intervals + 1);
+		for (blt::size_t i = 0; i <= intervals; ++i)
+			table[i] = static_cast<float>(func(static_cast<double>(i) / static_cast<double>(intervals)));
+		return table;
+	}
+
+	transcendental_tables_t tables{DEFAULT_TRANSCENDENTAL_TABLE_BITS};
+}
+
+transcendental_tables_t::transcendental_tables_t(const blt::u32 table_bits): bits(std::min(table_bits, MAX_TRANSCENDENTAL_TABLE_BITS))
+{
+	if (bits == 0)
+		return;
+	scale = static_cast<double>(1ull << bits);
+	sine = build_table(bits, [](const double x) {
+		return std::sin(x * 2 * PI);
+	});
+	exponential = build_table(bits, [](const double x) {
+		return std::exp(x);
+	});
+	log_mantissa = build_table(bits, [](const double x) {
+		return std::log(1.0 + x);
+	});
+	srgb_mantissa = build_table(bits, [](const double x) {
+		return std::pow(1.0 + x, SRGB_GAMMA);
+	});
+	linear = build_table(bits, [](const double x) {
+		return srgb_to_linear(static_cast<float>(x));
+	});
+	for (blt::size_t exponent = 0; exponent < srgb_exponent.size(); ++exponent)
+		srgb_exponent[exponent] = std::pow(static_cast<double>(1ull << exponent) / LIMIT, SRGB_GAMMA);
+}
+
+void set_transcendental_accuracy(const blt::u32 table_bits)
+{
+	if (table_bits == tables.table_bits())
+		return;
+	tables = transcendental_tables_t{table_bits};
+	// cached images were computed with the old tables and their keys don't say so
+	clear_eval_cache();
+	if (tables.table_bits() == 0)
+		BLT_INFO("Transcendental operators use libm");
+	else
+		BLT_INFO("Transcendental operators use {} entry tables", (1ull << tables.table_bits()) + 1);
+}
+
+const transcendental_tables_t& get_transcendental_tables()
+{
+	return tables;
+}
+
+void report_approximation_error()
+{
+	constexpr auto limit = transcendental_tables_t::LIMIT;
+	const transcendental_tables_t exact{0};
+	const auto& approx = tables;
+	if (approx.table_bits() == 0)
+	{
+		BLT_INFO("Transcendental operators use libm, there is no approximation error to report");
+		return;
+	}
+
+	// dense over the small values where log and pow change fastest, then strided over the rest of the range
+	std::vector<blt::u32> inputs;
+	for (blt::u64 v = 0; v < 65536; ++v)
+		inputs.push_back(static_cast<blt::u32>(v));
+	for (blt::u64 v = 65536; v <= std::numeric_limits<blt::u32>::max(); v += 65521)
+		inputs.push_back(static_cast<blt::u32>(v));
+	inputs.push_back(std::numeric_limits<blt::u32>::max());
+
+	const auto report = [](const std::string_view name, const double max_error, const blt::u32 worst_input, const double output_range) {
+		BLT_INFO("\t{:<14} max error {:.3e} ({:.3e} of output range, {:.1f} u32 steps) at input {}", name, max_error,
+				max_error / output_range, max_error * limit, worst_input);
+	};
+
+	const auto measure_unary = [&](const std::string_view name, const double output_range, const auto& func) {
+		double max_error = 0;
+		blt::u32 worst_input = 0;
+		for (const auto v : inputs)
+		{
+			const auto error = std::abs(func(approx, v) - func(exact, v));
+			if (error > max_error)
+			{
+				max_error = error;
+				worst_input = v;
+			}
+		}
+		report(name, max_error, worst_input, output_range);
+	};
+
+	// the second input scales the frequency, a coarser grid keeps the pair sweep quick
+	const auto measure_binary = [&](const std::string_view name, const auto& func) {
+		double max_error = 0;
+		blt::u32 worst_input = 0;
+		for (blt::u64 v = 0; v <= std::numeric_limits<blt::u32>::max(); v += 4194301)
+		{
+			for (blt::u64 off = 0; off <= std::numeric_limits<blt::u32>::max(); off += 4194301)
+			{
+				const auto a = static_cast<blt::u32>(v);
+				const auto b = static_cast<blt::u32>(off);
+				const auto error = std::abs(func(approx, a, b) - func(exact, a, b));
+				if (error > max_error)
+				{
+					max_error = error;
+					worst_input = a;
+				}
+			}
+		}
+		report(name, max_error, worst_input, 1.0);
+	};
+
+	BLT_INFO("Approximation error with {} entry tables:", (1ull << approx.table_bits()) + 1);
+	measure_unary("sin_image", 1.0, [](const transcendental_tables_t& math, const blt::u32 v) {
+		return (math.sin_turns(v / limit * 0.5) + 1.0) / 2.0;
+	});
+	measure_binary("sin_image_off", [](const transcendental_tables_t& math, const blt::u32 v, const blt::u32 off) {
+		return (math.sin_turns(v / limit * 0.5 * (off / (limit / 4))) + 1.0) / 2.0;
+	});
+	measure_unary("cos_image", 1.0, [](const transcendental_tables_t& math, const blt::u32 v) {
+		return (math.sin_turns(v / limit + 0.25) + 1.0) / 2.0;
+	});
+	measure_binary("cos_image_off", [](const transcendental_tables_t& math, const blt::u32 v, const blt::u32 off) {
+		return (math.sin_turns(v / limit * 0.5 * (off / (limit / 2)) + 0.25) + 1.0) / 2.0;
+	});
+	measure_unary("log_image", std::log(limit), [](const transcendental_tables_t& math, const blt::u32 v) {
+		return v == 0 ? 0.0 : math.log_pixel(v);
+	});
+	measure_unary("exp_image", std::exp(1.0) - 1.0, [](const transcendental_tables_t& math, const blt::u32 v) {
+		return math.exp_unit(v / limit);
+	});
+	measure_unary("srgb_image", 1.0, [](const transcendental_tables_t& math, const blt::u32 v) {
+		return math.srgb_pixel(v);
+	});
+	measure_unary("linear_image", 1.0, [](const transcendental_tables_t& math, const blt::u32 v) {
+		return static_cast<double>(math.linear_unit(static_cast<float>(v) / static_cast<float>(limit)));
+	});
+}
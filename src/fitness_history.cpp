@@ -0,0 +1,114 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <fitness_history.h>
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+	constexpr blt::u64 bucket_width(const blt::size_t level)
+	{
+		blt::u64 width = 1;
+		for (blt::size_t i = 0; i < level; ++i)
+			width *= HISTORY_LEVEL_FACTOR;
+		return width;
+	}
+}
+
+void history_series_t::accumulator_t::add(const float min_value, const float max_value, const double value_sum, const blt::u64 value_count)
+{
+	if (values == 0)
+	{
+		min = min_value;
+		max = max_value;
+	} else
+	{
+		min = std::min(min, min_value);
+		max = std::max(max, max_value);
+	}
+	sum += value_sum;
+	values += value_count;
+}
+
+void history_series_t::push(const float value)
+{
+	levels[0].buckets[count % HISTORY_LEVEL_POINTS] = {value, value, value};
+	++count;
+
+	// a bucket on each level completes when the value count reaches a multiple of its width
+	bucket_t completed{value, value, value};
+	for (blt::size_t level = 1; level < HISTORY_LEVELS; ++level)
+	{
+		auto& pending = levels[level].pending;
+		const auto child_width = bucket_width(level - 1);
+		pending.add(completed.min, completed.max, static_cast<double>(completed.mean) * static_cast<double>(child_width), child_width);
+		if (count % bucket_width(level) != 0)
+			break;
+		completed = {pending.min, pending.max, static_cast<float>(pending.sum / static_cast<double>(pending.values))};
+		levels[level].buckets[(count / bucket_width(level) - 1) % HISTORY_LEVEL_POINTS] = completed;
+		pending = {};
+	}
+}
+
+void history_series_t::read(const blt::u64 first, blt::u64 last, const blt::size_t max_points, std::vector<history_point_t>& out) const
+{
+	out.clear();
+	last = std::min(last, count);
+	if (first >= last || max_points == 0)
+		return;
+	const auto span = last - first;
+
+	// the finest level that still holds first and fits the range into max_points, or the coarsest if none does
+	blt::size_t level = 0;
+	for (; level < HISTORY_LEVELS - 1; ++level)
+	{
+		const auto width = bucket_width(level);
+		const auto completed = count / width;
+		const auto oldest = completed > HISTORY_LEVEL_POINTS ? completed - HISTORY_LEVEL_POINTS : 0;
+		if (first >= oldest * width && (span + width - 1) / width <= max_points)
+			break;
+	}
+
+	const auto width = bucket_width(level);
+	const auto completed = count / width;
+	const auto oldest = completed > HISTORY_LEVEL_POINTS ? completed - HISTORY_LEVEL_POINTS : 0;
+	for (auto bucket = std::max(first / width, oldest); bucket < completed && bucket * width < last; ++bucket)
+	{
+		const auto& [min, max, mean] = levels[level].buckets[bucket % HISTORY_LEVEL_POINTS];
+		out.push_back({static_cast<double>(bucket * width) + static_cast<double>(width - 1) / 2.0, min, max, mean});
+	}
+
+	// the values after the last completed bucket are spread over the pending buckets of this level and the ones below it
+	if (completed * width < last)
+	{
+		accumulator_t tail{};
+		for (blt::size_t below = 1; below <= level; ++below)
+		{
+			const auto& pending = levels[below].pending;
+			if (pending.values != 0)
+				tail.add(pending.min, pending.max, pending.sum, pending.values);
+		}
+		if (tail.values != 0)
+		{
+			out.push_back({
+				static_cast<double>(completed * width) + static_cast<double>(tail.values - 1) / 2.0, tail.min, tail.max,
+				static_cast<float>(tail.sum / static_cast<double>(tail.values))
+			});
+		}
+	}
+}
@@ -18,11 +18,35 @@
 #include <gp_system.h>
 #include <blt/gp/program.h>
 #include <image_storage.h>
+#include <image_kernels.h>
+#include <eval_cache.h>
+#include <fast_math.h>
+#include <image_filters.h>
+#include <image_expr.h>
+#include <image_noise.h>
+#include <ephemeral_image.h>
+#include <tree_io.h>
+#include <checkpoint.h>
+#include <eval_workers.h>
+#include <image_export.h>
+#include <island.h>
+#include <reference_set.h>
 #include <operations.h>
+#include <operator_profile.h>
+#include <preview_snapshot.h>
+#include <preview_store.h>
 #include <random>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <condition_variable>
+#include <mutex>
+#include <functional>
+#include <memory>
+#include <thread>
 #include "opencv2/imgcodecs.hpp"
-#include "opencv2/imgproc.hpp"
-#include <stb_perlin.h>
 
 using namespace blt::gp;
 
@@ -38,289 +62,582 @@ float filter_nan(const float f, const float failure = 0.0f)
 	return f;
 }
 
-std::vector<float> to_cv2(const image_t& a)
-{
-	std::vector<float> converted_data(IMAGE_SIZE);
-	for (const auto& [o, v] : blt::in_pairs(converted_data, a.get_data().data))
-		o = static_cast<float>(v) / static_cast<float>(std::numeric_limits<blt::u32>::max());
-	return converted_data;
-}
+std::atomic_bool use_gamma_correction = false;
 
-image_t from_cv2(const std::vector<float>& a)
+std::array<gp_program*, 3> programs;
+prog_config_t config{};
+// every program is set up with the same operators, ids below this are valid in any of them. see read_tree
+blt::size_t operator_count = 0;
+
+preview_store_t previews;
+// applied between generations, see set_preview_count
+std::atomic_size_t requested_previews = 0;
+reference_set_t references;
+// references.hash(), kept up to date wherever the references are replaced
+blt::u64 references_hash = 0;
+// the first target split into channels, what the UI shows as the reference
+std::array<image_storage_t, 3> reference_image;
+target_aggregate_t target_aggregate = target_aggregate_t::mean;
+// score against only this target, -1 for all of them
+blt::i64 fitness_target = -1;
+// pixels of the output compared against every target before moving on, so the output is only read from memory once
+constexpr blt::size_t ERROR_CHUNK_PIXELS = 4096;
+
+// pow(x, 1 / 2.2) over [0, 1], indexed by the top bits of a u32 pixel. see GAMMA_LUT_BITS
+const std::array<float, GAMMA_LUT_SIZE> gamma_lut = []() {
+	std::array<float, GAMMA_LUT_SIZE> lut{};
+	for (blt::size_t i = 0; i < GAMMA_LUT_SIZE; ++i)
+		lut[i] = static_cast<float>(std::pow(static_cast<double>(i) / static_cast<double>(GAMMA_LUT_SIZE - 1), 1.0 / 2.2));
+	return lut;
+}();
+
+using channel_history_t = std::array<history_series_t, static_cast<blt::size_t>(history_stat_t::count)>;
+// written by run_step, read by the UI whenever it likes
+std::array<channel_history_t, 3> fitness_history;
+std::mutex fitness_history_mutex;
+
+void record_history(const blt::size_t channel, const history_stat_t stat, const double value)
 {
-	image_t ret;
-	for (const auto& [o, v] : blt::in_pairs(ret.get_data().data, a))
-		o = static_cast<blt::u32>(v * static_cast<float>(std::numeric_limits<blt::u32>::max()));
-	return ret;
+	std::scoped_lock lock(fitness_history_mutex);
+	fitness_history[channel][static_cast<blt::size_t>(stat)].push(static_cast<float>(value));
 }
 
-bool use_gamma_correction = false;
+phase_timings_t phase_timings;
 
-std::array<gp_program*, 3> programs;
-prog_config_t config{};
+// seed the run was started with, every generation's random state is derived from it. see generation_seed
+blt::u64 run_seed = 0;
+blt::u32 generation = 0;
 
-std::vector<std::array<image_ipixel_t, IMAGE_DIMENSIONS * IMAGE_DIMENSIONS * 3>> images;
-std::vector<std::array<image_ipixel_t, IMAGE_DIMENSIONS * IMAGE_DIMENSIONS>> images_red;
-std::vector<std::array<image_ipixel_t, IMAGE_DIMENSIONS * IMAGE_DIMENSIONS>> images_green;
-std::vector<std::array<image_ipixel_t, IMAGE_DIMENSIONS * IMAGE_DIMENSIONS>> images_blue;
-std::array<image_storage_t, 3> reference_image;
+std::string checkpoint_path;
+blt::u32 checkpoint_interval = 0;
 
-std::vector<float> average_fitness;
-std::vector<float> best_fitness;
-std::vector<float> worst_fitness;
-std::vector<float> overall_fitness;
+std::string export_directory;
+blt::u32 export_interval = 0;
 
-std::array<std::vector<float>, 3> mean_vec;
-std::array<std::vector<float>, 3> variance_vec;
+triple_buffer_t<preview_snapshot_t> preview_snapshots;
+bool publish_previews = false;
 
-template <size_t Channel>
-void fitness_func(const tree_t& tree, fitness_t& fitness, const blt::size_t index)
+island_link_t* island_link = nullptr;
+island_topology_t island_topology = island_topology_t::ring;
+blt::u32 migration_interval = 0;
+blt::u32 migrant_count = 0;
+
+enum checkpoint_section_id_t : blt::u32
 {
-	auto image = tree.get_evaluation_ref<image_t>();
+	CHECKPOINT_RUN_STATE = 1,
+	CHECKPOINT_SETTINGS = 2,
+	CHECKPOINT_REFERENCE = 3,
+	CHECKPOINT_POPULATION = 16,
+	CHECKPOINT_FITNESS = 20,
+	CHECKPOINT_CHANNEL_HISTORY = 36
+};
+
+// everything outside of the programs and the per-channel arrays needed to continue a run
+struct checkpoint_run_state_t
+{
+	blt::u64 seed;
+	blt::u32 generation;
+	blt::i32 dimensions;
+	blt::u64 population_size;
+	blt::u64 screening_row_offset;
+	double screening_threshold[3];
+};
+
+// what the run was evolving under, a resumed run only continues the same way if all of it matches
+struct checkpoint_settings_t
+{
+	blt::u64 elites;
+	double crossover_chance;
+	double mutation_chance;
+	double reproduction_chance;
+	double screening_quantile;
+	blt::u32 transcendental_table_bits;
+	blt::u32 gamma_correction;
+};
+
+// every SCREENING_ROW_STRIDE-th row is scored first, starting at a row offset that rotates each generation
+constexpr blt::size_t SCREENING_ROW_STRIDE = 16;
+constexpr blt::size_t SCREENING_ROW_STEP = 7;
+// fraction of the previous generation that is always scored exactly, 0 disables screening
+double screening_quantile = 0;
+std::atomic_size_t screening_row_offset = 0;
+std::array<std::atomic<double>, 3> screening_threshold{
+	std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()
+};
+std::atomic_uint64_t screened_evaluations = 0;
+std::atomic_uint64_t full_evaluations = 0;
+
+/**
+ * Persistent worker per colour channel. run() hands every worker the same job and blocks until all of them are done, so the
+ * three channel pipelines only meet once per generation instead of at every phase.
+ */
+class channel_runner_t
+{
+public:
+	explicit channel_runner_t(const blt::size_t channels)
+	{
+		for (blt::size_t i = 0; i < channels; ++i)
+			workers.emplace_back([this, i]() {
+				worker_loop(i);
+			});
+	}
 
-	auto& data = image->get_data();
-	for (blt::size_t x = 0; x < IMAGE_DIMENSIONS; ++x)
+	~channel_runner_t()
 	{
-		for (blt::size_t y = 0; y < IMAGE_DIMENSIONS; ++y)
 		{
-			switch (Channel)
+			std::scoped_lock lock(mutex);
+			stopping = true;
+		}
+		work_ready.notify_all();
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	void run(const std::function<void(blt::size_t)>& func)
+	{
+		std::unique_lock lock(mutex);
+		job = &func;
+		remaining = workers.size();
+		++epoch;
+		work_ready.notify_all();
+		work_done.wait(lock, [this]() {
+			return remaining == 0;
+		});
+		job = nullptr;
+	}
+
+private:
+	void worker_loop(const blt::size_t channel)
+	{
+		blt::u64 seen_epoch = 0;
+		while (true)
+		{
+			const std::function<void(blt::size_t)>* current;
 			{
-				case 0:
-					images_red[index][(y * IMAGE_DIMENSIONS + x)] = data.get(x, y);
-					break;
-				case 1:
-					images_green[index][(y * IMAGE_DIMENSIONS + x)] = data.get(x, y);
-					break;
-				case 2:
-					images_blue[index][(y * IMAGE_DIMENSIONS + x)] = data.get(x, y);
-					break;
-				default:
-					break;
+				std::unique_lock lock(mutex);
+				work_ready.wait(lock, [&]() {
+					return stopping || epoch != seen_epoch;
+				});
+				if (stopping)
+					return;
+				seen_epoch = epoch;
+				current = job;
 			}
-			// images[index][(y * IMAGE_DIMENSIONS + x) * 3 + Channel] = data.get(x, y);
+			(*current)(channel);
+			{
+				std::scoped_lock lock(mutex);
+				--remaining;
+			}
+			work_done.notify_one();
+		}
+	}
 
-			const auto our = static_cast<double>(data.get(x, y)) / static_cast<double>(std::numeric_limits<blt::u32>::max());
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable work_ready;
+	std::condition_variable work_done;
+	const std::function<void(blt::size_t)>* job = nullptr;
+	blt::size_t remaining = 0;
+	blt::u64 epoch = 0;
+	bool stopping = false;
+};
+
+/**
+ * The cores shared by the three programs' evaluations. blt::gp gives every program its own pool, so with concurrent channels
+ * there are three threads per core. Each evaluation takes a slot first, so only as many run at once as there are cores,
+ * whichever channel they belong to. A channel that finishes early stops asking for slots and the channels still running get
+ * its cores, rather than the machine being oversubscribed while all three run.
+ */
+class evaluation_slots_t
+{
+public:
+	class scope_t
+	{
+	public:
+		explicit scope_t(evaluation_slots_t* slots): slots(slots)
+		{
+			if (slots)
+				slots->acquire();
+		}
 
-			const auto theirs = reference_image[Channel].get(x, y);
+		scope_t(const scope_t&) = delete;
+		scope_t& operator=(const scope_t&) = delete;
 
-			const auto gamma_ours = std::pow(our, 1.0f / 2.2f);
-			// const auto gamma_theirs = std::pow(theirs, 1.0f / 2.2f);
+		~scope_t()
+		{
+			if (slots)
+				slots->release();
+		}
 
-			if (use_gamma_correction)
-			{
-				const auto diff = gamma_ours - theirs;
-				fitness.raw_fitness += static_cast<float>((diff * diff));
-			} else
+	private:
+		evaluation_slots_t* slots;
+	};
+
+	explicit evaluation_slots_t(const blt::size_t count): available(count)
+	{}
+
+private:
+	void acquire()
+	{
+		std::unique_lock lock(mutex);
+		freed.wait(lock, [this]() {
+			return available != 0;
+		});
+		--available;
+	}
+
+	void release()
+	{
+		{
+			std::scoped_lock lock(mutex);
+			++available;
+		}
+		freed.notify_one();
+	}
+
+	std::mutex mutex;
+	std::condition_variable freed;
+	blt::size_t available;
+};
+
+evaluation_slots_t evaluation_slots{std::max(1u, std::thread::hardware_concurrency())};
+
+bool concurrent_channels = true;
+blt::size_t program_thread_count = 0;
+// evaluation workers only need the operators, see set_population_generation
+bool generate_population = true;
+std::unique_ptr<channel_runner_t> channel_runner;
+
+blt::u64 nanos_since(const std::chrono::steady_clock::time_point start)
+{
+	return static_cast<blt::u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+}
+
+/**
+ * Scores an evaluated output against the references. The screening state is passed in rather than read from the globals so
+ * evaluation workers can use the coordinator's.
+ * @return true if the fitness was extrapolated from the row subsample
+ */
+bool score_output(const blt::size_t channel, const image_ipixel_t* data, fitness_t& fitness, const double threshold,
+				const blt::u64 row_offset, const bool gamma)
+{
+	// the output and every target share the same y * dimensions + x layout, so the error is a single linear pass over the buffers
+	const auto& kernels = get_kernels();
+	const auto first_target = fitness_target < 0 ? 0 : static_cast<blt::size_t>(fitness_target);
+	const auto targets = fitness_target < 0 ? references.size() : 1;
+	thread_local std::vector<double> errors;
+	errors.assign(targets, 0.0);
+	const auto add_squared_error = [&](const blt::size_t offset, const blt::size_t count) {
+		for (blt::size_t chunk = offset; chunk < offset + count; chunk += ERROR_CHUNK_PIXELS)
+		{
+			const auto chunk_size = std::min(ERROR_CHUNK_PIXELS, offset + count - chunk);
+			for (blt::size_t target = 0; target < targets; ++target)
 			{
-				const auto diff = our - theirs;
-				fitness.raw_fitness += static_cast<float>((diff * diff));
+				const auto theirs = references.channel(channel, first_target + target) + chunk;
+				errors[target] += gamma
+									? kernels.squared_error_lut(data + chunk, theirs, gamma_lut.data(), chunk_size)
+									: kernels.squared_error(data + chunk, theirs, chunk_size);
 			}
 		}
+	};
+	const auto combined_error = [&]() {
+		if (target_aggregate == target_aggregate_t::max)
+			return *std::max_element(errors.begin(), errors.end());
+		return std::accumulate(errors.begin(), errors.end(), 0.0) / static_cast<double>(errors.size());
+	};
+
+	// the error over a subset of rows is a lower bound on the full error, so once it passes the previous generation's cutoff the
+	// individual can't be one of the ones we care about ranking exactly and the sample is extrapolated instead. the mean and
+	// max of per-target lower bounds are lower bounds of the mean and max
+	if (threshold < std::numeric_limits<double>::infinity())
+	{
+		const auto dimensions = static_cast<blt::size_t>(image_dimensions());
+		blt::size_t rows = 0;
+		for (auto row = row_offset; row < dimensions; row += SCREENING_ROW_STRIDE, ++rows)
+			add_squared_error(row * dimensions, dimensions);
+		const auto partial = combined_error();
+		if (partial > threshold)
+		{
+			fitness.raw_fitness += partial * static_cast<double>(dimensions) / static_cast<double>(rows);
+			fitness.set_normal(static_cast<float>(std::sqrt(fitness.raw_fitness)));
+			return true;
+		}
+		errors.assign(targets, 0.0);
 	}
+	add_squared_error(0, image_size());
+	fitness.raw_fitness += combined_error();
+
 	fitness.set_normal(static_cast<float>(std::sqrt(fitness.raw_fitness)));
 	// fitness.raw_fitness = static_cast<float>(std::sqrt(fitness.raw_fitness));
 	// fitness.standardized_fitness = fitness.raw_fitness;
 	// fitness.adjusted_fitness = -fitness.standardized_fitness;
+	return false;
+}
+
+// what the coordinator sends an evaluation worker, followed by the tree as written by write_tree
+struct worker_request_t
+{
+	blt::u32 channel;
+	blt::u32 index;
+	double screening_threshold;
+	blt::u64 screening_row_offset;
+	bool gamma;
+	bool return_image;
+};
+
+// what comes back, followed by the output image if it was asked for
+struct worker_response_t
+{
+	fitness_t fitness;
+	bool screened;
+};
+
+// the largest serialised tree sent to a worker
+constexpr blt::size_t WORKER_REQUEST_BYTES = 256 * 1024;
+
+eval_worker_pool_t* evaluation_workers = nullptr;
+bool worker_images = true;
+std::atomic_uint64_t failed_evaluations = 0;
+
+/**
+ * Everything a worker scores with that doesn't come with each request. A worker that reports a different one than the
+ * coordinator's is never used, see eval_workers.h.
+ */
+blt::u64 evaluation_configuration()
+{
+	return combine_keys(op_tag("evaluation_configuration"), key_of_value(references_hash), key_of_value(fitness_target),
+						key_of_value(target_aggregate), key_of_value(image_dimensions()));
+}
+
+/**
+ * @return false if no worker is left to evaluate with, fitness is untouched then
+ */
+bool evaluate_in_worker(const blt::size_t channel, const tree_t& tree, fitness_t& fitness, const blt::size_t index)
+{
+	static_assert(std::is_trivially_copyable_v<worker_request_t> && std::is_trivially_copyable_v<worker_response_t>);
+	thread_local byte_writer_t request;
+	thread_local std::vector<char> response;
+	worker_request_t header{};
+	header.channel = static_cast<blt::u32>(channel);
+	header.index = static_cast<blt::u32>(index);
+	header.screening_threshold = screening_threshold[channel].load(std::memory_order_relaxed);
+	header.screening_row_offset = screening_row_offset.load(std::memory_order_relaxed);
+	header.gamma = use_gamma_correction.load(std::memory_order_relaxed);
+	header.return_image = worker_images;
+	request.bytes.clear();
+	request.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	write_tree(request, tree);
+	response.resize(sizeof(worker_response_t) + image_size_bytes());
+
+	const auto outcome = evaluation_workers->evaluate({request.bytes.data(), request.bytes.size()}, response.data());
+	if (outcome == eval_outcome_t::unavailable)
+	{
+		static std::atomic_bool warned = false;
+		if (!warned.exchange(true))
+			BLT_ERROR("No evaluation workers are left, evaluating in this process from now on");
+		return false;
+	}
+	if (outcome == eval_outcome_t::failed)
+	{
+		// a tree that crashes or hangs its worker is ranked last rather than taking the run down with it
+		fitness.raw_fitness = std::numeric_limits<float>::max();
+		fitness.set_normal(static_cast<float>(std::sqrt(fitness.raw_fitness)));
+		previews.capture(channel, index, nullptr, fitness.adjusted_fitness);
+		failed_evaluations.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+	worker_response_t result{};
+	std::memcpy(&result, response.data(), sizeof(result));
+	fitness = result.fitness;
+	if (worker_images)
+	{
+		thread_local std::vector<image_ipixel_t> output;
+		output.resize(image_size());
+		std::memcpy(output.data(), response.data() + sizeof(result), image_size_bytes());
+		previews.capture(channel, index, output.data(), fitness.adjusted_fitness);
+	}
+	(result.screened ? screened_evaluations : full_evaluations).fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+template <size_t Channel>
+void fitness_func(const tree_t& tree, fitness_t& fitness, const blt::size_t index)
+{
+	if (evaluation_workers && evaluate_in_worker(Channel, tree, fitness, index))
+		return;
+
+	// sequential channels have a single pool running, it can't oversubscribe the machine on its own
+	const evaluation_slots_t::scope_t slot{concurrent_channels ? &evaluation_slots : nullptr};
+	auto image = tree.get_evaluation_ref<image_t>();
+
+	const auto& data = image->get_data().data;
+	const auto screened = score_output(Channel, data.data(), fitness, screening_threshold[Channel].load(std::memory_order_relaxed),
+										screening_row_offset.load(std::memory_order_relaxed),
+										use_gamma_correction.load(std::memory_order_relaxed));
+	previews.capture(Channel, index, data.data(), fitness.adjusted_fitness);
+	(screened ? screened_evaluations : full_evaluations).fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Evaluates an operator through the evaluation cache, compute is only called on a miss and writes into an output that may
+ * reuse one of args' buffers. Hits share the cached buffer, but cached buffers can't be overwritten in place by the parent
+ * operator, so only operators that cost noticeably more than that go through the cache. Cheap integer operators only
+ * propagate their key.
+ */
+template <typename Func, typename... Args>
+image_t cached_image(const blt::u64 key, Func&& compute, const Args&... args)
+{
+	if (const auto shared = eval_cache_acquire(key))
+		return image_t{shared, key};
+	auto ret = image_t::output_for(args...);
+	compute(ret);
+	ret.set_key(key);
+	eval_cache_store(key, ret.get_data());
+	return ret;
 }
 
 template <typename T>
 void setup_operations(gp_program* program)
 {
 	static operation_t op_image_x([]() {
-		constexpr auto mul = std::numeric_limits<blt::u32>::max() / static_cast<blt::u32>(IMAGE_DIMENSIONS - 1);
+		const operator_timer_t timer{profiled_op_t::image_x};
 		image_t ret{};
-		for (blt::u32 x = 0; x < IMAGE_DIMENSIONS; ++x)
-		{
-			for (blt::u32 y = 0; y < IMAGE_DIMENSIONS; ++y)
-				ret.get_data().get(x, y) = y * mul;
-		}
+		dispatch_dimensions([&ret](const auto dimensions) {
+			const auto mul = std::numeric_limits<blt::u32>::max() / static_cast<blt::u32>(dimensions - 1);
+			for (blt::u32 x = 0; x < static_cast<blt::u32>(dimensions); ++x)
+			{
+				for (blt::u32 y = 0; y < static_cast<blt::u32>(dimensions); ++y)
+					ret.get_data().get(x, y) = y * mul;
+			}
+		});
+		ret.set_key(combine_keys(op_tag("image_x")));
 		return ret;
 	});
 	static operation_t op_image_y([]() {
-		constexpr auto mul = std::numeric_limits<blt::u32>::max() / static_cast<blt::u32>(IMAGE_DIMENSIONS - 1);
+		const operator_timer_t timer{profiled_op_t::image_y};
 		image_t ret{};
-		for (blt::u32 x = 0; x < IMAGE_DIMENSIONS; ++x)
-		{
-			for (blt::u32 y = 0; y < IMAGE_DIMENSIONS; ++y)
-				ret.get_data().get(x, y) = x * mul;
-		}
+		dispatch_dimensions([&ret](const auto dimensions) {
+			const auto mul = std::numeric_limits<blt::u32>::max() / static_cast<blt::u32>(dimensions - 1);
+			for (blt::u32 x = 0; x < static_cast<blt::u32>(dimensions); ++x)
+			{
+				for (blt::u32 y = 0; y < static_cast<blt::u32>(dimensions); ++y)
+					ret.get_data().get(x, y) = x * mul;
+			}
+		});
+		ret.set_key(combine_keys(op_tag("image_y")));
 		return ret;
 	});
 	static auto op_image_random = operation_t([program]() {
+		const operator_timer_t timer{profiled_op_t::random};
 		image_t ret{};
 		for (auto& v : ret.get_data().data)
 			v = program->get_random().get_u32(0, std::numeric_limits<blt::u32>::max());
 		return ret;
 	});
 	static auto op_image_noise = operation_t([program]() {
-		image_t ret{};
-		for (auto& v : ret.get_data().data)
-			v = program->get_random().get_u32(0, std::numeric_limits<blt::u32>::max());
-		return ret;
+		const operator_timer_t timer{profiled_op_t::noise};
+		if (const auto recipe = replayed_ephemeral())
+			return make_ephemeral_image(*recipe);
+		const auto state = static_cast<blt::u64>(program->get_random().get_u32(0, std::numeric_limits<blt::u32>::max())) << 32 |
+			program->get_random().get_u32(0, std::numeric_limits<blt::u32>::max());
+		return make_ephemeral_image(noise_recipe(state));
 	}).set_ephemeral();
 	static auto op_image_ephemeral = operation_t([program]() {
-		image_t ret{};
-		const auto value = program->get_random().get_u32(0, std::numeric_limits<blt::u32>::max());
-		for (auto& v : ret.get_data().data)
-			v = value;
-		return ret;
+		const operator_timer_t timer{profiled_op_t::ephemeral};
+		if (const auto recipe = replayed_ephemeral())
+			return make_ephemeral_image(*recipe);
+		return make_ephemeral_image(constant_recipe(program->get_random().get_u32(0, std::numeric_limits<blt::u32>::max())));
 	}).set_ephemeral();
 	// static operation_t op_image_blend([](const image_t a, const image_t b, const float f) {
 	// 	const auto blend = std::min(std::max(f, 0.0f), 1.0f);
 	// 	const auto beta = 1.0f - blend;
 	// 	image_t ret{};
-	// 	const cv::Mat src1{IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, CV_32F, a.as_void_const()};
-	// 	const cv::Mat src2{IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, CV_32F, b.as_void_const()};
-	// 	cv::Mat dst{IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, CV_32F, ret.get_data().data.data()};
+	// 	const cv::Mat src1{dimensions, dimensions, CV_32F, a.as_void_const()};
+	// 	const cv::Mat src2{dimensions, dimensions, CV_32F, b.as_void_const()};
+	// 	cv::Mat dst{dimensions, dimensions, CV_32F, ret.get_data().data.data()};
 	// 	addWeighted(src1, blend, src2, beta, 0.0, dst);
 	// 	return ret;
 	// }, "blend_image");
 	static operation_t op_image_sin([](const image_t a) {
-		constexpr auto limit = static_cast<double>(std::numeric_limits<blt::u32>::max());
-		image_t ret{};
-		for (const auto& [i, v] : blt::enumerate(std::as_const(a.get_data().data)))
-			ret.get_data().data[i] = static_cast<blt::u32>(((std::sin((v / limit) * blt::PI) + 1.0) / 2.0f) * limit);
-		return ret;
+		const operator_timer_t timer{profiled_op_t::sin};
+		return pointwise_image(pixel_op_t::sin, combine_keys(op_tag("sin_image"), a.get_key()), a);
 	}, "sin_image");
 	static operation_t op_image_sin_off([](const image_t a, const image_t b) {
-		constexpr auto limit = static_cast<double>(std::numeric_limits<blt::u32>::max());
-		image_t ret{};
-		for (const auto& [i, v, off] : blt::in_pairs(std::as_const(a.get_data().data), std::as_const(b.get_data().data)).enumerate().flatten())
-			ret.get_data().data[i] = static_cast<blt::u32>(((std::sin((v / limit) * blt::PI * (off / (limit / 4))) + 1.0) / 2.0f) * limit);
-		return ret;
+		const operator_timer_t timer{profiled_op_t::sin_off};
+		return pointwise_image(pixel_op_t::sin_off, combine_keys(op_tag("sin_image_off"), a.get_key(), b.get_key()), a, b);
 	}, "sin_image_off");
 	static operation_t op_image_cos([](const image_t a) {
-		constexpr auto limit = static_cast<double>(std::numeric_limits<blt::u32>::max());
-		image_t ret{};
-		for (const auto& [i, v] : blt::enumerate(std::as_const(a.get_data().data)))
-			ret.get_data().data[i] = static_cast<blt::u32>(((std::cos((v / limit) * blt::PI * 2) + 1.0) / 2.0f) * limit);
-		return ret;
+		const operator_timer_t timer{profiled_op_t::cos};
+		return pointwise_image(pixel_op_t::cos, combine_keys(op_tag("cos_image"), a.get_key()), a);
 	}, "cos_image");
 	static operation_t op_image_cos_off([](const image_t a, const image_t b) {
-		constexpr auto limit = static_cast<double>(std::numeric_limits<blt::u32>::max());
-		image_t ret{};
-		for (const auto& [i, v, off] : blt::in_pairs(std::as_const(a.get_data().data), std::as_const(b.get_data().data)).enumerate().flatten())
-			ret.get_data().data[i] = static_cast<blt::u32>(((std::cos((v / limit) * blt::PI * (off / (limit / 2))) + 1.0) / 2.0f) * limit);
-		return ret;
+		const operator_timer_t timer{profiled_op_t::cos_off};
+		return pointwise_image(pixel_op_t::cos_off, combine_keys(op_tag("cos_image_off"), a.get_key(), b.get_key()), a, b);
 	}, "cos_image_off");
 	static operation_t op_image_log([](const image_t a) {
-		constexpr auto limit = static_cast<double>(std::numeric_limits<blt::u32>::max());
-		image_t ret{};
-		for (const auto& [i, v] : blt::enumerate(std::as_const(a.get_data().data)))
-		{
-			if (v == 0)
-				ret.get_data().data[i] = 0;
-			else
-				ret.get_data().data[i] = static_cast<blt::u32>(std::log(v / limit) * limit);
-		}
-		return ret;
+		const operator_timer_t timer{profiled_op_t::log};
+		return pointwise_image(pixel_op_t::log, combine_keys(op_tag("log_image"), a.get_key()), a);
 	}, "log_image");
 	static operation_t op_image_exp([](const image_t a) {
-		constexpr auto limit = static_cast<double>(std::numeric_limits<blt::u32>::max());
-		image_t ret{};
-		for (const auto& [i, v] : blt::enumerate(std::as_const(a.get_data().data)))
-			ret.get_data().data[i] = static_cast<blt::u32>(std::exp(v / limit) * limit);
-		return ret;
+		const operator_timer_t timer{profiled_op_t::exp};
+		return pointwise_image(pixel_op_t::exp, combine_keys(op_tag("exp_image"), a.get_key()), a);
 	}, "exp_image");
 	static operation_t op_image_abs([](const image_t a) {
-		image_t ret{};
-		for (const auto& [i, v] : blt::enumerate(std::as_const(a.get_data().data)))
-			ret.get_data().data[i] = std::numeric_limits<blt::u32>::max() - v;
-		return ret;
+		const operator_timer_t timer{profiled_op_t::abs};
+		// u32 max - v is the same as ~v
+		return pointwise_image(pixel_op_t::bit_not, combine_keys(op_tag("abs_image"), a.get_key()), a);
 	}, "abs_image");
 	static operation_t op_image_mod([](const image_t a, const image_t b) {
-		image_t ret{};
-		for (const auto& [i, av, bv] : blt::in_pairs(std::as_const(a.get_data().data), std::as_const(b.get_data().data)).enumerate().flatten())
-			ret.get_data().data[i] = bv == 0 ? 0 : av % bv;
-		return ret;
+		const operator_timer_t timer{profiled_op_t::mod};
+		return pointwise_image(pixel_op_t::mod, combine_keys(op_tag("mod_image"), a.get_key(), b.get_key()), a, b);
 	}, "mod_image");
 	static operation_t op_image_or([](const image_t a, const image_t b) {
-		image_t ret{};
-		for (const auto& [i, av, bv] : blt::in_pairs(std::as_const(a.get_data().data), std::as_const(b.get_data().data)).enumerate().flatten())
-			ret.get_data().data[i] = av | bv;
-		return ret;
+		const operator_timer_t timer{profiled_op_t::bit_or};
+		return pointwise_image(pixel_op_t::bit_or, combine_keys(op_tag("bit_or_image"), a.get_key(), b.get_key()), a, b);
 	}, "bit_or_image");
 	static operation_t op_image_and([](const image_t a, const image_t b) {
-		image_t ret{};
-		for (const auto& [i, av, bv] : blt::in_pairs(std::as_const(a.get_data().data), std::as_const(b.get_data().data)).enumerate().flatten())
-			ret.get_data().data[i] = av & bv;
-		return ret;
+		const operator_timer_t timer{profiled_op_t::bit_and};
+		return pointwise_image(pixel_op_t::bit_and, combine_keys(op_tag("bit_and_image"), a.get_key(), b.get_key()), a, b);
 	}, "bit_and_image");
 	static operation_t op_image_xor([](const image_t a, const image_t b) {
-		image_t ret{};
-		for (const auto& [i, av, bv] : blt::in_pairs(std::as_const(a.get_data().data), std::as_const(b.get_data().data)).enumerate().flatten())
-			ret.get_data().data[i] = av ^ bv;
-		return ret;
+		const operator_timer_t timer{profiled_op_t::bit_xor};
+		return pointwise_image(pixel_op_t::bit_xor, combine_keys(op_tag("bit_xor_image"), a.get_key(), b.get_key()), a, b);
 	}, "bit_xor_image");
 	static operation_t op_image_not([](const image_t a) {
-		image_t ret{};
-		for (const auto& [i, av] : blt::enumerate(std::as_const(a.get_data().data)).flatten())
-			ret.get_data().data[i] = ~av;
-		return ret;
+		const operator_timer_t timer{profiled_op_t::bit_not};
+		return pointwise_image(pixel_op_t::bit_not, combine_keys(op_tag("bit_not_image"), a.get_key()), a);
 	}, "bit_not_image");
 	static operation_t op_image_srgb([](const image_t a) {
-		constexpr auto limit = static_cast<double>(std::numeric_limits<blt::u32>::max());
-		image_t ret{};
-		for (const auto& [i, av] : blt::enumerate(std::as_const(a.get_data().data)).flatten())
-			ret.get_data().data[i] = static_cast<blt::u32>(std::pow(av / limit, 1.0/2.2) * limit);
-		return ret;
+		const operator_timer_t timer{profiled_op_t::srgb};
+		return pointwise_image(pixel_op_t::srgb, combine_keys(op_tag("srgb_image"), a.get_key()), a);
 	}, "srgb_image");
 	static operation_t op_image_linear([](const image_t a) {
-		struct f
-		{
-			static float srgb_to_linear(const float v) noexcept
-			{
-				return (v <= 0.04045f) ? (v / 12.92f)
-									   : std::pow((v + 0.055f) / 1.055f, 2.4f);
-			}
-		};
-
-		constexpr auto limit = static_cast<float>(std::numeric_limits<blt::u32>::max());
-		image_t ret{};
-		for (const auto& [i, av] : blt::enumerate(std::as_const(a.get_data().data)).flatten())
-			ret.get_data().data[i] = static_cast<blt::u32>(f::srgb_to_linear(static_cast<float>(av) / limit) * limit);
-		return ret;
+		const operator_timer_t timer{profiled_op_t::linear};
+		return pointwise_image(pixel_op_t::linear, combine_keys(op_tag("linear_image"), a.get_key()), a);
 	}, "srgb_image");
 	static operation_t op_image_gt([](const image_t a, const image_t b) {
-		image_t ret{};
-		for (const auto& [i, av, bv] : blt::in_pairs(std::as_const(a.get_data().data), std::as_const(b.get_data().data)).enumerate().flatten())
-			ret.get_data().data[i] = av > bv ? av : bv;
-		return ret;
+		const operator_timer_t timer{profiled_op_t::gt};
+		return pointwise_image(pixel_op_t::max, combine_keys(op_tag("gt_image"), a.get_key(), b.get_key()), a, b);
 	}, "gt_image");
 	static operation_t op_image_lt([](const image_t a, const image_t b) {
-		image_t ret{};
-		for (const auto& [i, av, bv] : blt::in_pairs(std::as_const(a.get_data().data), std::as_const(b.get_data().data)).enumerate().flatten())
-			ret.get_data().data[i] = av < bv ? av : bv;
-		return ret;
+		const operator_timer_t timer{profiled_op_t::lt};
+		return pointwise_image(pixel_op_t::min, combine_keys(op_tag("lt_image"), a.get_key(), b.get_key()), a, b);
 	}, "lt_image");
 	static operation_t op_image_grad([](const image_t a, const image_t b) {
-		image_t out{};
-
-		for (const auto& [i, av, bv] : blt::in_pairs(std::as_const(a.get_data().data), std::as_const(b.get_data().data)).enumerate().flatten())
-		{
-			const auto p = static_cast<double>(i) / static_cast<double>(IMAGE_SIZE);
-			const auto pi = 1 - p;
-
-			out.get_data().data[i] = static_cast<blt::u32>(av * p + bv * pi);
-		}
-		return out;
+		const operator_timer_t timer{profiled_op_t::grad};
+		return pointwise_image(pixel_op_t::grad, combine_keys(op_tag("grad_image"), a.get_key(), b.get_key()), a, b);
 	}, "grad_image");
 	static operation_t op_image_perlin([](const image_t a) {
-		constexpr auto limit = static_cast<double>(std::numeric_limits<blt::u32>::max());
-		image_t ret{};
-		for (const auto& [i, out, bv] : blt::in_pairs(ret.get_data().data, std::as_const(a.get_data().data)).enumerate().flatten())
-		{
-			constexpr auto AND = IMAGE_DIMENSIONS - 1;
-			const double y = (static_cast<float>(i) / IMAGE_DIMENSIONS) / static_cast<float>(IMAGE_DIMENSIONS);
-			const double x = static_cast<float>(i & AND) / static_cast<float>(IMAGE_DIMENSIONS);
-			out = static_cast<blt::u32>(stb_perlin_noise3(static_cast<float>(x), static_cast<float>(y), static_cast<float>(bv / (limit * 0.1)), 0, 0,
-														0) * limit);
-		}
-		return ret;
+		const operator_timer_t timer{profiled_op_t::perlin};
+		return cached_image(combine_keys(op_tag("perlin_image"), a.get_key()), [&](image_t& ret) {
+			constexpr auto limit = static_cast<double>(std::numeric_limits<blt::u32>::max());
+			perlin_from_image(a.get_data().data.data(), ret.get_data().data.data(), image_dimensions(), 1.0 / (limit * 0.1));
+		}, a);
 	}, "perlin_image");
 	static auto op_image_2d_perlin_eph = operation_t([program]() {
-		constexpr auto limit = static_cast<double>(std::numeric_limits<blt::u32>::max());
-		image_t ret{};
+		const operator_timer_t timer{profiled_op_t::perlin_eph};
+		if (const auto recipe = replayed_ephemeral())
+			return make_ephemeral_image(*recipe);
 		const auto variety = program->get_random().get_float(1.5, 255);
 		const auto x_warp = program->get_random().get_i32(0, 255);
 		const auto y_warp = program->get_random().get_i32(0, 255);
@@ -329,19 +646,12 @@ void setup_operations(gp_program* program)
 		const auto offset_x = program->get_random().get_float(1.0 / 64.0f, 16.0f);
 		const auto offset_y = program->get_random().get_float(1.0 / 64.0f, 16.0f);
 
-		for (const auto& [i, out] : blt::enumerate(ret.get_data().data))
-		{
-			constexpr auto AND = IMAGE_DIMENSIONS - 1;
-			const double y = (static_cast<float>(i) / IMAGE_DIMENSIONS) / static_cast<float>(IMAGE_DIMENSIONS);
-			const double x = static_cast<float>(i & AND) / static_cast<float>(IMAGE_DIMENSIONS);
-			out = static_cast<blt::u32>(stb_perlin_noise3(static_cast<float>(x) * offset_x, static_cast<float>(y) * offset_y, variety, x_warp, y_warp,
-														z_warp) * limit);
-		}
-		return ret;
+		return make_ephemeral_image(perlin_recipe(variety, x_warp, y_warp, z_warp, offset_x, offset_y));
 	}, "perlin_image_eph").set_ephemeral();
 	static auto op_image_2d_perlin_oct = operation_t([program]() {
-		constexpr auto limit = static_cast<double>(std::numeric_limits<blt::u32>::max());
-		image_t ret{};
+		const operator_timer_t timer{profiled_op_t::perlin_oct};
+		if (const auto recipe = replayed_ephemeral())
+			return make_ephemeral_image(*recipe);
 		const auto rand = program->get_random().get_float(0, 255);
 		const auto octaves = program->get_random().get_i32(2, 8);
 		const auto gain = program->get_random().get_float(0.1f, 0.9f);
@@ -349,71 +659,41 @@ void setup_operations(gp_program* program)
 
 		const auto offset = program->get_random().get_float(1.0 / 255.0f, 16.0f);
 
-		for (const auto& [i, out] : blt::enumerate(ret.get_data().data))
-		{
-			constexpr auto AND = IMAGE_DIMENSIONS - 1;
-			const double y = (static_cast<float>(i) / IMAGE_DIMENSIONS) / static_cast<float>(IMAGE_DIMENSIONS);
-			const double x = static_cast<float>(i & AND) / static_cast<float>(IMAGE_DIMENSIONS);
-			out = static_cast<blt::u32>(stb_perlin_fbm_noise3(static_cast<float>(x * offset), static_cast<float>(y * offset), rand, lac, gain,
-															octaves) * limit);
-		}
-		return ret;
+		return make_ephemeral_image(perlin_fbm_recipe(rand, octaves, gain, lac, offset));
 	}, "perlin_image_eph_oct").set_ephemeral();
 
 	static operation_t op_passthrough([](const image_t& a) {
-		image_t ret{};
-		std::memcpy(ret.get_data().data.data(), a.get_data().data.data(), IMAGE_SIZE_BYTES);
-		return ret;
+		const operator_timer_t timer{profiled_op_t::passthrough};
+		// the argument is dropped after the call, so a second reference is all it takes to pass it on untouched
+		return a.share();
 	}, "passthrough");
 
 	static operation_t op_erode([program](const image_t a) {
+		const operator_timer_t timer{profiled_op_t::erode};
 		const auto erosion_size = program->get_random().get_i32(3, 12);
-		std::vector<float> converted_data = to_cv2(a);
-		std::vector<float> output_data(IMAGE_SIZE);
-
-		const cv::Mat src{IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, CV_32F, converted_data.data()};
-		cv::Mat dst{IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, CV_32F, output_data.data()};
-
-		const cv::Mat element = cv::getStructuringElement(cv::MORPH_ERODE, cv::Size(erosion_size, erosion_size));
-		cv::erode(src, dst, element);
-
-		return from_cv2(output_data);
+		auto ret = image_t::output_for(a);
+		erode_rect(a.get_data().data.data(), ret.get_data().data.data(), image_dimensions(), erosion_size);
+		return ret;
 	}, "erode_image");
 
 	static operation_t op_dilate([program](const image_t a) {
+		const operator_timer_t timer{profiled_op_t::dilate};
 		const auto dilate_size = program->get_random().get_i32(3, 12);
-		std::vector<float> converted_data = to_cv2(a);
-		std::vector<float> output_data(IMAGE_SIZE);
-
-		const cv::Mat src{IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, CV_32F, converted_data.data()};
-		cv::Mat dst{IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, CV_32F, output_data.data()};
-
-		const cv::Mat element = cv::getStructuringElement(cv::MORPH_DILATE, cv::Size(dilate_size, dilate_size));
-		cv::dilate(src, dst, element);
-
-		return from_cv2(output_data);
+		auto ret = image_t::output_for(a);
+		// a cross rather than a square, the element this operator has always used
+		dilate_cross(a.get_data().data.data(), ret.get_data().data.data(), image_dimensions(), dilate_size);
+		return ret;
 	}, "dilate_image");
 	static operation_t op_band_pass([program](const image_t a) {
-		auto input = to_cv2(a);
-		std::vector<float> output_data(IMAGE_SIZE);
-
-		const cv::Mat src{IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, CV_32F, input.data()};
-		cv::Mat dst{IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, CV_32F, output_data.data()};
-
+		const operator_timer_t timer{profiled_op_t::band_pass};
 		const auto sigmaLow = program->get_random().get_float(0.5f, 2.0f);
 		const auto sigmaHigh = program->get_random().get_float(3.f, 12.f);
 
 		const auto size = program->get_random().get_i32(1,5) * 2 + 1;
 
-		cv::Mat low{IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, CV_32F}, high{IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, CV_32F};
-		cv::GaussianBlur(src, low,  cv::Size(size, size), sigmaLow);
-		cv::GaussianBlur(src, high, cv::Size(size, size), sigmaHigh);
-
-		cv::Mat dog = high - low;
-		cv::normalize(dog, dog, 0, 1, cv::NORM_MINMAX);
-		dog.copyTo(dst);
-
-		return from_cv2(output_data);
+		auto ret = image_t::output_for(a);
+		band_pass(a.get_data().data.data(), ret.get_data().data.data(), image_dimensions(), size, sigmaLow, sigmaHigh);
+		return ret;
 	}, "band_pass");
 
 	operator_builder builder{};
@@ -422,23 +702,53 @@ void setup_operations(gp_program* program)
 				op_band_pass, op_image_perlin, op_image_noise, op_image_random, op_image_2d_perlin_eph, op_image_not, op_image_srgb,
 				op_image_grad, op_image_2d_perlin_oct, op_erode, op_dilate, op_image_abs, op_image_mod, op_image_linear);
 	// builder.build(op_thresh, op_image_2d_perlin_oct);
-	program->set_operations(builder.grab());
+	auto storage = builder.grab();
+	operator_count = storage.operators.size();
+	program->set_operations(std::move(storage));
 }
 
-void setup_gp_system(const blt::size_t population_size)
+/**
+ * The programs' random engines are reseeded at the start of every generation from the run's seed, the generation and the
+ * channel. A generation then only depends on the population it starts from, which is what lets a resumed run continue
+ * exactly as the original would have.
+ */
+blt::u64 generation_seed(const blt::size_t channel)
 {
-	reference_image = image_storage_t::from_file("../silly.png");
+	return mix_key(run_seed ^ mix_key(static_cast<blt::u64>(generation) * programs.size() + channel + 1));
+}
+
+bool setup_gp_system(const blt::size_t population_size, const blt::u64 seed, const std::vector<std::string>& reference_paths)
+{
+	references = reference_set_t::load(reference_paths);
+	references_hash = references.hash();
+	if (references.empty())
+	{
+		BLT_ERROR("No reference images could be loaded");
+		return false;
+	}
+	if (fitness_target >= static_cast<blt::i64>(references.size()))
+	{
+		BLT_ERROR("Fitness target {} doesn't exist, only {} references were loaded", fitness_target, references.size());
+		return false;
+	}
+	reference_image = references.target_image(0);
 
 	config.set_pop_size(population_size);
 	config.set_elite_count(2);
-	config.set_thread_count(0);
+	// every program gets a full pool, concurrent evaluations share the cores through evaluation_slots
+	config.set_thread_count(program_thread_count);
+	BLT_INFO("Each channel's program uses {} threads, channels run {}",
+			program_thread_count == 0 ? std::thread::hardware_concurrency() : program_thread_count,
+			concurrent_channels ? "concurrently, sharing the cores between their evaluations" : "one after another");
 	config.set_reproduction_chance(0);
 	// config.set_crossover_chance(0);
 	// config.set_mutation_chance(0);
 	// config.set_reproduction_chance(0);
 
-	const auto rand = std::random_device()();
+	const auto rand = seed == 0 ? std::random_device()() : seed;
 	BLT_INFO("Random Seed: {}", rand);
+	run_seed = rand;
+	generation = 0;
 	for (auto& program : programs)
 	{
 		program = new gp_program{rand, config};
@@ -447,92 +757,283 @@ void setup_gp_system(const blt::size_t population_size)
 	setup_operations<struct p2>(programs[1]);
 	setup_operations<struct p3>(programs[2]);
 
-	images.resize(population_size);
-	images_red.resize(population_size);
-	images_green.resize(population_size);
-	images_blue.resize(population_size);
+	previews.resize(requested_previews, image_size());
 
 	static auto sel = select_tournament_t{};
 
-	for (const auto program : programs)
-		program->generate_initial_population(program->get_typesystem().get_type<image_t>().id());
+	if (generate_population)
+	{
+		for (const auto program : programs)
+			program->generate_initial_population(program->get_typesystem().get_type<image_t>().id());
 
-	programs[0]->setup_generational_evaluation(fitness_func<0>, sel, sel, sel);
-	programs[1]->setup_generational_evaluation(fitness_func<1>, sel, sel, sel);
-	programs[2]->setup_generational_evaluation(fitness_func<2>, sel, sel, sel);
+		programs[0]->setup_generational_evaluation(fitness_func<0>, sel, sel, sel);
+		programs[1]->setup_generational_evaluation(fitness_func<1>, sel, sel, sel);
+		programs[2]->setup_generational_evaluation(fitness_func<2>, sel, sel, sel);
+	}
+
+	channel_runner = std::make_unique<channel_runner_t>(programs.size());
+	return true;
 }
 
-void run_step()
+const char* channel_name(const blt::size_t channel)
 {
-	BLT_TRACE("------------\\{Begin Generation {}}------------", programs[0]->get_current_generation());
-	BLT_TRACE("Creating next generation");
-	for (const auto program : programs)
-		program->create_next_generation();
-	BLT_TRACE("Move to next generation");
-	for (const auto program : programs)
-		program->next_generation();
-	BLT_TRACE("Evaluate Fitness");
-	for (const auto program : programs)
-		program->evaluate_fitness();
-	for (const auto [i, program] : blt::enumerate(programs))
+	switch (channel)
+	{
+		case 0:
+			return "Red";
+		case 1:
+			return "Green";
+		default:
+			return "Blue";
+	}
+}
+
+/**
+ * Sets the channel's screening cutoff to the error at screening_quantile of its current population. Screened individuals only
+ * carry an estimate, but they are all above the previous cutoff so the ones below it are still exact.
+ */
+void update_screening_threshold(const blt::size_t channel, population_t& population)
+{
+	if (screening_quantile <= 0)
 	{
-		auto& cur = program->get_current_pop();
-		auto mean = std::accumulate(cur.begin(), cur.end(), 0.0, [](const double a, const individual_t& b) {
-			return a + b.fitness.adjusted_fitness;
-		}) / static_cast<double>(cur.get_individuals().size());
+		screening_threshold[channel] = std::numeric_limits<double>::infinity();
+		return;
+	}
+	std::vector<double> errors;
+	errors.reserve(population.get_individuals().size());
+	for (const auto& individual : population)
+		errors.push_back(individual.fitness.raw_fitness);
+	if (errors.empty())
+		return;
+	const auto nth = errors.begin() + static_cast<std::ptrdiff_t>(std::min(errors.size() - 1, static_cast<blt::size_t>(
+		screening_quantile * static_cast<double>(errors.size()))));
+	std::nth_element(errors.begin(), nth, errors.end());
+	screening_threshold[channel] = *nth;
+}
+
+/**
+ * Runs one full generation of a single channel's program: breeding, fitness evaluation and the channel's statistics.
+ * Channels share no state here, which is what lets run_step run them concurrently.
+ */
+phase_timings_t run_channel_step(const blt::size_t channel)
+{
+	phase_timings_t timings;
+	const auto program = programs[channel];
+	program->get_random().set_seed(generation_seed(channel));
+
+	auto phase_start = std::chrono::steady_clock::now();
+	program->create_next_generation();
+	timings.create_generation_ns = nanos_since(phase_start);
+
+	phase_start = std::chrono::steady_clock::now();
+	program->next_generation();
+	timings.next_generation_ns = nanos_since(phase_start);
 
-		auto variance = std::accumulate(cur.begin(), cur.end(), 0.0, [mean](const double a, const individual_t& b) {
-			const auto amount = (b.fitness.adjusted_fitness - mean);
-			return a + amount * amount;
-		}) / static_cast<double>(cur.get_individuals().size());
+	phase_start = std::chrono::steady_clock::now();
+	previews.reset_best(channel);
+	program->evaluate_fitness();
+	timings.evaluate_fitness_ns = nanos_since(phase_start);
 
-		mean_vec[i].push_back(static_cast<float>(mean));
-		variance_vec[i].push_back(static_cast<float>(variance));
+	phase_start = std::chrono::steady_clock::now();
+	auto& cur = program->get_current_pop();
+	auto mean = std::accumulate(cur.begin(), cur.end(), 0.0, [](const double a, const individual_t& b) {
+		return a + b.fitness.adjusted_fitness;
+	}) / static_cast<double>(cur.get_individuals().size());
 
-		if (i == 0)
-			BLT_TRACE("Channel Red");
-		else if (i == 1)
-			BLT_TRACE("Channel Green");
-		else
-			BLT_TRACE("Channel Blue");
-		BLT_TRACE("	Program has variance of {}", variance);
+	auto variance = std::accumulate(cur.begin(), cur.end(), 0.0, [mean](const double a, const individual_t& b) {
+		const auto amount = (b.fitness.adjusted_fitness - mean);
+		return a + amount * amount;
+	}) / static_cast<double>(cur.get_individuals().size());
 
-		if (program->get_random().choice())
+	record_history(channel, history_stat_t::mean, mean);
+	record_history(channel, history_stat_t::variance, variance);
+
+	BLT_TRACE("Channel {}", channel_name(channel));
+	BLT_TRACE("	Program has variance of {}", variance);
+
+	if (program->get_random().choice())
+	{
+		grow_generator_t gen;
+		const auto amount = static_cast<size_t>(static_cast<double>(cur.get_individuals().size()) * 0.1);
+		for (size_t j = 0; j < amount; j++)
 		{
-			const auto amount = static_cast<size_t>(static_cast<double>(cur.get_individuals().size()) * 0.1);
-			for (size_t j = 0; j < amount; j++)
-			{
-				static grow_generator_t gen;
-				const auto index = cur.get_individuals().size() - 1 - j;
-				cur.get_individuals()[index].tree.regen(gen, program->get_typesystem().get_type<image_t>().id(), 6, 10);
-			}
+			const auto index = cur.get_individuals().size() - 1 - j;
+			cur.get_individuals()[index].tree.regen(gen, program->get_typesystem().get_type<image_t>().id(), 6, 10);
 		}
-		program->evaluate_fitness();
 	}
+	program->evaluate_fitness();
+	update_screening_threshold(channel, cur);
+	timings.statistics_ns = nanos_since(phase_start);
+
+	return timings;
+}
+
+/**
+ * Individuals are sent one per message as the tree written by write_tree. The best ones are copied out and the worst ones
+ * overwritten in place, so the population keeps its size and the next generation breeds from the migrants like any other
+ * individual. The sender's fitness isn't sent: islands may score against different targets or screen differently, so every
+ * migrant is scored by the island it arrives at, the same way as its own individuals.
+ */
+void migrate_individuals()
+{
+	const auto destinations = island_link->destinations(island_topology);
+	std::array<std::vector<blt::size_t>, 3> replaceable;
+	for (const auto [channel, program] : blt::enumerate(programs))
+	{
+		auto& individuals = program->get_current_pop().get_individuals();
+		std::vector<blt::size_t> order(individuals.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&individuals](const blt::size_t a, const blt::size_t b) {
+			return individuals[a].fitness.adjusted_fitness > individuals[b].fitness.adjusted_fitness;
+		});
+		// never overwrite the individuals being sent, the best half stays put however many migrants arrive
+		const auto count = std::min<blt::size_t>(migrant_count, order.size() / 2);
+		for (blt::size_t i = 0; i < count; ++i)
+		{
+			byte_writer_t writer;
+			write_tree(writer, individuals[order[i]].tree);
+			for (const auto destination : destinations)
+				island_link->send(destination, static_cast<blt::u32>(channel), {writer.bytes.data(), writer.bytes.size()});
+		}
+		replaceable[channel].assign(order.rbegin(), order.rbegin() + static_cast<std::ptrdiff_t>(order.size() / 2));
+	}
+
+	constexpr std::array score{fitness_func<0>, fitness_func<1>, fitness_func<2>};
+	blt::size_t accepted = 0;
+	island_link->receive([&](const island_link_t::message_t& message) {
+		if (message.channel >= programs.size() || replaceable[message.channel].empty())
+			return false;
+		auto& program = *programs[message.channel];
+		// read and score aside first, a malformed message must not leave an empty or unscored tree in the population
+		tree_t migrant{program};
+		checkpoint_file_t::section_reader_t reader{message.payload};
+		if (!read_tree(reader, migrant, program, operator_count) || !reader.at_end())
+			return false;
+		const auto index = replaceable[message.channel].front();
+		fitness_t fitness{};
+		score[message.channel](migrant, fitness, index);
+		if (!std::isfinite(fitness.adjusted_fitness))
+			return false;
+		auto& individual = program.get_current_pop().get_individuals()[index];
+		replaceable[message.channel].erase(replaceable[message.channel].begin());
+		individual.fitness = fitness;
+		individual.tree = std::move(migrant);
+		++accepted;
+		return true;
+	});
+	BLT_TRACE("Island {} sent its best {} individuals per channel to {} islands and accepted {} migrants", island_link->index(),
+			migrant_count, destinations.size(), accepted);
+}
+
+/**
+ * Copies the previews of the generation that just finished into the snapshot buffer, adding the alpha channel the UI uploads
+ * with. Runs between generations, when nothing writes to the previews.
+ */
+void publish_preview_snapshot()
+{
+	auto& snapshot = preview_snapshots.back();
+	const auto pixels = image_size();
+	snapshot.generation = generation;
+	snapshot.dimensions = image_dimensions();
+	snapshot.count = previews.displayed();
+	snapshot.best = get_best_image_index();
+	snapshot.pixels.resize((snapshot.count + 1) * pixels * 4);
+	for (blt::size_t index = 0; index < snapshot.count; ++index)
+	{
+		const auto in = previews.image(index);
+		const auto out = snapshot.image(index);
+		for (blt::size_t i = 0; i < pixels; ++i)
+		{
+			out[i * 4] = in[i * 3];
+			out[i * 4 + 1] = in[i * 3 + 1];
+			out[i * 4 + 2] = in[i * 3 + 2];
+			out[i * 4 + 3] = 255;
+		}
+	}
+	const auto out = snapshot.best_image();
+	for (blt::size_t i = 0; i < pixels; ++i)
+	{
+		for (blt::size_t channel = 0; channel < programs.size(); ++channel)
+			out[i * 4 + channel] = previews.best(channel)[i];
+		out[i * 4 + 3] = 255;
+	}
+	preview_snapshots.publish();
+}
+
+void run_step()
+{
+	BLT_TRACE("------------\\{Begin Generation {}}------------", programs[0]->get_current_generation());
+
+	if (const auto count = requested_previews.load(std::memory_order_relaxed); count != previews.displayed())
+		previews.resize(count, image_size());
+
+	screening_row_offset = (screening_row_offset + SCREENING_ROW_STEP) % SCREENING_ROW_STRIDE;
+	// a resumed run takes its references from the checkpoint, workers loading them from the command line may not agree
+	if (evaluation_workers)
+		evaluation_workers->set_configuration(evaluation_configuration());
+
+	std::array<phase_timings_t, 3> channel_timings;
+	if (concurrent_channels && channel_runner)
+	{
+		channel_runner->run([&channel_timings](const blt::size_t channel) {
+			channel_timings[channel] = run_channel_step(channel);
+		});
+	} else
+	{
+		for (blt::size_t channel = 0; channel < programs.size(); ++channel)
+			channel_timings[channel] = run_channel_step(channel);
+	}
+
+	const auto phase_start = std::chrono::steady_clock::now();
 	for (const auto [i, program] : blt::enumerate(programs))
 	{
 		const auto& stats = program->get_population_stats();
-		if (i == 0)
-			BLT_TRACE("Channel Red");
-		else if (i == 1)
-			BLT_TRACE("Channel Green");
-		else
-			BLT_TRACE("Channel Blue");
+		BLT_TRACE("Channel {}", channel_name(i));
 		const auto avg = stats.average_fitness.load(std::memory_order_relaxed);
 		const auto best = stats.best_fitness.load(std::memory_order_relaxed);
 		const auto worst = stats.worst_fitness.load(std::memory_order_relaxed);
 		const auto overall = stats.overall_fitness.load(std::memory_order_relaxed);
 
-		average_fitness.push_back(static_cast<float>(avg));
-		best_fitness.push_back(static_cast<float>(best));
-		worst_fitness.push_back(static_cast<float>(worst));
-		overall_fitness.push_back(static_cast<float>(overall));
+		record_history(i, history_stat_t::average, avg);
+		record_history(i, history_stat_t::best, best);
+		record_history(i, history_stat_t::worst, worst);
+		record_history(i, history_stat_t::overall, overall);
 
 		BLT_TRACE("\tAvg Fit: {:0.6f}, Best Fit: {:0.6f}, Worst Fit: {:0.6f}, Overall Fit: {:0.6f}",
 				stats.average_fitness.load(std::memory_order_relaxed), stats.best_fitness.load(std::memory_order_relaxed),
 				stats.worst_fitness.load(std::memory_order_relaxed), stats.overall_fitness.load(std::memory_order_relaxed));
 	}
 
+	// concurrent channels overlap, so only the slowest channel's time for each phase is on the critical path
+	const auto combine = [&](blt::u64 phase_timings_t::* member) {
+		blt::u64 total = 0;
+		for (const auto& timings : channel_timings)
+			total = concurrent_channels ? std::max(total, timings.*member) : total + timings.*member;
+		phase_timings.*member += total;
+	};
+	combine(&phase_timings_t::create_generation_ns);
+	combine(&phase_timings_t::next_generation_ns);
+	combine(&phase_timings_t::evaluate_fitness_ns);
+	combine(&phase_timings_t::statistics_ns);
+	phase_timings.statistics_ns += nanos_since(phase_start);
+	++phase_timings.generations;
+	++generation;
+	if (is_operator_profiling())
+		merge_operator_profile(generation);
+
+	if (checkpoint_interval != 0 && !checkpoint_path.empty() && generation % checkpoint_interval == 0)
+		save_checkpoint(checkpoint_path);
+	if (export_interval != 0 && !export_directory.empty() && generation % export_interval == 0)
+	{
+		std::string name = std::to_string(generation);
+		name.insert(0, name.size() < 6 ? 6 - name.size() : 0, '0');
+		export_best_image(export_directory + "/generation_" + name + ".png");
+	}
+	if (publish_previews)
+		publish_preview_snapshot();
+	if (island_link && migration_interval != 0 && generation % migration_interval == 0)
+		migrate_individuals();
+
 	BLT_TRACE("----------------------------------------------");
 }
 
@@ -541,20 +1042,11 @@ bool should_terminate()
 	return programs[0]->should_terminate() || programs[1]->should_terminate() || programs[2]->should_terminate();
 }
 
-std::array<image_ipixel_t, IMAGE_DIMENSIONS * IMAGE_DIMENSIONS * 3>& get_image(const blt::size_t index)
-{
-	for (const auto& [i, image_red, image_green, image_blue] : blt::zip(images_red[index], images_green[index], images_blue[index]).enumerate().
-																																	flatten())
-	{
-		images[index][i * 3] = image_red;
-		images[index][i * 3 + 1] = image_green;
-		images[index][i * 3 + 2] = image_blue;
-	}
-	return images[index];
-}
-
 void cleanup()
 {
+	wait_for_checkpoint_writes();
+	wait_for_image_exports();
+	channel_runner.reset();
 	for (const auto program : programs)
 		delete program;
 }
@@ -564,19 +1056,20 @@ const std::array<image_storage_t, 3>& get_reference_image()
 	return reference_image;
 }
 
-std::array<image_pixel_t, IMAGE_DIMENSIONS * IMAGE_DIMENSIONS * 3> to_gl_image(const std::array<image_storage_t, 3>& image)
+std::vector<image_pixel_t> to_gl_image(const std::array<image_storage_t, 3>& image)
 {
-	std::array<image_pixel_t, IMAGE_DIMENSIONS * IMAGE_DIMENSIONS * 3> image_data{};
-	for (blt::size_t x = 0; x < IMAGE_DIMENSIONS; ++x)
+	const auto dimensions = static_cast<blt::size_t>(image[0].dimensions);
+	std::vector<image_pixel_t> image_data(dimensions * dimensions * 3);
+	for (blt::size_t x = 0; x < dimensions; ++x)
 	{
-		for (blt::size_t y = 0; y < IMAGE_DIMENSIONS; ++y)
+		for (blt::size_t y = 0; y < dimensions; ++y)
 		{
-			// image_data[(x * IMAGE_DIMENSIONS + y) * 3 + 0] = std::pow(image[0].get(x, y), 1.0f / 2.2f);
-			// image_data[(x * IMAGE_DIMENSIONS + y) * 3 + 1] = std::pow(image[1].get(x, y), 1.0f / 2.2f);
-			// image_data[(x * IMAGE_DIMENSIONS + y) * 3 + 2] = std::pow(image[2].get(x, y), 1.0f / 2.2f);
-			image_data[(x * IMAGE_DIMENSIONS + y) * 3 + 0] = image[0].get(x, y);
-			image_data[(x * IMAGE_DIMENSIONS + y) * 3 + 1] = image[1].get(x, y);
-			image_data[(x * IMAGE_DIMENSIONS + y) * 3 + 2] = image[2].get(x, y);
+			// image_data[(x * dimensions + y) * 3 + 0] = std::pow(image[0].get(x, y), 1.0f / 2.2f);
+			// image_data[(x * dimensions + y) * 3 + 1] = std::pow(image[1].get(x, y), 1.0f / 2.2f);
+			// image_data[(x * dimensions + y) * 3 + 2] = std::pow(image[2].get(x, y), 1.0f / 2.2f);
+			image_data[(x * dimensions + y) * 3 + 0] = image[0].get(x, y);
+			image_data[(x * dimensions + y) * 3 + 1] = image[1].get(x, y);
+			image_data[(x * dimensions + y) * 3 + 2] = image[2].get(x, y);
 		}
 	}
 	return image_data;
@@ -584,19 +1077,11 @@ std::array<image_pixel_t, IMAGE_DIMENSIONS * IMAGE_DIMENSIONS * 3> to_gl_image(c
 
 blt::u32 get_generation()
 {
-	return programs[0]->get_current_generation();
+	return generation;
 }
 
 void set_population_size(const blt::u32 size)
 {
-	if (size > images.size())
-		images.resize(size);
-	if (size > images_red.size())
-		images_red.resize(size);
-	if (size > images_green.size())
-		images_green.resize(size);
-	if (size > images_blue.size())
-		images_blue.resize(size);
 	config.set_pop_size(size);
 	for (const auto program : programs)
 		program->set_config(config);
@@ -605,6 +1090,9 @@ void set_population_size(const blt::u32 size)
 
 void reset_programs()
 {
+	generation = 0;
+	for (auto& threshold : screening_threshold)
+		threshold = std::numeric_limits<double>::infinity();
 	for (const auto program : programs)
 		program->reset_program(program->get_typesystem().get_type<image_t>().id());
 }
@@ -620,9 +1108,11 @@ std::array<size_t, 3> get_best_image_index()
 void regenerate_image(blt::size_t index, float& image_storage, blt::i32 width, blt::i32 height)
 {}
 
-std::tuple<const std::vector<float>&, const std::vector<float>&, const std::vector<float>&, const std::vector<float>&> get_fitness_history()
+void read_fitness_history(const blt::size_t channel, const history_stat_t stat, const blt::u64 first, const blt::u64 last,
+						const blt::size_t max_points, std::vector<history_point_t>& out)
 {
-	return {average_fitness, best_fitness, worst_fitness, overall_fitness};
+	std::scoped_lock lock(fitness_history_mutex);
+	fitness_history[channel][static_cast<blt::size_t>(stat)].read(first, last, max_points, out);
 }
 
 std::array<population_t*, 3> get_populations()
@@ -630,12 +1120,342 @@ std::array<population_t*, 3> get_populations()
 	return {&programs[0]->get_current_pop(), &programs[1]->get_current_pop(), &programs[2]->get_current_pop()};
 }
 
-void set_use_gamma_correction(bool use)
+void set_use_gamma_correction(const bool use)
+{
+	use_gamma_correction = use;
+}
+
+void set_fitness_screening(const double quantile)
+{
+	screening_quantile = std::clamp(quantile, 0.0, 1.0);
+	if (screening_quantile <= 0)
+	{
+		for (auto& threshold : screening_threshold)
+			threshold = std::numeric_limits<double>::infinity();
+	}
+}
+
+screening_stats_t get_screening_stats()
+{
+	return {screened_evaluations.load(std::memory_order_relaxed), full_evaluations.load(std::memory_order_relaxed)};
+}
+
+const phase_timings_t& get_phase_timings()
+{
+	return phase_timings;
+}
+
+void set_population_generation(const bool generate)
+{
+	generate_population = generate;
+}
+
+void set_concurrent_channels(const bool concurrent)
+{
+	concurrent_channels = concurrent;
+}
+
+void set_thread_count(const blt::size_t threads)
+{
+	program_thread_count = threads;
+}
+
+void set_checkpointing(const std::string& path, const blt::u32 interval)
 {
-	use_gamma_correction = true;
+	checkpoint_path = path;
+	checkpoint_interval = interval;
+}
+
+void save_checkpoint(const std::string& path)
+{
+	static_assert(std::is_trivially_copyable_v<fitness_t>, "fitness values are stored as raw bytes");
+	static_assert(std::is_trivially_copyable_v<channel_history_t>, "fitness histories are stored as raw bytes");
+
+	checkpoint_builder_t builder;
+	checkpoint_run_state_t state{};
+	state.seed = run_seed;
+	state.generation = generation;
+	state.dimensions = image_dimensions();
+	state.population_size = programs[0]->get_current_pop().get_individuals().size();
+	state.screening_row_offset = screening_row_offset;
+	for (blt::size_t channel = 0; channel < programs.size(); ++channel)
+		state.screening_threshold[channel] = screening_threshold[channel];
+	builder.add_section(CHECKPOINT_RUN_STATE, &state, sizeof(state));
+
+	checkpoint_settings_t settings{};
+	settings.elites = config.elites;
+	settings.crossover_chance = config.crossover_chance;
+	settings.mutation_chance = config.mutation_chance;
+	settings.reproduction_chance = config.reproduction_chance;
+	settings.screening_quantile = screening_quantile;
+	settings.transcendental_table_bits = get_transcendental_tables().table_bits();
+	settings.gamma_correction = use_gamma_correction.load(std::memory_order_relaxed);
+	builder.add_section(CHECKPOINT_SETTINGS, &settings, sizeof(settings));
+
+	builder.add_section(CHECKPOINT_REFERENCE, references.pixels());
+
+	for (const auto [channel, program] : blt::enumerate(programs))
+	{
+		builder.begin_section(CHECKPOINT_POPULATION + channel);
+		for (const auto& individual : program->get_current_pop())
+			write_tree(builder, individual.tree);
+		builder.end_section();
+
+		// evaluation draws random numbers (erode, dilate, band pass), so fitness is restored rather than recomputed
+		std::vector<fitness_t> fitness;
+		for (const auto& individual : program->get_current_pop())
+			fitness.push_back(individual.fitness);
+		builder.add_section(CHECKPOINT_FITNESS + channel, fitness);
+
+		std::scoped_lock lock(fitness_history_mutex);
+		builder.add_section(CHECKPOINT_CHANNEL_HISTORY + channel, &fitness_history[channel], sizeof(channel_history_t));
+	}
+
+	write_checkpoint_async(path, builder.finish());
+}
+
+bool load_settings(const std::string& path, const checkpoint_file_t& file)
+{
+	checkpoint_settings_t settings{};
+	if (!file.read_value(CHECKPOINT_SETTINGS, settings))
+	{
+		BLT_ERROR("Checkpoint '{}' is missing its settings", path);
+		return false;
+	}
+	if (settings.elites != config.elites || settings.crossover_chance != config.crossover_chance ||
+		settings.mutation_chance != config.mutation_chance || settings.reproduction_chance != config.reproduction_chance)
+	{
+		BLT_ERROR("Checkpoint '{}' was written by a build with different evolution settings (elites {}, crossover {}, mutation {}, "
+				"reproduction {})", path, settings.elites, settings.crossover_chance, settings.mutation_chance, settings.reproduction_chance);
+		return false;
+	}
+	if (settings.transcendental_table_bits != get_transcendental_tables().table_bits())
+	{
+		BLT_ERROR("Checkpoint '{}' was written with --approx-bits {}, resume it with the same", path, settings.transcendental_table_bits);
+		return false;
+	}
+	if (settings.screening_quantile != screening_quantile)
+	{
+		BLT_ERROR("Checkpoint '{}' was written with --screening {}, resume it with the same", path, settings.screening_quantile);
+		return false;
+	}
+	if ((settings.gamma_correction != 0) != use_gamma_correction.load(std::memory_order_relaxed))
+	{
+		BLT_ERROR("Checkpoint '{}' was written {} --gamma, resume it the same way", path, settings.gamma_correction ? "with" : "without");
+		return false;
+	}
+	return true;
+}
+
+bool load_fitness_history(const checkpoint_file_t& file)
+{
+	std::scoped_lock lock(fitness_history_mutex);
+	for (blt::size_t channel = 0; channel < fitness_history.size(); ++channel)
+	{
+		if (!file.read_value(CHECKPOINT_CHANNEL_HISTORY + channel, fitness_history[channel]))
+			return false;
+	}
+	return true;
+}
+
+bool load_checkpoint(const std::string& path)
+{
+	checkpoint_file_t file;
+	if (!file.open(path))
+		return false;
+
+	checkpoint_run_state_t state{};
+	if (!file.read_value(CHECKPOINT_RUN_STATE, state))
+	{
+		BLT_ERROR("Checkpoint '{}' is missing its run state", path);
+		return false;
+	}
+	if (state.dimensions != image_dimensions())
+	{
+		BLT_ERROR("Checkpoint '{}' was written at a resolution of {}, resume it with --resolution {}", path, state.dimensions,
+				state.dimensions);
+		return false;
+	}
+	if (state.population_size != programs[0]->get_current_pop().get_individuals().size())
+	{
+		BLT_ERROR("Checkpoint '{}' has a population of {}, resume it with --population {}", path, state.population_size,
+				state.population_size);
+		return false;
+	}
+
+	if (!load_settings(path, file))
+		return false;
+
+	if (!load_fitness_history(file))
+	{
+		BLT_ERROR("Checkpoint '{}' has a corrupt fitness history", path);
+		return false;
+	}
+
+	std::vector<float> reference_pixels;
+	if (!file.read_array(CHECKPOINT_REFERENCE, reference_pixels) || reference_pixels.empty() ||
+		reference_pixels.size() % (3 * image_size()) != 0)
+	{
+		BLT_ERROR("Checkpoint '{}' has corrupt reference images", path);
+		return false;
+	}
+	const auto reference_count = reference_pixels.size() / (3 * image_size());
+	if (fitness_target >= static_cast<blt::i64>(reference_count))
+	{
+		BLT_ERROR("Fitness target {} doesn't exist, checkpoint '{}' only has {} references", fitness_target, path, reference_count);
+		return false;
+	}
+	references = reference_set_t::from_pixels(std::move(reference_pixels));
+	references_hash = references.hash();
+	reference_image = references.target_image(0);
+
+	for (const auto [channel, program] : blt::enumerate(programs))
+	{
+		auto reader = file.reader(CHECKPOINT_POPULATION + channel);
+		bool trees_read = true;
+		for (auto& individual : program->get_current_pop())
+			trees_read = trees_read && read_tree(reader, individual.tree, *program, operator_count);
+		std::vector<fitness_t> fitness;
+		if (!trees_read || !reader.at_end() || !file.read_array(CHECKPOINT_FITNESS + channel, fitness) ||
+			fitness.size() != program->get_current_pop().get_individuals().size())
+		{
+			BLT_ERROR("Checkpoint '{}' has a corrupt population for the {} channel", path, channel_name(channel));
+			return false;
+		}
+		// the ephemeral images are regenerated rather than loaded, written out again they must give back the same recipes
+		byte_writer_t rewritten;
+		for (const auto& individual : program->get_current_pop())
+			write_tree(rewritten, individual.tree);
+		if (std::string_view{rewritten.bytes.data(), rewritten.bytes.size()} != file.section(CHECKPOINT_POPULATION + channel))
+		{
+			BLT_ERROR("Checkpoint '{}': the {} channel's population didn't come back as it was saved", path, channel_name(channel));
+			return false;
+		}
+		for (const auto& [individual, value] : blt::zip(program->get_current_pop().get_individuals(), fitness))
+			individual.fitness = value;
+
+		screening_threshold[channel] = state.screening_threshold[channel];
+	}
+
+	run_seed = state.seed;
+	generation = state.generation;
+	screening_row_offset = state.screening_row_offset;
+	BLT_INFO("Resumed from checkpoint '{}' at generation {}", path, generation);
+	return true;
+}
+
+void set_image_export(const std::string& directory, const blt::u32 interval)
+{
+	export_directory = directory;
+	export_interval = interval;
+	if (!directory.empty())
+	{
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+		if (error)
+			BLT_ERROR("Unable to create export directory '{}': {}", directory, error.message());
+	}
+}
+
+void export_best_image(const std::string& path)
+{
+	// the best output of each channel in the last generation evaluated
+	const auto pixels = image_size();
+	image_export_t image{path, image_dimensions()};
+	image.pixels.resize(pixels * 3);
+	for (blt::size_t channel = 0; channel < programs.size(); ++channel)
+	{
+		const auto best = previews.best(channel);
+		for (blt::size_t i = 0; i < pixels; ++i)
+			image.pixels[i * 3 + channel] = best[i];
+	}
+	submit_image_export(std::move(image));
+}
+
+void set_island_migration(island_link_t* link, const island_topology_t topology, const blt::u32 interval, const blt::u32 migrants)
+{
+	island_link = link;
+	island_topology = topology;
+	migration_interval = interval;
+	migrant_count = migrants;
+}
+
+void set_preview_snapshots(const bool enabled)
+{
+	publish_previews = enabled;
+}
+
+void set_preview_count(const blt::size_t count)
+{
+	requested_previews = count;
+}
+
+preview_snapshot_t* acquire_preview_snapshot()
+{
+	return preview_snapshots.acquire();
+}
+
+void set_evaluation_workers(eval_worker_pool_t* pool, const bool return_images)
+{
+	evaluation_workers = pool;
+	worker_images = return_images;
+}
+
+blt::size_t evaluation_request_bytes()
+{
+	return WORKER_REQUEST_BYTES;
+}
+
+blt::size_t evaluation_response_bytes()
+{
+	return sizeof(worker_response_t) + image_size_bytes();
+}
+
+blt::u64 get_failed_evaluations()
+{
+	return failed_evaluations.load(std::memory_order_relaxed);
+}
+
+int run_evaluation_worker(const std::string& pool_name, const blt::u32 index)
+{
+	const auto worker = eval_worker_t::attach(pool_name, index);
+	if (!worker)
+		return EXIT_FAILURE;
+	// programs built for a worker have no population, each channel gets a tree to deserialise into instead
+	std::vector<tree_t> vessels;
+	for (const auto program : programs)
+		vessels.emplace_back(*program);
+	worker->serve(evaluation_configuration(), [&vessels](const std::string_view request, char* response) {
+		worker_request_t header{};
+		worker_response_t result{};
+		const auto reject = [&result, response]() {
+			// an impossible score rather than a crash, the coordinator ranks it last
+			result.fitness.raw_fitness = std::numeric_limits<float>::max();
+			result.fitness.set_normal(static_cast<float>(std::sqrt(result.fitness.raw_fitness)));
+			std::memcpy(response, &result, sizeof(result));
+		};
+		std::memcpy(&header, request.data(), std::min(sizeof(header), request.size()));
+		if (request.size() < sizeof(header) || header.channel >= programs.size())
+			return reject();
+
+		auto& tree = vessels[header.channel];
+		checkpoint_file_t::section_reader_t reader{request.substr(sizeof(header))};
+		if (!read_tree(reader, tree, *programs[header.channel], operator_count) || !reader.at_end())
+			return reject();
+		auto image = tree.get_evaluation_ref<image_t>();
+		const auto& data = image->get_data().data;
+		result.screened = score_output(header.channel, data.data(), result.fitness, header.screening_threshold,
+										header.screening_row_offset, header.gamma);
+		std::memcpy(response, &result, sizeof(result));
+		if (header.return_image)
+			std::memcpy(response + sizeof(result), data.data(), image_size_bytes());
+	});
+	cleanup();
+	return EXIT_SUCCESS;
 }
 
-std::pair<std::array<std::vector<float>, 3>&, std::array<std::vector<float>, 3>&> get_mean_and_variance()
+void set_fitness_targets(const target_aggregate_t aggregate, const blt::i64 target)
 {
-	return {mean_vec, variance_vec};
+	target_aggregate = aggregate;
+	fitness_target = target < 0 ? -1 : target;
 }
@@ -0,0 +1,446 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <headless.h>
+#include <gp_system.h>
+#include <eval_cache.h>
+#include <eval_workers.h>
+#include <fast_math.h>
+#include <image_expr.h>
+#include <image_export.h>
+#include <island.h>
+#include <operator_profile.h>
+#include <reference_cache.h>
+#include <blt/logging/logging.h>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <memory>
+#include <string_view>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// largest serialised migrant, fitness and tree, that fits in a mailbox slot
+constexpr blt::size_t MIGRANT_BYTES = 32 * 1024;
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void request_stop(int)
+{
+	stop_requested = 1;
+}
+
+void print_usage(const char* program_name)
+{
+	BLT_INFO("Usage: {} [--headless] [--population N] [--generations N] [--seed N] [--reference PATH]... [--reference-cache DIR] [--no-reference-cache] [--target-error mean|max] [--target N] [--gamma] [--threads N] [--sequential-channels] [--cache-mib N] [--resolution N] [--screening Q] [--approx-bits N] [--approx-report] [--eager-pointwise] [--checkpoint PATH] [--checkpoint-every N] [--resume PATH] [--export-dir DIR] [--export-every N] [--islands K] [--island-index I] [--island-name NAME] [--topology ring|all] [--migrate-every N] [--migrants N] [--eval-workers N] [--eval-timeout S] [--eval-no-images] [--profile-operators CSV]",
+			program_name);
+	BLT_INFO("\t--headless        run without a window and report throughput at the end");
+	BLT_INFO("\t--population N    number of individuals per channel (default 64)");
+	BLT_INFO("\t--generations N   generation limit for headless runs, 0 runs until termination (default 100)");
+	BLT_INFO("\t--seed N          random seed, 0 picks one at random (default 0)");
+	BLT_INFO("\t--reference PATH  reference image, or directory of them, to evolve towards. repeat for more (default ../silly.png)");
+	BLT_INFO("\t--reference-cache DIR keep decoded references in DIR (default $XDG_CACHE_HOME/image-gp or ~/.cache/image-gp)");
+	BLT_INFO("\t--no-reference-cache  always decode the references from their source files");
+	BLT_INFO("\t--target-error M  combine the error against several references with mean or max (default mean)");
+	BLT_INFO("\t--target N        only score against the Nth reference (default: all of them)");
+	BLT_INFO("\t--gamma           use gamma correction in the fitness function");
+	BLT_INFO("\t--threads N       worker threads per channel program, 0 uses every core (default 0)");
+	BLT_INFO("\t--sequential-channels  evolve the red, green and blue programs one after another");
+	BLT_INFO("\t--cache-mib N     memory budget of the subtree evaluation cache, 0 disables it (default 512)");
+	BLT_INFO("\t--resolution N    side length of the evolved images, a power of two from 16 to 4096 (default 256)");
+	BLT_INFO("\t--screening Q     score the best Q of each generation exactly and estimate the rest from a row subsample (default 0, off)");
+	BLT_INFO("\t--approx-bits N   log2 of the table size used by sin, cos, log, exp and sRGB operators, 0 uses libm (default 12)");
+	BLT_INFO("\t--approx-report   print the error of those tables against libm and exit");
+	BLT_INFO("\t--eager-pointwise evaluate point-wise operators one at a time instead of fusing them into compiled expressions");
+	BLT_INFO("\t--checkpoint PATH write the run's state to PATH periodically and when it ends or is interrupted");
+	BLT_INFO("\t--checkpoint-every N generations between checkpoints, 0 only writes one at the end (default 100)");
+	BLT_INFO("\t--resume PATH     continue the run saved in the checkpoint at PATH");
+	BLT_INFO("\t--export-dir DIR  write the best image of the run to DIR as a PNG when it ends");
+	BLT_INFO("\t--export-every N  also write the best image every N generations, for timelapses (default 0, off)");
+	BLT_INFO("\t--islands K       evolve K separate populations in K processes that exchange migrants (headless only, default 1)");
+	BLT_INFO("\t--island-index I  run only island I and meet the others started separately, island 0 must be started first");
+	BLT_INFO("\t--island-name N   name of the shared memory the islands meet in (default: derived from the process id)");
+	BLT_INFO("\t--topology T      ring sends migrants to the next island, all sends them to every island (default ring)");
+	BLT_INFO("\t--migrate-every N generations between migrations (default 10)");
+	BLT_INFO("\t--migrants N      best individuals of each channel sent per migration (default 2)");
+	BLT_INFO("\t--eval-workers N  evaluate fitness in N separate worker processes instead of on the programs' threads (headless only)");
+	BLT_INFO("\t--eval-timeout S  seconds before a worker stuck on one tree is killed and the tree ranked last (default 30)");
+	BLT_INFO("\t--eval-no-images  workers only return fitness, leaving exported images blank");
+	BLT_INFO("\t--profile-operators CSV  time every operator and write per-generation and total figures to CSV");
+}
+
+run_options_t parse_run_options(const int argc, const char* const* argv)
+{
+	run_options_t options;
+	options.arguments.assign(argv, argv + argc);
+
+	const auto next_value = [&](int& i) -> std::string_view {
+		if (i + 1 >= argc)
+		{
+			BLT_ERROR("Missing value for argument '{}'", argv[i]);
+			print_usage(argv[0]);
+			std::exit(EXIT_FAILURE);
+		}
+		return argv[++i];
+	};
+
+	// the default reference is replaced by the first --reference rather than added to
+	bool explicit_references = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string_view arg = argv[i];
+		if (arg == "--headless")
+			options.headless = true;
+		else if (arg == "--population")
+			options.population_size = std::stoull(std::string(next_value(i)));
+		else if (arg == "--generations")
+			options.generation_limit = static_cast<blt::u32>(std::stoul(std::string(next_value(i))));
+		else if (arg == "--seed")
+			options.seed = std::stoull(std::string(next_value(i)));
+		else if (arg == "--reference")
+		{
+			if (!explicit_references)
+				options.reference_paths.clear();
+			explicit_references = true;
+			options.reference_paths.emplace_back(next_value(i));
+		} else if (arg == "--reference-cache")
+			options.reference_cache = std::string(next_value(i));
+		else if (arg == "--no-reference-cache")
+			options.reference_cache = std::string{};
+		else if (arg == "--target-error")
+		{
+			const auto value = next_value(i);
+			if (value == "mean")
+				options.target_aggregate = target_aggregate_t::mean;
+			else if (value == "max")
+				options.target_aggregate = target_aggregate_t::max;
+			else
+			{
+				BLT_ERROR("--target-error must be mean or max, got '{}'", value);
+				std::exit(EXIT_FAILURE);
+			}
+		} else if (arg == "--target")
+			options.fitness_target = std::stoll(std::string(next_value(i)));
+		else if (arg == "--gamma")
+			options.use_gamma_correction = true;
+		else if (arg == "--threads")
+			options.threads = std::stoull(std::string(next_value(i)));
+		else if (arg == "--sequential-channels")
+			options.concurrent_channels = false;
+		else if (arg == "--cache-mib")
+			options.eval_cache_mib = std::stoull(std::string(next_value(i)));
+		else if (arg == "--resolution")
+			options.resolution = std::stoi(std::string(next_value(i)));
+		else if (arg == "--screening")
+			options.screening_quantile = std::stod(std::string(next_value(i)));
+		else if (arg == "--approx-bits")
+			options.transcendental_table_bits = static_cast<blt::u32>(std::stoul(std::string(next_value(i))));
+		else if (arg == "--approx-report")
+			options.report_approximation = true;
+		else if (arg == "--eager-pointwise")
+			options.eager_pointwise = true;
+		else if (arg == "--checkpoint")
+			options.checkpoint_path = std::string(next_value(i));
+		else if (arg == "--checkpoint-every")
+			options.checkpoint_interval = static_cast<blt::u32>(std::stoul(std::string(next_value(i))));
+		else if (arg == "--resume")
+			options.resume_path = std::string(next_value(i));
+		else if (arg == "--export-dir")
+			options.export_directory = std::string(next_value(i));
+		else if (arg == "--export-every")
+			options.export_interval = static_cast<blt::u32>(std::stoul(std::string(next_value(i))));
+		else if (arg == "--islands")
+			options.islands = static_cast<blt::u32>(std::stoul(std::string(next_value(i))));
+		else if (arg == "--island-index")
+			options.island_index = std::stoll(std::string(next_value(i)));
+		else if (arg == "--island-name")
+			options.island_name = std::string(next_value(i));
+		else if (arg == "--topology")
+		{
+			const auto value = next_value(i);
+			if (value == "ring")
+				options.island_topology = island_topology_t::ring;
+			else if (value == "all")
+				options.island_topology = island_topology_t::all;
+			else
+			{
+				BLT_ERROR("--topology must be ring or all, got '{}'", value);
+				std::exit(EXIT_FAILURE);
+			}
+		} else if (arg == "--migrate-every")
+			options.migration_interval = static_cast<blt::u32>(std::stoul(std::string(next_value(i))));
+		else if (arg == "--migrants")
+			options.migrants = static_cast<blt::u32>(std::stoul(std::string(next_value(i))));
+		else if (arg == "--eval-workers")
+			options.eval_workers = static_cast<blt::u32>(std::stoul(std::string(next_value(i))));
+		else if (arg == "--eval-timeout")
+			options.eval_timeout = std::stod(std::string(next_value(i)));
+		else if (arg == "--eval-no-images")
+			options.eval_worker_images = false;
+		else if (arg == "--profile-operators")
+			options.operator_profile_path = std::string(next_value(i));
+		else if (arg == "--eval-worker")
+		{
+			options.eval_worker_pool = std::string(next_value(i));
+			options.eval_worker_index = std::stoll(std::string(next_value(i)));
+		} else if (arg == "--help" || arg == "-h")
+		{
+			print_usage(argv[0]);
+			std::exit(EXIT_SUCCESS);
+		} else
+		{
+			BLT_ERROR("Unknown argument '{}'", arg);
+			print_usage(argv[0]);
+			std::exit(EXIT_FAILURE);
+		}
+	}
+
+	if (options.islands == 0 || (options.island_index >= 0 && options.island_index >= static_cast<blt::i64>(options.islands)))
+	{
+		BLT_ERROR("--island-index must be below --islands, which must be at least 1");
+		std::exit(EXIT_FAILURE);
+	}
+	if (options.islands > 1 && options.island_index >= 0 && options.island_name.empty())
+		options.island_name = "image-gp-islands";
+
+	return options;
+}
+
+/**
+ * Sets up this process' island. Without an explicit index the islands are forked from here, which has to happen before any
+ * thread is started. Every island but the parent returns with its own index, the parent keeps index 0 and collects the pids of
+ * the others.
+ */
+std::unique_ptr<island_link_t> join_islands(run_options_t& options, std::vector<pid_t>& children)
+{
+	if (options.island_index >= 0)
+	{
+		if (options.island_index == 0)
+			return island_link_t::create(options.island_name, options.islands, MIGRANT_BYTES);
+		return island_link_t::attach(options.island_name, static_cast<blt::u32>(options.island_index));
+	}
+
+	if (options.island_name.empty())
+		options.island_name = "image-gp-" + std::to_string(getpid());
+	auto link = island_link_t::create(options.island_name, options.islands, MIGRANT_BYTES);
+	if (!link)
+		return nullptr;
+	options.island_index = 0;
+	for (blt::u32 island = 1; island < options.islands; ++island)
+	{
+		const auto pid = fork();
+		if (pid < 0)
+		{
+			BLT_ERROR("Unable to fork island {}, continuing with {} islands", island, island);
+			break;
+		}
+		if (pid == 0)
+		{
+			link->set_index(island);
+			link->set_owner(false);
+			options.island_index = island;
+			children.clear();
+			return link;
+		}
+		children.push_back(pid);
+	}
+	return link;
+}
+
+/**
+ * Each island gets its own seed, checkpoint and export directory so islands started from the same command line don't evolve
+ * identical populations or overwrite each other's files.
+ */
+void separate_island(run_options_t& options)
+{
+	const auto index = static_cast<blt::u64>(options.island_index);
+	if (options.seed != 0)
+		options.seed += index * 0x9e3779b97f4a7c15ull;
+	const auto suffix = ".island" + std::to_string(index);
+	if (!options.checkpoint_path.empty())
+		options.checkpoint_path += suffix;
+	if (!options.resume_path.empty())
+		options.resume_path += suffix;
+	if (!options.export_directory.empty())
+		options.export_directory += "/island_" + std::to_string(index);
+	if (!options.operator_profile_path.empty())
+		options.operator_profile_path += suffix;
+}
+
+bool configure_gp_system(const run_options_t& options)
+{
+	if (!set_image_dimensions(options.resolution))
+		return false;
+	set_thread_count(options.threads);
+	set_population_generation(options.generate_population);
+	set_concurrent_channels(options.concurrent_channels);
+	set_eval_cache_budget(options.eval_cache_mib * 1024 * 1024);
+	set_fitness_screening(options.screening_quantile);
+	set_transcendental_accuracy(options.transcendental_table_bits);
+	set_lazy_evaluation(!options.eager_pointwise);
+	if (options.reference_cache)
+		set_reference_cache_directory(*options.reference_cache);
+	set_fitness_targets(options.target_aggregate, options.fitness_target);
+	if (!setup_gp_system(options.population_size, options.seed, options.reference_paths))
+		return false;
+	if (options.use_gamma_correction)
+		set_use_gamma_correction(true);
+	return true;
+}
+
+int run_eval_worker(run_options_t options)
+{
+	// the coordinator decides when to stop, an interrupt meant for it must not kill the evaluations of its last generation
+	std::signal(SIGINT, SIG_IGN);
+	std::signal(SIGTERM, SIG_IGN);
+	options.threads = 1;
+	options.concurrent_channels = false;
+	options.generate_population = false;
+	if (!configure_gp_system(options))
+		return EXIT_FAILURE;
+	return run_evaluation_worker(options.eval_worker_pool, static_cast<blt::u32>(options.eval_worker_index));
+}
+
+int run_headless(run_options_t options)
+{
+	std::unique_ptr<island_link_t> islands;
+	std::vector<pid_t> children;
+	if (options.islands > 1)
+	{
+		islands = join_islands(options, children);
+		if (!islands)
+			return EXIT_FAILURE;
+		separate_island(options);
+		BLT_INFO("Running as island {} of {}", islands->index(), islands->size());
+	}
+
+	BLT_INFO("Running headless with population {} for {} generations", options.population_size, options.generation_limit);
+	if (!configure_gp_system(options))
+		return EXIT_FAILURE;
+	std::unique_ptr<eval_worker_pool_t> workers;
+	if (options.eval_workers > 0)
+	{
+		workers = eval_worker_pool_t::start("image-gp-eval-" + std::to_string(getpid()), options.eval_workers,
+											evaluation_request_bytes(), evaluation_response_bytes(), options.arguments,
+											options.eval_timeout);
+		if (!workers)
+		{
+			cleanup();
+			return EXIT_FAILURE;
+		}
+		set_evaluation_workers(workers.get(), options.eval_worker_images);
+	}
+	if (!options.resume_path.empty() && !load_checkpoint(options.resume_path))
+	{
+		cleanup();
+		return EXIT_FAILURE;
+	}
+	set_checkpointing(options.checkpoint_path, options.checkpoint_interval);
+	set_image_export(options.export_directory, options.export_interval);
+	set_island_migration(islands.get(), options.island_topology, options.migration_interval, options.migrants);
+	if (!options.operator_profile_path.empty())
+	{
+		set_operator_profiling(true);
+		set_operator_profile_csv(options.operator_profile_path);
+	}
+	// a preempted run finishes its generation and checkpoints instead of dying mid-way
+	std::signal(SIGINT, request_stop);
+	std::signal(SIGTERM, request_stop);
+
+	const auto start = std::chrono::steady_clock::now();
+	while ((options.generation_limit == 0 || get_generation() < options.generation_limit) && !should_terminate() && !stop_requested)
+		run_step();
+	if (!options.checkpoint_path.empty())
+		save_checkpoint(options.checkpoint_path);
+	if (!options.export_directory.empty())
+		export_best_image(options.export_directory + "/final.png");
+	const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	const auto& timings = get_phase_timings();
+	const auto to_seconds = [](const blt::u64 ns) {
+		return static_cast<double>(ns) / 1e9;
+	};
+	const auto per_generation_ms = [&](const blt::u64 ns) {
+		return timings.generations == 0 ? 0.0 : static_cast<double>(ns) / 1e6 / static_cast<double>(timings.generations);
+	};
+
+	BLT_INFO("Ran {} generations in {:.3f}s ({:.3f} generations/sec)", timings.generations, seconds,
+			seconds > 0 ? static_cast<double>(timings.generations) / seconds : 0.0);
+	BLT_INFO("\tCreate generation: {:.3f}s ({:.3f}ms / generation)", to_seconds(timings.create_generation_ns),
+			per_generation_ms(timings.create_generation_ns));
+	BLT_INFO("\tNext generation:   {:.3f}s ({:.3f}ms / generation)", to_seconds(timings.next_generation_ns),
+			per_generation_ms(timings.next_generation_ns));
+	BLT_INFO("\tEvaluate fitness:  {:.3f}s ({:.3f}ms / generation)", to_seconds(timings.evaluate_fitness_ns),
+			per_generation_ms(timings.evaluate_fitness_ns));
+	BLT_INFO("\tStatistics:        {:.3f}s ({:.3f}ms / generation)", to_seconds(timings.statistics_ns),
+			per_generation_ms(timings.statistics_ns));
+
+	const auto cache = get_eval_cache_stats();
+	BLT_INFO("Evaluation cache: {} hits, {} misses, {} evictions, {} entries", cache.hits, cache.misses, cache.evictions, cache.entries);
+
+	const auto screening = get_screening_stats();
+	BLT_INFO("Fitness screening: {} estimated from the subsample, {} scored exactly", screening.screened, screening.full);
+
+	const auto expressions = get_image_expr_stats();
+	BLT_INFO("Point-wise expressions: {} evaluated, {:.2f} operators each", expressions.materialized,
+			expressions.materialized == 0 ? 0.0 : static_cast<double>(expressions.operations) / static_cast<double>(expressions.materialized));
+
+	if (!options.operator_profile_path.empty())
+	{
+		// the top of the profile, the CSV has every operator
+		const auto profile = get_operator_profile(true);
+		BLT_INFO("Operator profile over {} generations, most time first:", profile.generations);
+		for (blt::size_t i = 0; i < std::min<blt::size_t>(10, profile.operators.size()); ++i)
+		{
+			const auto& entry = profile.operators[i];
+			BLT_INFO("\t{:<22} {:>10} calls {:>10.3f}ms  p50 {:.1f}us  p99 {:.1f}us  {} images", profiled_op_name(entry.op), entry.calls,
+					static_cast<double>(entry.total_ns) / 1e6, static_cast<double>(entry.p50_ns) / 1e3,
+					static_cast<double>(entry.p99_ns) / 1e3, entry.image_acquisitions);
+		}
+		set_operator_profile_csv("");
+	}
+	if (workers)
+	{
+		const auto evaluation = workers->get_stats();
+		BLT_INFO("Evaluation workers: {} evaluations, {} crashed, {} timed out, {} workers retired", evaluation.evaluations,
+				evaluation.crashed, evaluation.timed_out, evaluation.retired);
+		set_evaluation_workers(nullptr);
+	}
+	if (islands)
+	{
+		const auto migration = islands->get_stats();
+		BLT_INFO("Island {}: {} migrants sent, {} received, {} rejected, {} dropped", islands->index(), migration.sent,
+				migration.received, migration.rejected, migration.dropped);
+	}
+
+	cleanup();
+
+	const auto exports = get_image_export_stats();
+	if (!options.export_directory.empty())
+		BLT_INFO("Image export: {} written, {} dropped, {} failed", exports.written, exports.dropped, exports.failed);
+
+	// the parent keeps the shared memory alive until every island it forked is done with it
+	int exit_code = EXIT_SUCCESS;
+	for (const auto child : children)
+	{
+		int status = 0;
+		if (waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+			exit_code = EXIT_FAILURE;
+	}
+	return exit_code;
+}
@@ -0,0 +1,158 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <image_export.h>
+#include <blt/logging/logging.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "opencv2/imgcodecs.hpp"
+
+namespace
+{
+	std::atomic_uint64_t written_count = 0;
+	std::atomic_uint64_t dropped_count = 0;
+	std::atomic_uint64_t failed_count = 0;
+
+	bool encode(const image_export_t& image)
+	{
+		// OpenCV wants BGR rows from the top, the evolved images are stored column by column with rows from the bottom
+		cv::Mat mat{image.dimensions, image.dimensions, CV_8UC3};
+		const auto size = static_cast<blt::size_t>(image.dimensions);
+		auto out = mat.ptr<blt::u8>();
+		for (blt::size_t row = 0; row < size; ++row)
+		{
+			for (blt::size_t column = 0; column < size; ++column)
+			{
+				const auto in = image.pixels.data() + (column * size + size - 1 - row) * 3;
+				const auto pixel = out + (row * size + column) * 3;
+				pixel[0] = in[2];
+				pixel[1] = in[1];
+				pixel[2] = in[0];
+			}
+		}
+		try
+		{
+			return cv::imwrite(image.path, mat);
+		} catch (const cv::Exception& e)
+		{
+			BLT_ERROR("Unable to encode '{}': {}", image.path, e.what());
+			return false;
+		}
+	}
+
+	class export_queue_t
+	{
+	public:
+		~export_queue_t()
+		{
+			{
+				std::scoped_lock lock(mutex);
+				stopping = true;
+			}
+			work_ready.notify_all();
+			if (thread.joinable())
+				thread.join();
+		}
+
+		void submit(image_export_t image)
+		{
+			{
+				std::scoped_lock lock(mutex);
+				if (queue.size() >= MAX_PENDING_EXPORTS)
+				{
+					dropped_count.fetch_add(1, std::memory_order_relaxed);
+					BLT_WARN("Image export is falling behind, dropping '{}'", image.path);
+					return;
+				}
+				queue.push_back(std::move(image));
+				if (!thread.joinable())
+					thread = std::thread([this]() {
+						worker_loop();
+					});
+			}
+			work_ready.notify_all();
+		}
+
+		void wait()
+		{
+			std::unique_lock lock(mutex);
+			work_done.wait(lock, [this]() {
+				return queue.empty() && !encoding;
+			});
+		}
+
+	private:
+		void worker_loop()
+		{
+			std::unique_lock lock(mutex);
+			while (true)
+			{
+				work_ready.wait(lock, [this]() {
+					return stopping || !queue.empty();
+				});
+				// drain what's queued before shutting down
+				if (queue.empty())
+					return;
+				auto image = std::move(queue.front());
+				queue.pop_front();
+				encoding = true;
+				lock.unlock();
+
+				if (encode(image))
+					written_count.fetch_add(1, std::memory_order_relaxed);
+				else
+				{
+					failed_count.fetch_add(1, std::memory_order_relaxed);
+					BLT_ERROR("Failed to write '{}'", image.path);
+				}
+
+				lock.lock();
+				encoding = false;
+				work_done.notify_all();
+			}
+		}
+
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable work_ready;
+		std::condition_variable work_done;
+		std::deque<image_export_t> queue;
+		bool encoding = false;
+		bool stopping = false;
+	};
+
+	export_queue_t export_queue;
+}
+
+void submit_image_export(image_export_t image)
+{
+	export_queue.submit(std::move(image));
+}
+
+void wait_for_image_exports()
+{
+	export_queue.wait();
+}
+
+image_export_stats_t get_image_export_stats()
+{
+	return {written_count.load(std::memory_order_relaxed), dropped_count.load(std::memory_order_relaxed),
+			failed_count.load(std::memory_order_relaxed)};
+}
@@ -0,0 +1,542 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <image_expr.h>
+#include <image_kernels.h>
+#include <eval_cache.h>
+#include <fast_math.h>
+#include <operator_profile.h>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+namespace
+{
+	bool lazy_evaluation = true;
+	std::atomic_uint64_t materialized_count = 0;
+	std::atomic_uint64_t operation_count = 0;
+
+	// expressions only live for the duration of one tree's evaluation, recycling them keeps their vectors' capacity around
+	struct expr_pool_t
+	{
+		~expr_pool_t()
+		{
+			for (const auto expr : free)
+				delete expr;
+		}
+
+		image_expr_t* acquire()
+		{
+			if (free.empty())
+				return new image_expr_t{};
+			const auto expr = free.back();
+			free.pop_back();
+			expr->refs = 1;
+			expr->depth = 1;
+			expr->expensive = false;
+			expr->result = nullptr;
+			return expr;
+		}
+
+		void release(image_expr_t* expr)
+		{
+			expr->program.clear();
+			expr->leaves.clear();
+			if (free.size() >= 256)
+				delete expr;
+			else
+				free.push_back(expr);
+		}
+
+		std::vector<image_expr_t*> free;
+	};
+
+	thread_local expr_pool_t expr_pool;
+	thread_local std::vector<image_ipixel_t> chunk_registers;
+
+	blt::size_t arity(const pixel_op_t op)
+	{
+		switch (op)
+		{
+			case pixel_op_t::leaf:
+				return 0;
+			case pixel_op_t::bit_not:
+			case pixel_op_t::sin:
+			case pixel_op_t::cos:
+			case pixel_op_t::log:
+			case pixel_op_t::exp:
+			case pixel_op_t::srgb:
+			case pixel_op_t::linear:
+				return 1;
+			default:
+				return 2;
+		}
+	}
+
+	bool is_expensive(const pixel_op_t op)
+	{
+		switch (op)
+		{
+			case pixel_op_t::sin:
+			case pixel_op_t::sin_off:
+			case pixel_op_t::cos:
+			case pixel_op_t::cos_off:
+			case pixel_op_t::log:
+			case pixel_op_t::exp:
+			case pixel_op_t::srgb:
+			case pixel_op_t::linear:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	void release_leaves(image_expr_t& expr)
+	{
+		for (const auto leaf : expr.leaves)
+			release_image_storage(leaf);
+		expr.leaves.clear();
+		expr.program.clear();
+	}
+
+	// operators that aren't in the kernel table, same argument order as a binary kernel plus where the chunk sits in the image
+	using pixel_step_t = void (*)(image_ipixel_t* out, const image_ipixel_t* a, const image_ipixel_t* b, blt::size_t count,
+								blt::size_t offset, blt::size_t pixels);
+
+	constexpr auto LIMIT = static_cast<double>(std::numeric_limits<blt::u32>::max());
+
+	void sin_step(image_ipixel_t* out, const image_ipixel_t* a, const image_ipixel_t*, const blt::size_t count, blt::size_t, blt::size_t)
+	{
+		const auto& math = get_transcendental_tables();
+		for (blt::size_t i = 0; i < count; ++i)
+			out[i] = wrap_to_u32(((math.sin_turns(a[i] / LIMIT * 0.5) + 1.0) / 2.0f) * LIMIT);
+	}
+
+	void sin_off_step(image_ipixel_t* out, const image_ipixel_t* a, const image_ipixel_t* b, const blt::size_t count, blt::size_t,
+					blt::size_t)
+	{
+		const auto& math = get_transcendental_tables();
+		for (blt::size_t i = 0; i < count; ++i)
+			out[i] = wrap_to_u32(((math.sin_turns(a[i] / LIMIT * 0.5 * (b[i] / (LIMIT / 4))) + 1.0) / 2.0f) * LIMIT);
+	}
+
+	void cos_step(image_ipixel_t* out, const image_ipixel_t* a, const image_ipixel_t*, const blt::size_t count, blt::size_t, blt::size_t)
+	{
+		const auto& math = get_transcendental_tables();
+		// cos(x) = sin(x + a quarter turn)
+		for (blt::size_t i = 0; i < count; ++i)
+			out[i] = wrap_to_u32(((math.sin_turns(a[i] / LIMIT + 0.25) + 1.0) / 2.0f) * LIMIT);
+	}
+
+	void cos_off_step(image_ipixel_t* out, const image_ipixel_t* a, const image_ipixel_t* b, const blt::size_t count, blt::size_t,
+					blt::size_t)
+	{
+		const auto& math = get_transcendental_tables();
+		for (blt::size_t i = 0; i < count; ++i)
+			out[i] = wrap_to_u32(((math.sin_turns(a[i] / LIMIT * 0.5 * (b[i] / (LIMIT / 2)) + 0.25) + 1.0) / 2.0f) * LIMIT);
+	}
+
+	void log_step(image_ipixel_t* out, const image_ipixel_t* a, const image_ipixel_t*, const blt::size_t count, blt::size_t, blt::size_t)
+	{
+		const auto& math = get_transcendental_tables();
+		for (blt::size_t i = 0; i < count; ++i)
+			out[i] = a[i] == 0 ? 0 : wrap_to_u32(math.log_pixel(a[i]) * LIMIT);
+	}
+
+	void exp_step(image_ipixel_t* out, const image_ipixel_t* a, const image_ipixel_t*, const blt::size_t count, blt::size_t, blt::size_t)
+	{
+		const auto& math = get_transcendental_tables();
+		for (blt::size_t i = 0; i < count; ++i)
+			out[i] = wrap_to_u32(math.exp_unit(a[i] / LIMIT) * LIMIT);
+	}
+
+	void srgb_step(image_ipixel_t* out, const image_ipixel_t* a, const image_ipixel_t*, const blt::size_t count, blt::size_t, blt::size_t)
+	{
+		const auto& math = get_transcendental_tables();
+		for (blt::size_t i = 0; i < count; ++i)
+			out[i] = wrap_to_u32(math.srgb_pixel(a[i]) * LIMIT);
+	}
+
+	void linear_step(image_ipixel_t* out, const image_ipixel_t* a, const image_ipixel_t*, const blt::size_t count, blt::size_t,
+					blt::size_t)
+	{
+		constexpr auto limit = static_cast<float>(std::numeric_limits<blt::u32>::max());
+		const auto& math = get_transcendental_tables();
+		for (blt::size_t i = 0; i < count; ++i)
+			out[i] = wrap_to_u32(math.linear_unit(static_cast<float>(a[i]) / limit) * limit);
+	}
+
+	void grad_step(image_ipixel_t* out, const image_ipixel_t* a, const image_ipixel_t* b, const blt::size_t count, const blt::size_t offset,
+					const blt::size_t pixels)
+	{
+		for (blt::size_t i = 0; i < count; ++i)
+		{
+			const auto p = static_cast<double>(offset + i) / static_cast<double>(pixels);
+			out[i] = static_cast<blt::u32>(a[i] * p + b[i] * (1 - p));
+		}
+	}
+
+	/*
+	 * One instruction of a compiled expression. Operands are slots: the leaves, then one register per stack depth, then the
+	 * output. The function is resolved when compiling so running an instruction is a single indirect call.
+	 */
+	struct fused_step_t
+	{
+		enum class kind_t : blt::u8
+		{
+			unary,
+			binary,
+			pixel
+		};
+
+		kind_t kind = kind_t::pixel;
+		blt::u8 out = 0;
+		blt::u8 a = 0;
+		blt::u8 b = 0;
+		unary_kernel_t unary = nullptr;
+		binary_kernel_t binary = nullptr;
+		pixel_step_t pixel = nullptr;
+	};
+
+	struct fused_program_t
+	{
+		std::vector<fused_step_t> steps;
+		blt::size_t leaves = 0;
+		blt::size_t registers = 0;
+		// slot the final step writes to
+		blt::u8 output = 0;
+	};
+
+	fused_step_t resolve(const pixel_op_t op)
+	{
+		const auto& kernels = get_kernels();
+		const auto binary = [](const binary_kernel_t kernel) {
+			fused_step_t step;
+			step.kind = fused_step_t::kind_t::binary;
+			step.binary = kernel;
+			return step;
+		};
+		const auto unary = [](const unary_kernel_t kernel) {
+			fused_step_t step;
+			step.kind = fused_step_t::kind_t::unary;
+			step.unary = kernel;
+			return step;
+		};
+		const auto pixel = [](const pixel_step_t func) {
+			fused_step_t step;
+			step.kind = fused_step_t::kind_t::pixel;
+			step.pixel = func;
+			return step;
+		};
+		switch (op)
+		{
+			case pixel_op_t::add:
+				return binary(kernels.add);
+			case pixel_op_t::sub:
+				return binary(kernels.sub);
+			case pixel_op_t::mul:
+				return binary(kernels.mul);
+			case pixel_op_t::div:
+				return binary(kernels.div);
+			case pixel_op_t::mod:
+				return binary(kernels.mod);
+			case pixel_op_t::bit_or:
+				return binary(kernels.bit_or);
+			case pixel_op_t::bit_and:
+				return binary(kernels.bit_and);
+			case pixel_op_t::bit_xor:
+				return binary(kernels.bit_xor);
+			case pixel_op_t::bit_not:
+				return unary(kernels.bit_not);
+			case pixel_op_t::max:
+				return binary(kernels.max);
+			case pixel_op_t::min:
+				return binary(kernels.min);
+			case pixel_op_t::sin:
+				return pixel(sin_step);
+			case pixel_op_t::sin_off:
+				return pixel(sin_off_step);
+			case pixel_op_t::cos:
+				return pixel(cos_step);
+			case pixel_op_t::cos_off:
+				return pixel(cos_off_step);
+			case pixel_op_t::log:
+				return pixel(log_step);
+			case pixel_op_t::exp:
+				return pixel(exp_step);
+			case pixel_op_t::srgb:
+				return pixel(srgb_step);
+			case pixel_op_t::linear:
+				return pixel(linear_step);
+			case pixel_op_t::grad:
+				return pixel(grad_step);
+			case pixel_op_t::leaf:
+				break;
+		}
+		// compile handles leaves itself
+		return {};
+	}
+
+	/*
+	 * Lowers the postfix program to register form. Leaves are read where they are rather than copied, the stack depth an
+	 * intermediate lives at is its register, and the last instruction writes straight into the output.
+	 */
+	void compile(const image_expr_t& expr, fused_program_t& compiled)
+	{
+		compiled.steps.clear();
+		compiled.leaves = expr.leaves.size();
+		compiled.registers = expr.depth;
+		compiled.output = static_cast<blt::u8>(compiled.leaves + compiled.registers);
+
+		blt::u8 stack[MAX_EXPR_DEPTH];
+		blt::size_t depth = 0;
+		for (blt::size_t i = 0; i < expr.program.size(); ++i)
+		{
+			const auto& instruction = expr.program[i];
+			if (instruction.op == pixel_op_t::leaf)
+			{
+				stack[depth++] = instruction.leaf;
+				continue;
+			}
+			const auto operands = arity(instruction.op);
+			auto step = resolve(instruction.op);
+			depth -= operands;
+			step.a = stack[depth];
+			step.b = operands == 2 ? stack[depth + 1] : step.a;
+			step.out = i + 1 == expr.program.size() ? compiled.output : static_cast<blt::u8>(compiled.leaves + depth);
+			stack[depth++] = step.out;
+			compiled.steps.push_back(step);
+		}
+	}
+
+	thread_local fused_program_t compiled_program;
+	thread_local std::vector<const image_ipixel_t*> slots;
+
+	// runs the compiled program one chunk at a time, small enough that every register and the chunk of each leaf stay in L1
+	void evaluate(const image_expr_t& expr, image_ipixel_t* dst, const blt::size_t pixels)
+	{
+		auto& compiled = compiled_program;
+		compile(expr, compiled);
+
+		const auto chunk = std::min(EXPR_CHUNK_PIXELS, pixels);
+		chunk_registers.resize(compiled.registers * chunk);
+		slots.resize(compiled.output + 1);
+		for (blt::size_t r = 0; r < compiled.registers; ++r)
+			slots[compiled.leaves + r] = chunk_registers.data() + r * chunk;
+
+		for (blt::size_t begin = 0; begin < pixels; begin += chunk)
+		{
+			const auto count = std::min(chunk, pixels - begin);
+			for (blt::size_t l = 0; l < compiled.leaves; ++l)
+				slots[l] = expr.leaves[l]->data.data() + begin;
+			slots[compiled.output] = dst + begin;
+
+			for (const auto& step : compiled.steps)
+			{
+				// registers and the output are the only slots ever written
+				const auto out = const_cast<image_ipixel_t*>(slots[step.out]);
+				switch (step.kind)
+				{
+					case fused_step_t::kind_t::unary:
+						step.unary(out, slots[step.a], count);
+						break;
+					case fused_step_t::kind_t::binary:
+						step.binary(out, slots[step.a], slots[step.b], count);
+						break;
+					case fused_step_t::kind_t::pixel:
+						step.pixel(out, slots[step.a], slots[step.b], count, begin, pixels);
+						break;
+				}
+			}
+		}
+	}
+
+	struct operand_shape_t
+	{
+		blt::size_t instructions = 1;
+		blt::size_t leaves = 1;
+		blt::size_t depth = 1;
+	};
+
+	operand_shape_t shape_of(const image_t& image)
+	{
+		const auto expr = image.get_expr();
+		if (expr == nullptr || expr->result != nullptr)
+			return {};
+		return {expr->program.size(), expr->leaves.size(), expr->depth};
+	}
+
+	bool is_pending(const image_t& image)
+	{
+		return image.get_expr() != nullptr && image.get_expr()->result == nullptr;
+	}
+
+	void append_operand(image_expr_t& target, const image_t& operand)
+	{
+		if (is_pending(operand))
+		{
+			const auto& source = *operand.get_expr();
+			const auto leaf_offset = target.leaves.size();
+			for (const auto leaf : source.leaves)
+			{
+				retain_image_storage(leaf);
+				target.leaves.push_back(leaf);
+			}
+			for (auto instruction : source.program)
+			{
+				if (instruction.op == pixel_op_t::leaf)
+					instruction.leaf = static_cast<blt::u8>(instruction.leaf + leaf_offset);
+				target.program.push_back(instruction);
+			}
+			return;
+		}
+		const auto buffer = operand.storage();
+		retain_image_storage(buffer);
+		target.program.push_back({pixel_op_t::leaf, static_cast<blt::u8>(target.leaves.size())});
+		target.leaves.push_back(buffer);
+	}
+
+	bool fits(const operand_shape_t& a, const operand_shape_t& b, const bool binary)
+	{
+		const auto instructions = a.instructions + (binary ? b.instructions : 0) + 1;
+		const auto leaves = a.leaves + (binary ? b.leaves : 0);
+		const auto depth = binary ? std::max(a.depth, b.depth + 1) : a.depth;
+		return instructions <= MAX_EXPR_INSTRUCTIONS && leaves <= MAX_EXPR_LEAVES && depth <= MAX_EXPR_DEPTH;
+	}
+
+	image_t build(const pixel_op_t op, const blt::u64 key, const image_t& a, const image_t* b)
+	{
+		if (is_expensive(op))
+		{
+			if (const auto shared = eval_cache_acquire(key))
+				return image_t{shared, key};
+		}
+
+		const bool binary = b != nullptr;
+		if (!fits(shape_of(a), binary ? shape_of(*b) : operand_shape_t{}, binary))
+		{
+			// evaluate the larger side on its own, then the other if that still isn't enough
+			if (binary && shape_of(*b).instructions > shape_of(a).instructions)
+				(void) b->storage();
+			else
+				(void) a.storage();
+			if (!fits(shape_of(a), binary ? shape_of(*b) : operand_shape_t{}, binary))
+			{
+				(void) a.storage();
+				if (binary)
+					(void) b->storage();
+			}
+		}
+		const auto a_shape = shape_of(a);
+		const auto b_shape = binary ? shape_of(*b) : operand_shape_t{};
+
+		// a's expression is extended in place when nothing else can see it, as its image is dropped right after this operator
+		image_expr_t* expr;
+		if (is_pending(a) && is_image_expr_exclusive(a.get_expr()))
+		{
+			expr = a.get_expr();
+			retain_image_expr(expr);
+		} else
+		{
+			expr = expr_pool.acquire();
+			append_operand(*expr, a);
+		}
+		if (binary)
+			append_operand(*expr, *b);
+		expr->program.push_back({op});
+		expr->depth = static_cast<blt::u32>(binary ? std::max(a_shape.depth, b_shape.depth + 1) : a_shape.depth);
+		// only the root's key is ever looked up, see the top of build
+		expr->expensive = is_expensive(op);
+
+		image_t result{expr, key};
+		if (!lazy_evaluation)
+			(void) result.storage();
+		return result;
+	}
+}
+
+image_t pointwise_image(const pixel_op_t op, const blt::u64 key, const image_t& a)
+{
+	return build(op, key, a, nullptr);
+}
+
+image_t pointwise_image(const pixel_op_t op, const blt::u64 key, const image_t& a, const image_t& b)
+{
+	return build(op, key, a, &b);
+}
+
+image_istorage_t* materialize_image_expr(image_expr_t* expr, const blt::u64 key)
+{
+	if (expr->result)
+		return expr->result;
+	const operator_timer_t timer{profiled_op_t::fused_expression};
+
+	// the same in-place reuse as image_t::output_for, a leaf only this expression references can hold the result
+	image_istorage_t* out = nullptr;
+	for (const auto leaf : expr->leaves)
+	{
+		if (is_image_storage_exclusive(leaf))
+		{
+			out = leaf;
+			retain_image_storage(out);
+			note_image_storage_reused();
+			break;
+		}
+	}
+	if (out == nullptr)
+		out = acquire_image_storage();
+
+	evaluate(*expr, out->data.data(), out->data.size());
+	materialized_count.fetch_add(1, std::memory_order_relaxed);
+	operation_count.fetch_add(expr->program.size() - expr->leaves.size(), std::memory_order_relaxed);
+
+	release_leaves(*expr);
+	expr->result = out;
+	if (expr->expensive && key != 0)
+		eval_cache_store(key, *out);
+	return out;
+}
+
+void retain_image_expr(image_expr_t* expr)
+{
+	++expr->refs;
+}
+
+void release_image_expr(image_expr_t* expr)
+{
+	if (--expr->refs != 0)
+		return;
+	release_leaves(*expr);
+	if (expr->result)
+		release_image_storage(expr->result);
+	expr_pool.release(expr);
+}
+
+bool is_image_expr_exclusive(const image_expr_t* expr)
+{
+	return expr->refs == 1;
+}
+
+void set_lazy_evaluation(const bool enabled)
+{
+	lazy_evaluation = enabled;
+}
+
+image_expr_stats_t get_image_expr_stats()
+{
+	return {materialized_count.load(std::memory_order_relaxed), operation_count.load(std::memory_order_relaxed)};
+}
@@ -0,0 +1,284 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <image_filters.h>
+#include <fast_math.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace
+{
+	// columns are filtered this many at a time so the vertical pass works on whole row segments and stays vectorisable
+	constexpr blt::size_t COLUMN_STRIP = 64;
+
+	struct min_op
+	{
+		static constexpr image_ipixel_t identity = std::numeric_limits<image_ipixel_t>::max();
+
+		static image_ipixel_t apply(const image_ipixel_t a, const image_ipixel_t b)
+		{
+			return std::min(a, b);
+		}
+	};
+
+	struct max_op
+	{
+		static constexpr image_ipixel_t identity = std::numeric_limits<image_ipixel_t>::min();
+
+		static image_ipixel_t apply(const image_ipixel_t a, const image_ipixel_t b)
+		{
+			return std::max(a, b);
+		}
+	};
+
+	struct filter_scratch_t
+	{
+		std::vector<image_ipixel_t> line;
+		std::vector<image_ipixel_t> forward;
+		std::vector<image_ipixel_t> backward;
+		std::vector<image_ipixel_t> first_pass;
+		std::vector<image_ipixel_t> second_pass;
+		std::vector<float> input;
+		std::vector<float> row;
+		std::vector<float> weights;
+		std::vector<float> blurred;
+		std::vector<float> low;
+		std::vector<float> high;
+	};
+
+	thread_local filter_scratch_t scratch;
+
+	/*
+	 * van Herk / Gil-Werman: the padded line is cut into blocks of size pixels, forward holds the running result from the start of
+	 * each block and backward the running result to its end. Any window of size pixels spans at most two blocks, so its result is
+	 * op(backward[start], forward[end]).
+	 */
+	template <typename Op>
+	void filter_rows(const image_ipixel_t* src, image_ipixel_t* dst, const blt::size_t dimensions, const blt::size_t size)
+	{
+		const auto before = size / 2;
+		const auto padded = dimensions + size - 1;
+		auto& line = scratch.line;
+		auto& forward = scratch.forward;
+		auto& backward = scratch.backward;
+		line.assign(padded, Op::identity);
+		forward.resize(padded);
+		backward.resize(padded);
+
+		for (blt::size_t y = 0; y < dimensions; ++y)
+		{
+			std::copy_n(src + y * dimensions, dimensions, line.begin() + static_cast<std::ptrdiff_t>(before));
+			for (blt::size_t block = 0; block < padded; block += size)
+			{
+				const auto block_end = std::min(block + size, padded);
+				forward[block] = line[block];
+				for (auto p = block + 1; p < block_end; ++p)
+					forward[p] = Op::apply(forward[p - 1], line[p]);
+				backward[block_end - 1] = line[block_end - 1];
+				for (auto p = block_end - 1; p-- > block;)
+					backward[p] = Op::apply(backward[p + 1], line[p]);
+			}
+
+			const auto out = dst + y * dimensions;
+			for (blt::size_t x = 0; x < dimensions; ++x)
+				out[x] = Op::apply(backward[x], forward[x + size - 1]);
+		}
+	}
+
+	// the same recurrence run down a strip of columns, every step is an element-wise op between two row segments
+	template <typename Op>
+	void filter_columns(const image_ipixel_t* src, image_ipixel_t* dst, const blt::size_t dimensions, const blt::size_t size)
+	{
+		const auto before = size / 2;
+		const auto padded = dimensions + size - 1;
+		auto& forward = scratch.forward;
+		auto& backward = scratch.backward;
+		forward.resize(padded * COLUMN_STRIP);
+		backward.resize(padded * COLUMN_STRIP);
+
+		for (blt::size_t strip = 0; strip < dimensions; strip += COLUMN_STRIP)
+		{
+			const auto width = std::min(COLUMN_STRIP, dimensions - strip);
+			const auto load = [&](const blt::size_t p) {
+				return p < before || p >= before + dimensions ? nullptr : src + (p - before) * dimensions + strip;
+			};
+			const auto combine = [width](image_ipixel_t* out, const image_ipixel_t* previous, const image_ipixel_t* in) {
+				if (in == nullptr)
+					std::copy_n(previous, width, out);
+				else
+					for (blt::size_t x = 0; x < width; ++x)
+						out[x] = Op::apply(previous[x], in[x]);
+			};
+			const auto start = [width](image_ipixel_t* out, const image_ipixel_t* in) {
+				if (in == nullptr)
+					std::fill_n(out, width, Op::identity);
+				else
+					std::copy_n(in, width, out);
+			};
+
+			for (blt::size_t block = 0; block < padded; block += size)
+			{
+				const auto block_end = std::min(block + size, padded);
+				start(forward.data() + block * COLUMN_STRIP, load(block));
+				for (auto p = block + 1; p < block_end; ++p)
+					combine(forward.data() + p * COLUMN_STRIP, forward.data() + (p - 1) * COLUMN_STRIP, load(p));
+				start(backward.data() + (block_end - 1) * COLUMN_STRIP, load(block_end - 1));
+				for (auto p = block_end - 1; p-- > block;)
+					combine(backward.data() + p * COLUMN_STRIP, backward.data() + (p + 1) * COLUMN_STRIP, load(p));
+			}
+
+			for (blt::size_t y = 0; y < dimensions; ++y)
+			{
+				const auto first = backward.data() + y * COLUMN_STRIP;
+				const auto last = forward.data() + (y + size - 1) * COLUMN_STRIP;
+				const auto out = dst + y * dimensions + strip;
+				for (blt::size_t x = 0; x < width; ++x)
+					out[x] = Op::apply(first[x], last[x]);
+			}
+		}
+	}
+
+	blt::size_t reflect_101(const blt::i64 index, const blt::i64 size)
+	{
+		if (index < 0)
+			return static_cast<blt::size_t>(-index);
+		if (index >= size)
+			return static_cast<blt::size_t>(2 * size - 2 - index);
+		return static_cast<blt::size_t>(index);
+	}
+
+	// same weights as cv::getGaussianKernel for a positive sigma
+	void gaussian_weights(std::vector<float>& weights, const blt::size_t kernel_size, const float sigma)
+	{
+		const auto center = static_cast<double>(kernel_size - 1) / 2.0;
+		const auto scale = -0.5 / (static_cast<double>(sigma) * sigma);
+		double sum = 0;
+		for (blt::size_t i = 0; i < kernel_size; ++i)
+		{
+			const auto x = static_cast<double>(i) - center;
+			sum += std::exp(scale * x * x);
+		}
+		weights.resize(kernel_size);
+		for (blt::size_t i = 0; i < kernel_size; ++i)
+		{
+			const auto x = static_cast<double>(i) - center;
+			weights[i] = static_cast<float>(std::exp(scale * x * x) / sum);
+		}
+	}
+
+	// separable blur, loops are ordered tap-outer / pixel-inner so the inner loop is a plain multiply-add over a row
+	void gaussian_blur(const float* src, float* dst, const blt::size_t dimensions, const blt::size_t kernel_size, const float sigma)
+	{
+		auto& weights = scratch.weights;
+		gaussian_weights(weights, kernel_size, sigma);
+		const auto radius = static_cast<blt::i64>(kernel_size / 2);
+		const auto size = static_cast<blt::i64>(dimensions);
+		auto& blurred = scratch.blurred;
+		blurred.assign(dimensions * dimensions, 0.0f);
+
+		auto& row = scratch.row;
+		row.resize(dimensions + kernel_size - 1);
+		for (blt::size_t y = 0; y < dimensions; ++y)
+		{
+			const auto in = src + y * dimensions;
+			for (blt::i64 p = 0; p < static_cast<blt::i64>(row.size()); ++p)
+				row[p] = in[reflect_101(p - radius, size)];
+			const auto out = blurred.data() + y * dimensions;
+			for (blt::size_t tap = 0; tap < kernel_size; ++tap)
+			{
+				const auto weight = weights[tap];
+				const auto shifted = row.data() + tap;
+				for (blt::size_t x = 0; x < dimensions; ++x)
+					out[x] += weight * shifted[x];
+			}
+		}
+
+		std::fill_n(dst, dimensions * dimensions, 0.0f);
+		for (blt::size_t y = 0; y < dimensions; ++y)
+		{
+			const auto out = dst + y * dimensions;
+			for (blt::size_t tap = 0; tap < kernel_size; ++tap)
+			{
+				const auto weight = weights[tap];
+				const auto in = blurred.data() + reflect_101(static_cast<blt::i64>(y + tap) - radius, size) * dimensions;
+				for (blt::size_t x = 0; x < dimensions; ++x)
+					out[x] += weight * in[x];
+			}
+		}
+	}
+}
+
+void erode_rect(const image_ipixel_t* src, image_ipixel_t* dst, const blt::i32 dimensions, const blt::i32 size)
+{
+	const auto n = static_cast<blt::size_t>(dimensions);
+	auto& rows = scratch.first_pass;
+	rows.resize(n * n);
+	filter_rows<min_op>(src, rows.data(), n, static_cast<blt::size_t>(size));
+	filter_columns<min_op>(rows.data(), dst, n, static_cast<blt::size_t>(size));
+}
+
+void dilate_cross(const image_ipixel_t* src, image_ipixel_t* dst, const blt::i32 dimensions, const blt::i32 size)
+{
+	const auto n = static_cast<blt::size_t>(dimensions);
+	auto& rows = scratch.first_pass;
+	auto& columns = scratch.second_pass;
+	rows.resize(n * n);
+	columns.resize(n * n);
+	filter_rows<max_op>(src, rows.data(), n, static_cast<blt::size_t>(size));
+	filter_columns<max_op>(src, columns.data(), n, static_cast<blt::size_t>(size));
+	for (blt::size_t i = 0; i < n * n; ++i)
+		dst[i] = std::max(rows[i], columns[i]);
+}
+
+void band_pass(const image_ipixel_t* src, image_ipixel_t* dst, const blt::i32 dimensions, const blt::i32 kernel_size, const float sigma_low,
+			const float sigma_high)
+{
+	constexpr auto limit = static_cast<float>(std::numeric_limits<blt::u32>::max());
+	const auto n = static_cast<blt::size_t>(dimensions);
+	const auto pixels = n * n;
+	auto& input = scratch.input;
+	auto& low = scratch.low;
+	auto& high = scratch.high;
+	input.resize(pixels);
+	low.resize(pixels);
+	high.resize(pixels);
+
+	for (blt::size_t i = 0; i < pixels; ++i)
+		input[i] = static_cast<float>(src[i]) / limit;
+	gaussian_blur(input.data(), low.data(), n, static_cast<blt::size_t>(kernel_size), sigma_low);
+	gaussian_blur(input.data(), high.data(), n, static_cast<blt::size_t>(kernel_size), sigma_high);
+
+	float min = std::numeric_limits<float>::max();
+	float max = std::numeric_limits<float>::lowest();
+	for (blt::size_t i = 0; i < pixels; ++i)
+	{
+		high[i] -= low[i];
+		min = std::min(min, high[i]);
+		max = std::max(max, high[i]);
+	}
+
+	// a flat difference maps to 0, as cv::normalize does
+	const auto range = static_cast<double>(max) - static_cast<double>(min);
+	const auto scale = range > std::numeric_limits<double>::epsilon() ? 1.0 / range : 0.0;
+	for (blt::size_t i = 0; i < pixels; ++i)
+	{
+		const auto normalized = static_cast<float>((static_cast<double>(high[i]) - min) * scale);
+		dst[i] = wrap_to_u32(normalized * limit);
+	}
+}
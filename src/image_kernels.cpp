@@ -0,0 +1,80 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <image_kernels.h>
+#include <blt/logging/logging.h>
+#include <cstdlib>
+#include <string_view>
+
+namespace
+{
+	bool cpu_supports(const std::string_view isa)
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_cpu_init();
+		if (isa == "sse4")
+			return __builtin_cpu_supports("sse4.1");
+		if (isa == "avx2")
+			return __builtin_cpu_supports("avx2");
+		if (isa == "avx512")
+			return __builtin_cpu_supports("avx512f");
+#endif
+		return isa == "scalar";
+	}
+
+	const kernel_table_t* make_kernels(const std::string_view isa)
+	{
+		if (!cpu_supports(isa))
+			return nullptr;
+		if (isa == "avx512")
+			return make_avx512_kernels();
+		if (isa == "avx2")
+			return make_avx2_kernels();
+		if (isa == "sse4")
+			return make_sse4_kernels();
+		return make_scalar_kernels();
+	}
+
+	const kernel_table_t& select_kernels()
+	{
+		if (const char* forced = std::getenv("IMAGE_GP_KERNELS"))
+		{
+			if (const auto table = make_kernels(forced))
+			{
+				BLT_INFO("Using forced {} image kernels", table->name);
+				return *table;
+			}
+			BLT_WARN("Requested image kernels '{}' are not available on this machine, falling back to automatic selection", forced);
+		}
+		for (const std::string_view isa : {"avx512", "avx2", "sse4"})
+		{
+			if (const auto table = make_kernels(isa))
+			{
+				BLT_INFO("Using {} image kernels", table->name);
+				return *table;
+			}
+		}
+		BLT_INFO("Using scalar image kernels");
+		return *make_scalar_kernels();
+	}
+}
+
+const kernel_table_t& get_kernels()
+{
+	static const kernel_table_t& table = select_kernels();
+	return table;
+}
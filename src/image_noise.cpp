@@ -0,0 +1,132 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <image_noise.h>
+#include <fast_math.h>
+#include <FastNoise/FastNoise.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace
+{
+	struct noise_scratch_t
+	{
+		// unscaled sample coordinates, rebuilt when the resolution changes
+		blt::i32 dimensions = 0;
+		std::vector<float> base_x;
+		std::vector<float> base_y;
+
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+		std::vector<float> noise;
+
+		void prepare(const blt::i32 size)
+		{
+			const auto pixels = static_cast<blt::size_t>(size) * static_cast<blt::size_t>(size);
+			if (dimensions != size)
+			{
+				dimensions = size;
+				base_x.resize(pixels);
+				base_y.resize(pixels);
+				const auto mask = static_cast<blt::size_t>(size - 1);
+				const auto scale = static_cast<float>(size);
+				for (blt::size_t i = 0; i < pixels; ++i)
+				{
+					base_x[i] = static_cast<float>(i & mask) / scale;
+					base_y[i] = static_cast<float>(i) / scale / scale;
+				}
+			}
+			x.resize(pixels);
+			y.resize(pixels);
+			z.resize(pixels);
+			noise.resize(pixels);
+		}
+
+		void scale_coordinates(const float scale_x, const float scale_y)
+		{
+			for (blt::size_t i = 0; i < x.size(); ++i)
+			{
+				x[i] = base_x[i] * scale_x;
+				y[i] = base_y[i] * scale_y;
+			}
+		}
+
+		void store(image_ipixel_t* dst) const
+		{
+			constexpr auto limit = static_cast<double>(std::numeric_limits<blt::u32>::max());
+			for (blt::size_t i = 0; i < noise.size(); ++i)
+				dst[i] = wrap_to_u32(noise[i] * limit);
+		}
+	};
+
+	thread_local noise_scratch_t scratch;
+
+	// generators are immutable once configured apart from the fractal's parameters, so each thread keeps its own
+	const FastNoise::SmartNode<FastNoise::Perlin>& perlin()
+	{
+		thread_local const auto node = FastNoise::New<FastNoise::Perlin>();
+		return node;
+	}
+
+	const FastNoise::SmartNode<FastNoise::FractalFBm>& fbm()
+	{
+		thread_local const auto node = [] {
+			auto fractal = FastNoise::New<FastNoise::FractalFBm>();
+			fractal->SetSource(perlin());
+			return fractal;
+		}();
+		return node;
+	}
+}
+
+void perlin_from_image(const image_ipixel_t* src, image_ipixel_t* dst, const blt::i32 dimensions, const double z_scale)
+{
+	scratch.prepare(dimensions);
+	scratch.scale_coordinates(1.0f, 1.0f);
+	for (blt::size_t i = 0; i < scratch.z.size(); ++i)
+		scratch.z[i] = static_cast<float>(src[i] * z_scale);
+	perlin()->GenPositionArray3D(scratch.noise.data(), static_cast<int>(scratch.noise.size()), scratch.x.data(), scratch.y.data(),
+								scratch.z.data(), 0, 0, 0, 0);
+	scratch.store(dst);
+}
+
+void perlin_plane(image_ipixel_t* dst, const blt::i32 dimensions, const float scale_x, const float scale_y, const float z, const blt::i32 seed)
+{
+	scratch.prepare(dimensions);
+	scratch.scale_coordinates(scale_x, scale_y);
+	std::fill(scratch.z.begin(), scratch.z.end(), z);
+	perlin()->GenPositionArray3D(scratch.noise.data(), static_cast<int>(scratch.noise.size()), scratch.x.data(), scratch.y.data(),
+								scratch.z.data(), 0, 0, 0, seed);
+	scratch.store(dst);
+}
+
+void perlin_fbm_plane(image_ipixel_t* dst, const blt::i32 dimensions, const float scale, const float z, const blt::i32 octaves, const float gain,
+					const float lacunarity)
+{
+	scratch.prepare(dimensions);
+	scratch.scale_coordinates(scale, scale);
+	std::fill(scratch.z.begin(), scratch.z.end(), z);
+	const auto& fractal = fbm();
+	fractal->SetOctaveCount(octaves);
+	fractal->SetGain(gain);
+	fractal->SetLacunarity(lacunarity);
+	fractal->GenPositionArray3D(scratch.noise.data(), static_cast<int>(scratch.noise.size()), scratch.x.data(), scratch.y.data(),
+								scratch.z.data(), 0, 0, 0, 0);
+	scratch.store(dst);
+}
@@ -0,0 +1,325 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <image_pool.h>
+#include <image_storage.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace
+{
+	constexpr blt::size_t THREAD_CACHE_LIMIT = 32;
+
+	struct image_block_t
+	{
+		struct alignas(64) header_t
+		{
+			image_block_t* next = nullptr;
+			std::atomic_uint32_t refs = 0;
+			blt::u32 owner = 0;
+			std::atomic_bool pinned = false;
+		} header;
+
+		image_istorage_t storage;
+	};
+
+	constexpr blt::size_t BLOCK_ALIGNMENT = 64;
+	// pixels follow the block, rounded up so they start on their own cache line
+	constexpr blt::size_t PIXEL_OFFSET = (sizeof(image_block_t) + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+
+	image_block_t* create_block()
+	{
+		const auto pixels = image_size_channels();
+		const auto memory = static_cast<char*>(::operator new(PIXEL_OFFSET + pixels * sizeof(image_ipixel_t),
+															  std::align_val_t{BLOCK_ALIGNMENT}));
+		const auto block = new(memory) image_block_t{};
+		block->storage.dimensions = image_dimensions();
+		block->storage.data = {reinterpret_cast<image_ipixel_t*>(memory + PIXEL_OFFSET), pixels};
+		return block;
+	}
+
+	void destroy_block(image_block_t* block)
+	{
+		block->~image_block_t();
+		::operator delete(block, std::align_val_t{BLOCK_ALIGNMENT});
+	}
+
+	image_block_t* block_of(image_istorage_t* storage)
+	{
+		return reinterpret_cast<image_block_t*>(reinterpret_cast<char*>(storage) - offsetof(image_block_t, storage));
+	}
+
+	const image_block_t* block_of(const image_istorage_t* storage)
+	{
+		return reinterpret_cast<const image_block_t*>(reinterpret_cast<const char*>(storage) - offsetof(image_block_t, storage));
+	}
+
+	/*
+	 * Treiber stack of free blocks. Pops only ever take the whole list with an exchange, which sidesteps the ABA problem a
+	 * single-node pop would have, and pushes link a whole chain in with one CAS.
+	 */
+	struct global_free_list_t
+	{
+		~global_free_list_t()
+		{
+			auto block = head.exchange(nullptr);
+			while (block)
+			{
+				const auto next = block->header.next;
+				destroy_block(block);
+				block = next;
+			}
+		}
+
+		void push_chain(image_block_t* first, image_block_t* last, const blt::size_t count)
+		{
+			auto current = head.load(std::memory_order_relaxed);
+			do
+			{
+				last->header.next = current;
+			} while (!head.compare_exchange_weak(current, first, std::memory_order_release, std::memory_order_relaxed));
+			size.fetch_add(static_cast<blt::i64>(count), std::memory_order_relaxed);
+		}
+
+		image_block_t* take_all()
+		{
+			const auto list = head.exchange(nullptr, std::memory_order_acquire);
+			if (list)
+			{
+				blt::size_t count = 0;
+				for (auto block = list; block; block = block->header.next)
+					++count;
+				size.fetch_sub(static_cast<blt::i64>(count), std::memory_order_relaxed);
+			}
+			return list;
+		}
+
+		std::atomic<image_block_t*> head = nullptr;
+		// signed since a take_all can briefly run ahead of the push that published the blocks it took
+		std::atomic_int64_t size = 0;
+	};
+
+	global_free_list_t global_free_list;
+
+	// written only by the owning thread, relaxed load + store keeps the increments free of locked instructions
+	struct thread_counters_t
+	{
+		static void bump(std::atomic_uint64_t& counter, const blt::u64 amount = 1)
+		{
+			counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+		}
+
+		std::atomic_uint64_t allocated = 0;
+		std::atomic_uint64_t deallocated = 0;
+		std::atomic_uint64_t hits = 0;
+		std::atomic_uint64_t refills = 0;
+		std::atomic_uint64_t misses = 0;
+		std::atomic_uint64_t cross_thread_returns = 0;
+		std::atomic_uint64_t reused = 0;
+		std::atomic_uint64_t cached = 0;
+	};
+
+	struct thread_cache_t;
+
+	std::mutex registry_mutex;
+	std::vector<thread_cache_t*> registered_caches;
+	// counters of threads that have already exited
+	image_pool_stats_t retired_stats;
+	std::atomic_uint32_t next_thread_id = 1;
+
+	struct alignas(64) thread_cache_t
+	{
+		thread_cache_t(): id(next_thread_id.fetch_add(1, std::memory_order_relaxed))
+		{
+			std::scoped_lock lock(registry_mutex);
+			registered_caches.push_back(this);
+		}
+
+		~thread_cache_t()
+		{
+			if (head)
+			{
+				auto last = head;
+				while (last->header.next)
+					last = last->header.next;
+				global_free_list.push_chain(head, last, count);
+			}
+			std::scoped_lock lock(registry_mutex);
+			retired_stats.allocated += counters.allocated;
+			retired_stats.deallocated += counters.deallocated;
+			retired_stats.hits += counters.hits;
+			retired_stats.refills += counters.refills;
+			retired_stats.misses += counters.misses;
+			retired_stats.cross_thread_returns += counters.cross_thread_returns;
+			retired_stats.reused += counters.reused;
+			registered_caches.erase(std::remove(registered_caches.begin(), registered_caches.end(), this), registered_caches.end());
+		}
+
+		image_block_t* pop()
+		{
+			const auto block = head;
+			head = block->header.next;
+			--count;
+			return block;
+		}
+
+		void push(image_block_t* block)
+		{
+			block->header.next = head;
+			head = block;
+			++count;
+		}
+
+		// keeps THREAD_CACHE_LIMIT / 2 blocks and hands the rest back to the global list
+		void spill()
+		{
+			auto last = head;
+			for (blt::size_t i = 1; i < THREAD_CACHE_LIMIT / 2; ++i)
+				last = last->header.next;
+			const auto first = last->header.next;
+			last->header.next = nullptr;
+
+			auto spill_last = first;
+			blt::size_t spilled = 1;
+			while (spill_last->header.next)
+			{
+				spill_last = spill_last->header.next;
+				++spilled;
+			}
+			global_free_list.push_chain(first, spill_last, spilled);
+			count -= spilled;
+		}
+
+		image_block_t* head = nullptr;
+		blt::size_t count = 0;
+		const blt::u32 id;
+		thread_counters_t counters;
+	};
+
+	thread_local thread_cache_t thread_cache;
+}
+
+image_istorage_t* acquire_image_storage()
+{
+	auto& cache = thread_cache;
+	thread_counters_t::bump(cache.counters.allocated);
+
+	image_block_t* block;
+	if (cache.head)
+	{
+		thread_counters_t::bump(cache.counters.hits);
+		block = cache.pop();
+	} else if (auto list = global_free_list.take_all())
+	{
+		thread_counters_t::bump(cache.counters.refills);
+		block = list;
+		list = list->header.next;
+		while (list)
+		{
+			const auto next = list->header.next;
+			cache.push(list);
+			list = next;
+		}
+		if (cache.count > THREAD_CACHE_LIMIT)
+			cache.spill();
+	} else
+	{
+		thread_counters_t::bump(cache.counters.misses);
+		block = create_block();
+	}
+
+	// left over from before the resolution changed
+	if (block->storage.dimensions != image_dimensions())
+	{
+		destroy_block(block);
+		block = create_block();
+	}
+
+	block->header.owner = cache.id;
+	block->header.refs.store(1, std::memory_order_relaxed);
+	block->header.pinned.store(false, std::memory_order_relaxed);
+	cache.counters.cached.store(cache.count, std::memory_order_relaxed);
+	return &block->storage;
+}
+
+void retain_image_storage(image_istorage_t* storage)
+{
+	block_of(storage)->header.refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void release_image_storage(image_istorage_t* storage)
+{
+	const auto block = block_of(storage);
+	if (block->header.refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+
+	auto& cache = thread_cache;
+	thread_counters_t::bump(cache.counters.deallocated);
+	if (block->header.owner != cache.id)
+		thread_counters_t::bump(cache.counters.cross_thread_returns);
+
+	cache.push(block);
+	if (cache.count > THREAD_CACHE_LIMIT)
+		cache.spill();
+	cache.counters.cached.store(cache.count, std::memory_order_relaxed);
+}
+
+void pin_image_storage(image_istorage_t* storage)
+{
+	block_of(storage)->header.pinned.store(true, std::memory_order_release);
+}
+
+bool is_image_storage_exclusive(const image_istorage_t* storage)
+{
+	const auto& header = block_of(storage)->header;
+	return header.refs.load(std::memory_order_acquire) == 1 && !header.pinned.load(std::memory_order_acquire);
+}
+
+void note_image_storage_reused()
+{
+	thread_counters_t::bump(thread_cache.counters.reused);
+}
+
+blt::u64 thread_image_acquisitions()
+{
+	return thread_cache.counters.allocated.load(std::memory_order_relaxed);
+}
+
+image_pool_stats_t get_image_pool_stats()
+{
+	std::scoped_lock lock(registry_mutex);
+	auto stats = retired_stats;
+	for (const auto cache : registered_caches)
+	{
+		const auto& counters = cache->counters;
+		stats.allocated += counters.allocated.load(std::memory_order_relaxed);
+		stats.deallocated += counters.deallocated.load(std::memory_order_relaxed);
+		stats.hits += counters.hits.load(std::memory_order_relaxed);
+		stats.refills += counters.refills.load(std::memory_order_relaxed);
+		stats.misses += counters.misses.load(std::memory_order_relaxed);
+		stats.cross_thread_returns += counters.cross_thread_returns.load(std::memory_order_relaxed);
+		stats.reused += counters.reused.load(std::memory_order_relaxed);
+		stats.thread_cached += counters.cached.load(std::memory_order_relaxed);
+	}
+	stats.blocks_created = stats.misses;
+	stats.global_free = static_cast<blt::u64>(std::max<blt::i64>(0, global_free_list.size.load(std::memory_order_relaxed)));
+	return stats;
+}
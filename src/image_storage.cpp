@@ -16,9 +16,12 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include <image_storage.h>
+#include <image_expr.h>
+#include <eval_cache.h>
+#include <operator_profile.h>
+#include <reference_cache.h>
 #include <stb_image.h>
 #include <stb_image_resize2.h>
-#include <blt/iterator/zip.h>
 #include <blt/math/vectors.h>
 
 inline float srgb_to_linear(const float v) noexcept
@@ -28,43 +31,88 @@ inline float srgb_to_linear(const float v) noexcept
 }
 
 
+bool set_image_dimensions(const blt::i32 dimensions)
+{
+	if (dimensions < 16 || dimensions > 4096 || (dimensions & (dimensions - 1)) != 0)
+	{
+		BLT_WARN("Image dimensions must be a power of two between 16 and 4096, got {}", dimensions);
+		return false;
+	}
+	if (dimensions == g_image_dimensions)
+		return true;
+	// cached results are keyed by structure alone, which doesn't include the size they were rendered at
+	clear_eval_cache();
+	g_image_dimensions = dimensions;
+	BLT_INFO("Image dimensions set to {}x{}", dimensions, dimensions);
+	return true;
+}
+
 std::array<image_storage_t, 3> image_storage_t::from_file(const std::string& path)
 {
 	stbi_set_flip_vertically_on_load(true);
+	const auto dimensions = image_dimensions();
+	const auto size = static_cast<blt::size_t>(dimensions);
 	int x, y, channels;
 	auto* data = stbi_load(path.c_str(), &x, &y, &channels, 4);
+	std::array<image_storage_t, 3> storage{};
+	if (data == nullptr)
+	{
+		BLT_ERROR("Unable to decode '{}': {}", path, stbi_failure_reason());
+		return storage;
+	}
 
 	unsigned char* resized = nullptr;
 
-	if (x == IMAGE_DIMENSIONS && y == IMAGE_DIMENSIONS)
+	if (x == dimensions && y == dimensions)
 	{
 		resized = data;
 		data = nullptr;
 	} else
-		resized = stbir_resize_uint8_srgb(data, x, y, 0, nullptr, IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, 0, STBIR_RGBA);
-
-	image_storage_t storage_r{};
-	image_storage_t storage_g{};
-	image_storage_t storage_b{};
+		resized = stbir_resize_uint8_srgb(data, x, y, 0, nullptr, dimensions, dimensions, 0, STBIR_RGBA);
 
-	for (blt::size_t i = 0; i < IMAGE_DIMENSIONS; ++i)
+	// the planes are stored transposed relative to the decoded rows. each row is first split into contiguous float rows, which
+	// vectorises, then written out a block of rows at a time so the transposed writes stay within a few cache lines
+	constexpr blt::size_t BLOCK = 16;
+	std::vector<float> rows(3 * BLOCK * size);
+	for (blt::size_t row_begin = 0; row_begin < size; row_begin += BLOCK)
 	{
-		for (blt::size_t j = 0; j < IMAGE_DIMENSIONS; ++j)
+		const auto block_rows = std::min(BLOCK, size - row_begin);
+		for (blt::size_t r = 0; r < block_rows; ++r)
+		{
+			const auto source = resized + (row_begin + r) * size * 4;
+			float* __restrict red = rows.data() + r * size;
+			float* __restrict green = red + BLOCK * size;
+			float* __restrict blue = green + BLOCK * size;
+			for (blt::size_t j = 0; j < size; ++j)
+			{
+				red[j] = static_cast<float>(source[j * 4]) / 255.0f;
+				green[j] = static_cast<float>(source[j * 4 + 1]) / 255.0f;
+				blue[j] = static_cast<float>(source[j * 4 + 2]) / 255.0f;
+			}
+		}
+		for (blt::size_t channel = 0; channel < 3; ++channel)
 		{
-			storage_r.get(i, j) = static_cast<float>(resized[(i * IMAGE_DIMENSIONS + j) * 4]) / 255.0f;
-			storage_g.get(i, j) = static_cast<float>(resized[(i * IMAGE_DIMENSIONS + j) * 4 + 1]) / 255.0f;
-			storage_b.get(i, j) = static_cast<float>(resized[(i * IMAGE_DIMENSIONS + j) * 4 + 2]) / 255.0f;
+			const auto plane = rows.data() + channel * BLOCK * size;
+			auto& out = storage[channel];
+			for (blt::size_t j = 0; j < size; ++j)
+			{
+				for (blt::size_t r = 0; r < block_rows; ++r)
+					out.get(row_begin + r, j) = plane[r * size + j];
+			}
 		}
 	}
 
 	stbi_image_free(data);
 	stbi_image_free(resized);
-	return {storage_r, storage_g, storage_b};
+	return storage;
 }
 
 std::array<image_storage_t, 3> image_istorage_t::from_file(const std::string& path)
 {
-	BLT_ERROR("NOT IMPLEMENTED!");
+	// decoded as floats like every reference, through the preprocessed cache
+	if (auto image = load_reference_image(path))
+		return std::move(*image);
+	return {};
 }
 
 void image_istorage_t::normalize()
@@ -91,32 +139,24 @@ void image_storage_t::normalize()
 
 image_t operator/(const image_t& lhs, const image_t& rhs)
 {
-	const image_t ret{};
-	for (auto [ref, l, r] : blt::zip(ret.data->data, lhs.data->data, rhs.data->data))
-		ref = blt::f_equal(r, 0) ? 0 : l / r;
-	return ret;
+	const operator_timer_t timer{profiled_op_t::div};
+	return pointwise_image(pixel_op_t::div, combine_keys(op_tag("div_image"), lhs.key, rhs.key), lhs, rhs);
 }
 
 image_t operator*(const image_t& lhs, const image_t& rhs)
 {
-	const image_t ret{};
-	for (auto [ref, l, r] : blt::zip(ret.data->data, lhs.data->data, rhs.data->data))
-		ref = l * r;
-	return ret;
+	const operator_timer_t timer{profiled_op_t::mul};
+	return pointwise_image(pixel_op_t::mul, combine_keys(op_tag("mul_image"), lhs.key, rhs.key), lhs, rhs);
 }
 
 image_t operator-(const image_t& lhs, const image_t& rhs)
 {
-	const image_t ret{};
-	for (auto [ref, l, r] : blt::zip(ret.data->data, lhs.data->data, rhs.data->data))
-		ref = l - r;
-	return ret;
+	const operator_timer_t timer{profiled_op_t::sub};
+	return pointwise_image(pixel_op_t::sub, combine_keys(op_tag("sub_image"), lhs.key, rhs.key), lhs, rhs);
 }
 
 image_t operator+(const image_t& lhs, const image_t& rhs)
 {
-	const image_t ret{};
-	for (auto [ref, l, r] : blt::zip(ret.data->data, lhs.data->data, rhs.data->data))
-		ref = l + r;
-	return ret;
+	const operator_timer_t timer{profiled_op_t::add};
+	return pointwise_image(pixel_op_t::add, combine_keys(op_tag("add_image"), lhs.key, rhs.key), lhs, rhs);
 }
@@ -0,0 +1,280 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <island.h>
+#include <blt/logging/logging.h>
+#include <chrono>
+#include <new>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+	constexpr blt::u32 ISLAND_MAGIC = 0x49474953;
+	constexpr blt::u32 ISLAND_VERSION = 1;
+	// messages each mailbox holds before the sender starts dropping
+	constexpr blt::u64 MAILBOX_SLOTS = 64;
+
+	struct shared_header_t
+	{
+		// written last by the creator, attaching islands wait for it
+		std::atomic<blt::u32> magic;
+		blt::u32 version;
+		blt::u32 islands;
+		blt::u32 reserved;
+		blt::u64 slot_bytes;
+		blt::u64 mailbox_bytes;
+	};
+
+	struct mailbox_header_t
+	{
+		// next slot the sender writes / the receiver reads, each on its own cache line
+		alignas(64) std::atomic<blt::u64> head;
+		alignas(64) std::atomic<blt::u64> tail;
+	};
+
+	struct slot_header_t
+	{
+		blt::u64 size;
+		blt::u32 channel;
+		blt::u32 reserved;
+	};
+
+	static_assert(std::atomic<blt::u64>::is_always_lock_free, "mailboxes rely on lock free atomics in shared memory");
+
+	constexpr blt::size_t align_up(const blt::size_t value, const blt::size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	blt::size_t slot_stride(const blt::size_t slot_bytes)
+	{
+		return align_up(sizeof(slot_header_t) + slot_bytes, 64);
+	}
+
+	blt::size_t mailbox_size(const blt::size_t slot_bytes)
+	{
+		return sizeof(mailbox_header_t) + MAILBOX_SLOTS * slot_stride(slot_bytes);
+	}
+
+	blt::size_t header_size()
+	{
+		return align_up(sizeof(shared_header_t), 64);
+	}
+
+	std::string shm_name(const std::string& name)
+	{
+		return "/" + name;
+	}
+}
+
+island_link_t::~island_link_t()
+{
+	if (mapping)
+		munmap(mapping, mapping_size);
+	if (owner)
+		shm_unlink(shm_name(name).c_str());
+}
+
+std::unique_ptr<island_link_t> island_link_t::create(const std::string& name, const blt::u32 islands, const blt::size_t slot_bytes)
+{
+	const auto path = shm_name(name);
+	// whatever is left over from a run that crashed is of no use
+	shm_unlink(path.c_str());
+	const auto fd = shm_open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0)
+	{
+		BLT_ERROR("Unable to create island shared memory '{}'", path);
+		return nullptr;
+	}
+	const auto size = header_size() + static_cast<blt::size_t>(islands) * islands * mailbox_size(slot_bytes);
+	if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+	{
+		BLT_ERROR("Unable to size island shared memory '{}' to {} bytes", path, size);
+		close(fd);
+		shm_unlink(path.c_str());
+		return nullptr;
+	}
+	const auto mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED)
+	{
+		BLT_ERROR("Unable to map island shared memory '{}'", path);
+		shm_unlink(path.c_str());
+		return nullptr;
+	}
+
+	// ftruncate zero fills, so the mailboxes already start out empty
+	auto& header = *new (mapped) shared_header_t{};
+	header.version = ISLAND_VERSION;
+	header.islands = islands;
+	header.slot_bytes = slot_bytes;
+	header.mailbox_bytes = mailbox_size(slot_bytes);
+	header.magic.store(ISLAND_MAGIC, std::memory_order_release);
+
+	std::unique_ptr<island_link_t> link{new island_link_t{}};
+	link->name = name;
+	link->mapping = mapped;
+	link->mapping_size = size;
+	link->owner = true;
+	BLT_INFO("Created {} island mailboxes in '{}' ({} bytes)", islands * islands, path, size);
+	return link;
+}
+
+std::unique_ptr<island_link_t> island_link_t::attach(const std::string& name, const blt::u32 index, const double timeout_seconds)
+{
+	const auto path = shm_name(name);
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout_seconds);
+	while (true)
+	{
+		const auto fd = shm_open(path.c_str(), O_RDWR, 0600);
+		if (fd >= 0)
+		{
+			struct stat info{};
+			if (fstat(fd, &info) == 0 && static_cast<blt::size_t>(info.st_size) >= header_size())
+			{
+				const auto size = static_cast<blt::size_t>(info.st_size);
+				const auto mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+				close(fd);
+				if (mapped != MAP_FAILED)
+				{
+					const auto& header = *static_cast<shared_header_t*>(mapped);
+					if (header.magic.load(std::memory_order_acquire) == ISLAND_MAGIC)
+					{
+						if (header.version != ISLAND_VERSION || index >= header.islands)
+						{
+							BLT_ERROR("Island shared memory '{}' is incompatible or has no island {}", path, index);
+							munmap(mapped, size);
+							return nullptr;
+						}
+						std::unique_ptr<island_link_t> link{new island_link_t{}};
+						link->name = name;
+						link->mapping = mapped;
+						link->mapping_size = size;
+						link->island = index;
+						return link;
+					}
+					munmap(mapped, size);
+				}
+			} else
+				close(fd);
+		}
+		if (std::chrono::steady_clock::now() > deadline)
+		{
+			BLT_ERROR("Timed out waiting for island 0 to create '{}'", path);
+			return nullptr;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	}
+}
+
+void island_link_t::set_index(const blt::u32 index)
+{
+	island = index;
+}
+
+void island_link_t::set_owner(const bool owner)
+{
+	this->owner = owner;
+}
+
+blt::u32 island_link_t::size() const
+{
+	return static_cast<const shared_header_t*>(mapping)->islands;
+}
+
+std::vector<blt::u32> island_link_t::destinations(const island_topology_t topology) const
+{
+	std::vector<blt::u32> result;
+	if (size() < 2)
+		return result;
+	if (topology == island_topology_t::ring)
+		result.push_back((island + 1) % size());
+	else
+	{
+		for (blt::u32 i = 0; i < size(); ++i)
+		{
+			if (i != island)
+				result.push_back(i);
+		}
+	}
+	return result;
+}
+
+namespace
+{
+	char* mailbox_of(void* mapping, const blt::u32 source, const blt::u32 destination)
+	{
+		const auto& header = *static_cast<const shared_header_t*>(mapping);
+		return static_cast<char*>(mapping) + header_size() + (static_cast<blt::size_t>(source) * header.islands + destination) * header.
+			mailbox_bytes;
+	}
+
+	char* slot_of(void* mapping, char* mailbox, const blt::u64 position)
+	{
+		const auto& header = *static_cast<const shared_header_t*>(mapping);
+		return mailbox + sizeof(mailbox_header_t) + (position % MAILBOX_SLOTS) * slot_stride(header.slot_bytes);
+	}
+}
+
+bool island_link_t::send(const blt::u32 destination, const blt::u32 channel, const std::string_view payload)
+{
+	const auto& header = *static_cast<const shared_header_t*>(mapping);
+	const auto mailbox = mailbox_of(mapping, island, destination);
+	auto& positions = *reinterpret_cast<mailbox_header_t*>(mailbox);
+	const auto head = positions.head.load(std::memory_order_relaxed);
+	if (payload.size() > header.slot_bytes || head - positions.tail.load(std::memory_order_acquire) >= MAILBOX_SLOTS)
+	{
+		++stats.dropped;
+		return false;
+	}
+	const auto slot = slot_of(mapping, mailbox, head);
+	const slot_header_t slot_header{payload.size(), channel, 0};
+	std::memcpy(slot, &slot_header, sizeof(slot_header));
+	std::memcpy(slot + sizeof(slot_header_t), payload.data(), payload.size());
+	positions.head.store(head + 1, std::memory_order_release);
+	++stats.sent;
+	return true;
+}
+
+bool island_link_t::pop(const blt::u32 source, message_t& message)
+{
+	if (source == island)
+		return false;
+	const auto mailbox = mailbox_of(mapping, source, island);
+	auto& positions = *reinterpret_cast<mailbox_header_t*>(mailbox);
+	const auto tail = positions.tail.load(std::memory_order_relaxed);
+	if (tail == positions.head.load(std::memory_order_acquire))
+		return false;
+	const auto slot = slot_of(mapping, mailbox, tail);
+	slot_header_t slot_header{};
+	std::memcpy(&slot_header, slot, sizeof(slot_header));
+	message.source = source;
+	message.channel = slot_header.channel;
+	message.payload = {slot + sizeof(slot_header_t), slot_header.size};
+	return true;
+}
+
+void island_link_t::release(const blt::u32 source)
+{
+	auto& positions = *reinterpret_cast<mailbox_header_t*>(mailbox_of(mapping, source, island));
+	positions.tail.store(positions.tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
@@ -0,0 +1,325 @@
+#pragma once
+/*
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGE_GP_KERNEL_IMPL_H
+#define IMAGE_GP_KERNEL_IMPL_H
+
+#include <image_kernels.h>
+
+/*
+ * Shared kernel bodies. Every kernel translation unit includes this header after defining its ISA traits and is compiled with
+ * the matching -m flags, so everything here must stay in an anonymous namespace to avoid the linker merging instantiations
+ * built for different instruction sets. For the same reason the kernels don't call out-of-line std:: templates, whose
+ * instantiations are shared between translation units.
+ */
+namespace
+{
+	using blt::u32;
+	using blt::size_t;
+
+	constexpr float U32_TO_UNIT = static_cast<float>(1.0 / 4294967295.0);
+	constexpr u32 LUT_SHIFT = 32 - GAMMA_LUT_BITS;
+	constexpr u32 LUT_FRACTION_MASK = (1u << LUT_SHIFT) - 1;
+	constexpr float LUT_FRACTION_SCALE = 1.0f / static_cast<float>(1u << LUT_SHIFT);
+	// errors are summed in f32 lanes for at most this many pixels before being flushed into a f64 total
+	constexpr size_t ERROR_BLOCK_SIZE = 1024;
+
+	inline size_t min_size(const size_t a, const size_t b)
+	{
+		return a < b ? a : b;
+	}
+
+	inline float lut_lookup(const float* lut, const u32 v)
+	{
+		const u32 index = v >> LUT_SHIFT;
+		const float fraction = static_cast<float>(v & LUT_FRACTION_MASK) * LUT_FRACTION_SCALE;
+		return lut[index] + (lut[index + 1] - lut[index]) * fraction;
+	}
+
+	inline double scalar_squared_error(const u32* ours, const float* theirs, const size_t begin, const size_t end)
+	{
+		double total = 0;
+		for (size_t i = begin; i < end; ++i)
+		{
+			const double diff = static_cast<double>(ours[i]) * U32_TO_UNIT - theirs[i];
+			total += diff * diff;
+		}
+		return total;
+	}
+
+	inline double scalar_squared_error_lut(const u32* ours, const float* theirs, const float* lut, const size_t begin, const size_t end)
+	{
+		double total = 0;
+		for (size_t i = begin; i < end; ++i)
+		{
+			const double diff = lut_lookup(lut, ours[i]) - theirs[i];
+			total += diff * diff;
+		}
+		return total;
+	}
+
+	/**
+	 * Drives a V::width wide error accumulation. Body is called with (accumulator, offset) for every full vector and must
+	 * return the new accumulator, the scalar tail is handled by Tail(begin, end).
+	 */
+	template <typename V, typename Body, typename Tail>
+	double blocked_error(const size_t count, Body&& body, Tail&& tail)
+	{
+		double total = 0;
+		size_t i = 0;
+		while (i + V::width <= count)
+		{
+			const size_t block_end = min_size(count, i + ERROR_BLOCK_SIZE);
+			auto acc = V::fzero();
+			for (; i + V::width <= block_end; i += V::width)
+				acc = body(acc, i);
+			total += V::fsum(acc);
+		}
+		return total + tail(i, count);
+	}
+
+	struct op_add
+	{
+		template <typename V>
+		static typename V::reg vector(const typename V::reg a, const typename V::reg b)
+		{
+			return V::add(a, b);
+		}
+
+		static u32 scalar(const u32 a, const u32 b)
+		{
+			return a + b;
+		}
+	};
+
+	struct op_sub
+	{
+		template <typename V>
+		static typename V::reg vector(const typename V::reg a, const typename V::reg b)
+		{
+			return V::sub(a, b);
+		}
+
+		static u32 scalar(const u32 a, const u32 b)
+		{
+			return a - b;
+		}
+	};
+
+	struct op_mul
+	{
+		template <typename V>
+		static typename V::reg vector(const typename V::reg a, const typename V::reg b)
+		{
+			return V::mul(a, b);
+		}
+
+		static u32 scalar(const u32 a, const u32 b)
+		{
+			return a * b;
+		}
+	};
+
+	struct op_div
+	{
+		template <typename V>
+		static typename V::reg vector(const typename V::reg a, const typename V::reg b)
+		{
+			return V::div(a, b);
+		}
+
+		static u32 scalar(const u32 a, const u32 b)
+		{
+			return b == 0 ? 0 : a / b;
+		}
+	};
+
+	struct op_mod
+	{
+		template <typename V>
+		static typename V::reg vector(const typename V::reg a, const typename V::reg b)
+		{
+			return V::mod(a, b);
+		}
+
+		static u32 scalar(const u32 a, const u32 b)
+		{
+			return b == 0 ? 0 : a % b;
+		}
+	};
+
+	struct op_or
+	{
+		template <typename V>
+		static typename V::reg vector(const typename V::reg a, const typename V::reg b)
+		{
+			return V::bit_or(a, b);
+		}
+
+		static u32 scalar(const u32 a, const u32 b)
+		{
+			return a | b;
+		}
+	};
+
+	struct op_and
+	{
+		template <typename V>
+		static typename V::reg vector(const typename V::reg a, const typename V::reg b)
+		{
+			return V::bit_and(a, b);
+		}
+
+		static u32 scalar(const u32 a, const u32 b)
+		{
+			return a & b;
+		}
+	};
+
+	struct op_xor
+	{
+		template <typename V>
+		static typename V::reg vector(const typename V::reg a, const typename V::reg b)
+		{
+			return V::bit_xor(a, b);
+		}
+
+		static u32 scalar(const u32 a, const u32 b)
+		{
+			return a ^ b;
+		}
+	};
+
+	struct op_max
+	{
+		template <typename V>
+		static typename V::reg vector(const typename V::reg a, const typename V::reg b)
+		{
+			return V::max(a, b);
+		}
+
+		static u32 scalar(const u32 a, const u32 b)
+		{
+			return a > b ? a : b;
+		}
+	};
+
+	struct op_min
+	{
+		template <typename V>
+		static typename V::reg vector(const typename V::reg a, const typename V::reg b)
+		{
+			return V::min(a, b);
+		}
+
+		static u32 scalar(const u32 a, const u32 b)
+		{
+			return a < b ? a : b;
+		}
+	};
+
+	struct op_not
+	{
+		template <typename V>
+		static typename V::reg vector(const typename V::reg a)
+		{
+			return V::bit_not(a);
+		}
+
+		static u32 scalar(const u32 a)
+		{
+			return ~a;
+		}
+	};
+
+	template <typename V, typename Op>
+	void binary_kernel(u32* out, const u32* a, const u32* b, const size_t count)
+	{
+		size_t i = 0;
+		for (; i + V::width * 2 <= count; i += V::width * 2)
+		{
+			const auto r0 = Op::template vector<V>(V::load(a + i), V::load(b + i));
+			const auto r1 = Op::template vector<V>(V::load(a + i + V::width), V::load(b + i + V::width));
+			V::store(out + i, r0);
+			V::store(out + i + V::width, r1);
+		}
+		for (; i < count; ++i)
+			out[i] = Op::scalar(a[i], b[i]);
+	}
+
+	template <typename V, typename Op>
+	void unary_kernel(u32* out, const u32* a, const size_t count)
+	{
+		size_t i = 0;
+		for (; i + V::width * 2 <= count; i += V::width * 2)
+		{
+			const auto r0 = Op::template vector<V>(V::load(a + i));
+			const auto r1 = Op::template vector<V>(V::load(a + i + V::width));
+			V::store(out + i, r0);
+			V::store(out + i + V::width, r1);
+		}
+		for (; i < count; ++i)
+			out[i] = Op::scalar(a[i]);
+	}
+
+	template <typename V>
+	double squared_error_kernel(const u32* ours, const float* theirs, const size_t count)
+	{
+		return blocked_error<V>(count, [&](const auto acc, const size_t i) {
+			const auto diff = V::fsub(V::to_unit(V::load(ours + i)), V::fload(theirs + i));
+			return V::fmadd(diff, diff, acc);
+		}, [&](const size_t begin, const size_t end) {
+			return scalar_squared_error(ours, theirs, begin, end);
+		});
+	}
+
+	template <typename V>
+	double squared_error_lut_kernel(const u32* ours, const float* theirs, const float* lut, const size_t count)
+	{
+		return blocked_error<V>(count, [&](const auto acc, const size_t i) {
+			const auto diff = V::fsub(V::lut(lut, V::load(ours + i)), V::fload(theirs + i));
+			return V::fmadd(diff, diff, acc);
+		}, [&](const size_t begin, const size_t end) {
+			return scalar_squared_error_lut(ours, theirs, lut, begin, end);
+		});
+	}
+
+	template <typename V>
+	const kernel_table_t* make_kernel_table(const char* name)
+	{
+		static const kernel_table_t table{
+			name,
+			binary_kernel<V, op_add>,
+			binary_kernel<V, op_sub>,
+			binary_kernel<V, op_mul>,
+			binary_kernel<V, op_div>,
+			binary_kernel<V, op_mod>,
+			binary_kernel<V, op_or>,
+			binary_kernel<V, op_and>,
+			binary_kernel<V, op_xor>,
+			binary_kernel<V, op_max>,
+			binary_kernel<V, op_min>,
+			unary_kernel<V, op_not>,
+			squared_error_kernel<V>,
+			squared_error_lut_kernel<V>
+		};
+		return &table;
+	}
+}
+
+#endif //IMAGE_GP_KERNEL_IMPL_H
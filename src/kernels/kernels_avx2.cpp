@@ -0,0 +1,171 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "kernel_impl.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+namespace
+{
+	struct avx2_isa_t
+	{
+		using reg = __m256i;
+		using freg = __m256;
+		static constexpr size_t width = 8;
+
+		static reg load(const u32* p)
+		{
+			return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+		}
+
+		static void store(u32* p, const reg v)
+		{
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+		}
+
+		static reg add(const reg a, const reg b)
+		{
+			return _mm256_add_epi32(a, b);
+		}
+
+		static reg sub(const reg a, const reg b)
+		{
+			return _mm256_sub_epi32(a, b);
+		}
+
+		static reg mul(const reg a, const reg b)
+		{
+			return _mm256_mullo_epi32(a, b);
+		}
+
+		// see sse4_isa_t::to_double for why the f64 route is exact
+		static __m256d to_double(const __m128i v)
+		{
+			const auto bias = _mm_set1_epi32(static_cast<int>(0x80000000u));
+			return _mm256_add_pd(_mm256_cvtepi32_pd(_mm_xor_si128(v, bias)), _mm256_set1_pd(2147483648.0));
+		}
+
+		static __m128i from_double(const __m256d v)
+		{
+			const auto bias = _mm_set1_epi32(static_cast<int>(0x80000000u));
+			const auto floored = _mm256_sub_pd(_mm256_floor_pd(v), _mm256_set1_pd(2147483648.0));
+			return _mm_xor_si128(_mm256_cvttpd_epi32(floored), bias);
+		}
+
+		static reg div(const reg a, const reg b)
+		{
+			const auto lo = _mm256_div_pd(to_double(_mm256_castsi256_si128(a)), to_double(_mm256_castsi256_si128(b)));
+			const auto hi = _mm256_div_pd(to_double(_mm256_extracti128_si256(a, 1)), to_double(_mm256_extracti128_si256(b, 1)));
+			const auto result = _mm256_inserti128_si256(_mm256_castsi128_si256(from_double(lo)), from_double(hi), 1);
+			const auto zero = _mm256_cmpeq_epi32(b, _mm256_setzero_si256());
+			return _mm256_andnot_si256(zero, result);
+		}
+
+		static reg mod(const reg a, const reg b)
+		{
+			const auto zero = _mm256_cmpeq_epi32(b, _mm256_setzero_si256());
+			return _mm256_andnot_si256(zero, _mm256_sub_epi32(a, _mm256_mullo_epi32(div(a, b), b)));
+		}
+
+		static reg bit_or(const reg a, const reg b)
+		{
+			return _mm256_or_si256(a, b);
+		}
+
+		static reg bit_and(const reg a, const reg b)
+		{
+			return _mm256_and_si256(a, b);
+		}
+
+		static reg bit_xor(const reg a, const reg b)
+		{
+			return _mm256_xor_si256(a, b);
+		}
+
+		static reg max(const reg a, const reg b)
+		{
+			return _mm256_max_epu32(a, b);
+		}
+
+		static reg min(const reg a, const reg b)
+		{
+			return _mm256_min_epu32(a, b);
+		}
+
+		static reg bit_not(const reg a)
+		{
+			return _mm256_xor_si256(a, _mm256_set1_epi32(-1));
+		}
+
+		static freg fzero()
+		{
+			return _mm256_setzero_ps();
+		}
+
+		static double fsum(const freg v)
+		{
+			const auto quad = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+			const auto pairs = _mm_add_ps(quad, _mm_movehl_ps(quad, quad));
+			return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+		}
+
+		static freg fload(const float* p)
+		{
+			return _mm256_loadu_ps(p);
+		}
+
+		static freg fsub(const freg a, const freg b)
+		{
+			return _mm256_sub_ps(a, b);
+		}
+
+		static freg fmadd(const freg a, const freg b, const freg c)
+		{
+			return _mm256_fmadd_ps(a, b, c);
+		}
+
+		// see sse4_isa_t::to_unit
+		static freg to_unit(const reg v)
+		{
+			const auto high = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(v, 16)), _mm256_set1_ps(65536.0f));
+			const auto low = _mm256_cvtepi32_ps(_mm256_and_si256(v, _mm256_set1_epi32(0xFFFF)));
+			return _mm256_mul_ps(_mm256_add_ps(high, low), _mm256_set1_ps(U32_TO_UNIT));
+		}
+
+		static freg lut(const float* table, const reg v)
+		{
+			const auto index = _mm256_srli_epi32(v, LUT_SHIFT);
+			const auto fraction = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(v, _mm256_set1_epi32(LUT_FRACTION_MASK))),
+												_mm256_set1_ps(LUT_FRACTION_SCALE));
+			const auto low = _mm256_i32gather_ps(table, index, 4);
+			const auto high = _mm256_i32gather_ps(table + 1, index, 4);
+			return _mm256_fmadd_ps(_mm256_sub_ps(high, low), fraction, low);
+		}
+	};
+}
+
+const kernel_table_t* make_avx2_kernels()
+{
+	return make_kernel_table<avx2_isa_t>("avx2");
+}
+#else
+const kernel_table_t* make_avx2_kernels()
+{
+	return nullptr;
+}
+#endif
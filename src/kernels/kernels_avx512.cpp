@@ -0,0 +1,153 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "kernel_impl.h"
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+
+namespace
+{
+	struct avx512_isa_t
+	{
+		using reg = __m512i;
+		using freg = __m512;
+		static constexpr size_t width = 16;
+
+		static reg load(const u32* p)
+		{
+			return _mm512_loadu_si512(p);
+		}
+
+		static void store(u32* p, const reg v)
+		{
+			_mm512_storeu_si512(p, v);
+		}
+
+		static reg add(const reg a, const reg b)
+		{
+			return _mm512_add_epi32(a, b);
+		}
+
+		static reg sub(const reg a, const reg b)
+		{
+			return _mm512_sub_epi32(a, b);
+		}
+
+		static reg mul(const reg a, const reg b)
+		{
+			return _mm512_mullo_epi32(a, b);
+		}
+
+		// see sse4_isa_t::to_double for why the f64 route is exact. AVX-512 has native unsigned conversions and truncation
+		// of a non-negative quotient is the floor.
+		static reg div(const reg a, const reg b)
+		{
+			const auto lo = _mm512_div_pd(_mm512_cvtepu32_pd(_mm512_castsi512_si256(a)), _mm512_cvtepu32_pd(_mm512_castsi512_si256(b)));
+			const auto hi = _mm512_div_pd(_mm512_cvtepu32_pd(_mm512_extracti64x4_epi64(a, 1)),
+										_mm512_cvtepu32_pd(_mm512_extracti64x4_epi64(b, 1)));
+			const auto result = _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvttpd_epu32(lo)), _mm512_cvttpd_epu32(hi), 1);
+			return _mm512_maskz_mov_epi32(_mm512_test_epi32_mask(b, b), result);
+		}
+
+		static reg mod(const reg a, const reg b)
+		{
+			return _mm512_maskz_mov_epi32(_mm512_test_epi32_mask(b, b), _mm512_sub_epi32(a, _mm512_mullo_epi32(div(a, b), b)));
+		}
+
+		static reg bit_or(const reg a, const reg b)
+		{
+			return _mm512_or_si512(a, b);
+		}
+
+		static reg bit_and(const reg a, const reg b)
+		{
+			return _mm512_and_si512(a, b);
+		}
+
+		static reg bit_xor(const reg a, const reg b)
+		{
+			return _mm512_xor_si512(a, b);
+		}
+
+		static reg max(const reg a, const reg b)
+		{
+			return _mm512_max_epu32(a, b);
+		}
+
+		static reg min(const reg a, const reg b)
+		{
+			return _mm512_min_epu32(a, b);
+		}
+
+		static reg bit_not(const reg a)
+		{
+			return _mm512_ternarylogic_epi32(a, a, a, 0x55);
+		}
+
+		static freg fzero()
+		{
+			return _mm512_setzero_ps();
+		}
+
+		static double fsum(const freg v)
+		{
+			return _mm512_reduce_add_ps(v);
+		}
+
+		static freg fload(const float* p)
+		{
+			return _mm512_loadu_ps(p);
+		}
+
+		static freg fsub(const freg a, const freg b)
+		{
+			return _mm512_sub_ps(a, b);
+		}
+
+		static freg fmadd(const freg a, const freg b, const freg c)
+		{
+			return _mm512_fmadd_ps(a, b, c);
+		}
+
+		static freg to_unit(const reg v)
+		{
+			return _mm512_mul_ps(_mm512_cvtepu32_ps(v), _mm512_set1_ps(U32_TO_UNIT));
+		}
+
+		static freg lut(const float* table, const reg v)
+		{
+			const auto index = _mm512_srli_epi32(v, LUT_SHIFT);
+			const auto fraction = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_and_si512(v, _mm512_set1_epi32(LUT_FRACTION_MASK))),
+												_mm512_set1_ps(LUT_FRACTION_SCALE));
+			const auto low = _mm512_i32gather_ps(index, table, 4);
+			const auto high = _mm512_i32gather_ps(index, table + 1, 4);
+			return _mm512_fmadd_ps(_mm512_sub_ps(high, low), fraction, low);
+		}
+	};
+}
+
+const kernel_table_t* make_avx512_kernels()
+{
+	return make_kernel_table<avx512_isa_t>("avx512");
+}
+#else
+const kernel_table_t* make_avx512_kernels()
+{
+	return nullptr;
+}
+#endif
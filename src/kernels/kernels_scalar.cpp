@@ -0,0 +1,133 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "kernel_impl.h"
+
+namespace
+{
+	struct scalar_isa_t
+	{
+		using reg = u32;
+		using freg = float;
+		static constexpr size_t width = 1;
+
+		static reg load(const u32* p)
+		{
+			return *p;
+		}
+
+		static void store(u32* p, const reg v)
+		{
+			*p = v;
+		}
+
+		static reg add(const reg a, const reg b)
+		{
+			return a + b;
+		}
+
+		static reg sub(const reg a, const reg b)
+		{
+			return a - b;
+		}
+
+		static reg mul(const reg a, const reg b)
+		{
+			return a * b;
+		}
+
+		static reg div(const reg a, const reg b)
+		{
+			return b == 0 ? 0 : a / b;
+		}
+
+		static reg mod(const reg a, const reg b)
+		{
+			return b == 0 ? 0 : a % b;
+		}
+
+		static reg bit_or(const reg a, const reg b)
+		{
+			return a | b;
+		}
+
+		static reg bit_and(const reg a, const reg b)
+		{
+			return a & b;
+		}
+
+		static reg bit_xor(const reg a, const reg b)
+		{
+			return a ^ b;
+		}
+
+		static reg max(const reg a, const reg b)
+		{
+			return a > b ? a : b;
+		}
+
+		static reg min(const reg a, const reg b)
+		{
+			return a < b ? a : b;
+		}
+
+		static reg bit_not(const reg a)
+		{
+			return ~a;
+		}
+
+		static freg fzero()
+		{
+			return 0;
+		}
+
+		static double fsum(const freg v)
+		{
+			return v;
+		}
+
+		static freg fload(const float* p)
+		{
+			return *p;
+		}
+
+		static freg fsub(const freg a, const freg b)
+		{
+			return a - b;
+		}
+
+		static freg fmadd(const freg a, const freg b, const freg c)
+		{
+			return a * b + c;
+		}
+
+		static freg to_unit(const reg v)
+		{
+			return static_cast<float>(v) * U32_TO_UNIT;
+		}
+
+		static freg lut(const float* table, const reg v)
+		{
+			return lut_lookup(table, v);
+		}
+	};
+}
+
+const kernel_table_t* make_scalar_kernels()
+{
+	return make_kernel_table<scalar_isa_t>("scalar");
+}
@@ -0,0 +1,171 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "kernel_impl.h"
+
+#if defined(__SSE4_1__)
+#include <immintrin.h>
+
+namespace
+{
+	struct sse4_isa_t
+	{
+		using reg = __m128i;
+		using freg = __m128;
+		static constexpr size_t width = 4;
+
+		static reg load(const u32* p)
+		{
+			return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		}
+
+		static void store(u32* p, const reg v)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+		}
+
+		static reg add(const reg a, const reg b)
+		{
+			return _mm_add_epi32(a, b);
+		}
+
+		static reg sub(const reg a, const reg b)
+		{
+			return _mm_sub_epi32(a, b);
+		}
+
+		static reg mul(const reg a, const reg b)
+		{
+			return _mm_mullo_epi32(a, b);
+		}
+
+		// u32 -> f64 is exact, and the rounding error of a f64 quotient of two u32s is always smaller than the distance to the
+		// next integer, so flooring the f64 quotient gives the exact integer quotient.
+		static __m128d to_double(const __m128i v)
+		{
+			const auto bias = _mm_set1_epi32(static_cast<int>(0x80000000u));
+			return _mm_add_pd(_mm_cvtepi32_pd(_mm_xor_si128(v, bias)), _mm_set1_pd(2147483648.0));
+		}
+
+		static __m128i from_double(const __m128d lo, const __m128d hi)
+		{
+			const auto offset = _mm_set1_pd(2147483648.0);
+			const auto bias = _mm_set1_epi32(static_cast<int>(0x80000000u));
+			const auto l = _mm_cvttpd_epi32(_mm_sub_pd(_mm_floor_pd(lo), offset));
+			const auto h = _mm_cvttpd_epi32(_mm_sub_pd(_mm_floor_pd(hi), offset));
+			return _mm_xor_si128(_mm_unpacklo_epi64(l, h), bias);
+		}
+
+		static reg div(const reg a, const reg b)
+		{
+			const auto lo = _mm_div_pd(to_double(a), to_double(b));
+			const auto hi = _mm_div_pd(to_double(_mm_unpackhi_epi64(a, a)), to_double(_mm_unpackhi_epi64(b, b)));
+			const auto zero = _mm_cmpeq_epi32(b, _mm_setzero_si128());
+			return _mm_andnot_si128(zero, from_double(lo, hi));
+		}
+
+		static reg mod(const reg a, const reg b)
+		{
+			const auto zero = _mm_cmpeq_epi32(b, _mm_setzero_si128());
+			return _mm_andnot_si128(zero, _mm_sub_epi32(a, _mm_mullo_epi32(div(a, b), b)));
+		}
+
+		static reg bit_or(const reg a, const reg b)
+		{
+			return _mm_or_si128(a, b);
+		}
+
+		static reg bit_and(const reg a, const reg b)
+		{
+			return _mm_and_si128(a, b);
+		}
+
+		static reg bit_xor(const reg a, const reg b)
+		{
+			return _mm_xor_si128(a, b);
+		}
+
+		static reg max(const reg a, const reg b)
+		{
+			return _mm_max_epu32(a, b);
+		}
+
+		static reg min(const reg a, const reg b)
+		{
+			return _mm_min_epu32(a, b);
+		}
+
+		static reg bit_not(const reg a)
+		{
+			return _mm_xor_si128(a, _mm_set1_epi32(-1));
+		}
+
+		static freg fzero()
+		{
+			return _mm_setzero_ps();
+		}
+
+		static double fsum(const freg v)
+		{
+			const auto pairs = _mm_add_ps(v, _mm_movehl_ps(v, v));
+			return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+		}
+
+		static freg fload(const float* p)
+		{
+			return _mm_loadu_ps(p);
+		}
+
+		static freg fsub(const freg a, const freg b)
+		{
+			return _mm_sub_ps(a, b);
+		}
+
+		static freg fmadd(const freg a, const freg b, const freg c)
+		{
+			return _mm_add_ps(_mm_mul_ps(a, b), c);
+		}
+
+		// there is no unsigned conversion before AVX-512, so convert each 16 bit half separately
+		static freg to_unit(const reg v)
+		{
+			const auto high = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(v, 16)), _mm_set1_ps(65536.0f));
+			const auto low = _mm_cvtepi32_ps(_mm_and_si128(v, _mm_set1_epi32(0xFFFF)));
+			return _mm_mul_ps(_mm_add_ps(high, low), _mm_set1_ps(U32_TO_UNIT));
+		}
+
+		// no gather instruction here, the table lookups are done one lane at a time
+		static freg lut(const float* table, const reg v)
+		{
+			return _mm_setr_ps(lut_lookup(table, static_cast<u32>(_mm_extract_epi32(v, 0))),
+								lut_lookup(table, static_cast<u32>(_mm_extract_epi32(v, 1))),
+								lut_lookup(table, static_cast<u32>(_mm_extract_epi32(v, 2))),
+								lut_lookup(table, static_cast<u32>(_mm_extract_epi32(v, 3))));
+		}
+	};
+}
+
+const kernel_table_t* make_sse4_kernels()
+{
+	return make_kernel_table<sse4_isa_t>("sse4");
+}
+#else
+const kernel_table_t* make_sse4_kernels()
+{
+	return nullptr;
+}
+#endif
@@ -1,4 +1,9 @@
 #include <gp_system.h>
+#include <headless.h>
+#include <eval_cache.h>
+#include <fast_math.h>
+#include <image_expr.h>
+#include <operator_profile.h>
 
 #include <blt/gfx/window.h>
 #include "blt/gfx/renderer/resource_manager.h"
@@ -6,6 +11,7 @@
 #include "blt/gfx/renderer/camera.h"
 #include <imgui.h>
 #include <thread>
+#include <cstdlib>
 #include <implot.h>
 #include <blt/gp/tree.h>
 
@@ -15,6 +21,8 @@ blt::gfx::batch_renderer_2d renderer_2d(resources, global_matrices);
 blt::gfx::first_person_camera camera;
 
 std::vector<blt::gfx::texture_gl2D*> gl_images;
+// the best output of each channel composed into one image
+blt::gfx::texture_gl2D* best_image = nullptr;
 blt::size_t population_size = 64;
 
 namespace im = ImGui;
@@ -29,7 +37,7 @@ void update_population_size(const blt::u32 new_size)
 		return;
 	for (blt::size_t i = population_size; i < new_size; i++)
 	{
-		auto texture = new texture_gl2D(IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, GL_RGBA8);
+		auto texture = new texture_gl2D(image_dimensions(), image_dimensions(), GL_RGBA8);
 		texture->bind();
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -40,10 +48,10 @@ void update_population_size(const blt::u32 new_size)
 	population_size = new_size;
 }
 
-std::thread run_gp()
+std::thread run_gp(const std::string& checkpoint_path)
 {
 	return std::thread{
-		[]() {
+		[checkpoint_path]() {
 			while (!should_exit)
 			{
 				if (run_generation)
@@ -53,11 +61,45 @@ std::thread run_gp()
 				} else
 					std::this_thread::sleep_for(std::chrono::milliseconds(10));
 			}
+			if (!checkpoint_path.empty())
+				save_checkpoint(checkpoint_path);
 			cleanup();
 		}
 	};
 }
 
+/**
+ * Plots the whole history of a statistic with about one point per pixel of the plot, older generations are summarised by
+ * the band between their min and max around their mean.
+ */
+void plot_history(const char* title, const char* label, const blt::size_t channel, const history_stat_t stat)
+{
+	static std::vector<history_point_t> points;
+	static std::vector<float> generations, mins, maxes, means;
+	if (!ImPlot::BeginPlot(title))
+		return;
+	ImPlot::SetupAxes("Generation", label, ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit);
+	const auto width = static_cast<blt::size_t>(std::max(ImPlot::GetPlotSize().x, 1.0f));
+	read_fitness_history(channel, stat, 0, std::numeric_limits<blt::u64>::max(), width, points);
+
+	generations.clear();
+	mins.clear();
+	maxes.clear();
+	means.clear();
+	for (const auto& point : points)
+	{
+		generations.push_back(static_cast<float>(point.generation));
+		mins.push_back(point.min);
+		maxes.push_back(point.max);
+		means.push_back(point.mean);
+	}
+	const auto count = static_cast<int>(points.size());
+	ImPlot::SetNextFillStyle(IMPLOT_AUTO_COL, 0.25f);
+	ImPlot::PlotShaded(label, generations.data(), mins.data(), maxes.data(), count);
+	ImPlot::PlotLine(label, generations.data(), means.data(), count);
+	ImPlot::EndPlot();
+}
+
 void init(const blt::gfx::window_data&)
 {
 	ImPlot::CreateContext();
@@ -65,19 +107,24 @@ void init(const blt::gfx::window_data&)
 
 	for (blt::size_t i = 0; i < population_size; i++)
 	{
-		auto texture = new texture_gl2D(IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, GL_RGBA8);
+		auto texture = new texture_gl2D(image_dimensions(), image_dimensions(), GL_RGBA8);
 		texture->bind();
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 		gl_images.push_back(texture);
 		resources.set(std::to_string(i), texture);
 	}
-	const auto texture = new texture_gl2D(IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, GL_RGBA8);
+	const auto texture = new texture_gl2D(image_dimensions(), image_dimensions(), GL_RGBA8);
 	texture->bind();
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	texture->upload(to_gl_image(get_reference_image()).data(), IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, GL_RGB, GL_FLOAT);
+	texture->upload(to_gl_image(get_reference_image()).data(), image_dimensions(), image_dimensions(), GL_RGB, GL_FLOAT);
 	resources.set("reference", texture);
+	best_image = new texture_gl2D(image_dimensions(), image_dimensions(), GL_RGBA8);
+	best_image->bind();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	resources.set("best", best_image);
 	global_matrices.create_internals();
 	resources.load_resources();
 	renderer_2d.create();
@@ -137,6 +184,8 @@ void update(const blt::gfx::window_data& data)
 					run_generation = true;
 				ImGui::InputInt("Min Time Between Runs (ms)", &min_between_runs);
 				ImGui::Checkbox("Show Best", &show_best);
+				// only the grid is kept, however large the population is
+				set_preview_count(std::min(population_size, static_cast<blt::size_t>(std::max(images_x * images_y, 0))));
 				if (ImGui::Checkbox("Use Gamma Correction?", &use_gramma_correction))
 					set_use_gamma_correction(use_gramma_correction);
 			}
@@ -200,59 +249,16 @@ void update(const blt::gfx::window_data& data)
 		// 3. Statistics tab
 		if (ImGui::BeginTabItem("Statistics"))
 		{
-			auto [mean_chan, variance_chan] = get_mean_and_variance();
-
-			for (const auto [i, mean] : blt::enumerate(mean_chan))
-			{
-				std::string type;
-				switch (i)
-				{
-					case 0:
-						type = "Red";
-						break;
-					case 1:
-						type = "Green";
-						break;
-					case 2:
-						type = "Blue";
-						break;
-					default: break;
-				}
+			const std::array<std::string, 3> labels = {"Red", "Green", "Blue"};
 
-				if (ImPlot::BeginPlot(("Mean Graph " + type).c_str()))
-				{
-					ImPlot::PlotLine("Mean", mean.data(), static_cast<int>(mean.size()));
-					ImPlot::EndPlot();
-				}
-			}
+			for (const auto [channel, label] : blt::enumerate(labels))
+				plot_history(("Mean Graph " + label).c_str(), "Mean", channel, history_stat_t::mean);
 
-			for (const auto [i, variance] : blt::enumerate(variance_chan))
-			{
-				std::string type;
-				switch (i)
-				{
-					case 0:
-						type = "Red";
-						break;
-					case 1:
-						type = "Green";
-						break;
-					case 2:
-						type = "Blue";
-						break;
-					default: break;
-				}
-				if (ImPlot::BeginPlot(("Variance Graph " + type).c_str()))
-				{
-					ImPlot::PlotLine("Variance", variance.data(), static_cast<int>(variance.size()));
-					ImPlot::EndPlot();
-				}
-			}
+			for (const auto [channel, label] : blt::enumerate(labels))
+				plot_history(("Variance Graph " + label).c_str(), "Variance", channel, history_stat_t::variance);
 
 			auto pops = get_populations();
 
-			const std::array<std::string, 3> labels = {"Red", "Green", "Blue"};
-
 			for (const auto& [i, label, pop] : blt::in_pairs(labels, pops).enumerate().flatten())
 			{
 				if (i > 0)
@@ -270,6 +276,45 @@ void update(const blt::gfx::window_data& data)
 				ImGui::EndGroup();
 			}
 
+			if (ImGui::CollapsingHeader("Operator Profile"))
+			{
+				static bool profiling = false;
+				static bool cumulative = true;
+				if (ImGui::Checkbox("Profile Operators", &profiling))
+					set_operator_profiling(profiling);
+				ImGui::SameLine();
+				ImGui::Checkbox("Whole Run", &cumulative);
+				ImGui::SameLine();
+				if (ImGui::Button("Save CSV"))
+					write_operator_profile_csv("operator_profile.csv");
+
+				const auto profile = get_operator_profile(cumulative);
+				ImGui::Text("Generation %u, covering %u generations", profile.generation, profile.generations);
+				if (ImGui::BeginTable("OperatorProfile", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+				{
+					for (const auto header : {"Operator", "Calls", "Total (ms)", "p50 (us)", "p99 (us)", "Images"})
+						ImGui::TableSetupColumn(header);
+					ImGui::TableHeadersRow();
+					for (const auto& entry : profile.operators)
+					{
+						ImGui::TableNextRow();
+						ImGui::TableNextColumn();
+						ImGui::TextUnformatted(profiled_op_name(entry.op));
+						ImGui::TableNextColumn();
+						ImGui::Text("%lu", entry.calls);
+						ImGui::TableNextColumn();
+						ImGui::Text("%.3f", static_cast<double>(entry.total_ns) / 1e6);
+						ImGui::TableNextColumn();
+						ImGui::Text("%.1f", static_cast<double>(entry.p50_ns) / 1e3);
+						ImGui::TableNextColumn();
+						ImGui::Text("%.1f", static_cast<double>(entry.p99_ns) / 1e3);
+						ImGui::TableNextColumn();
+						ImGui::Text("%lu", entry.image_acquisitions);
+					}
+					ImGui::EndTable();
+				}
+			}
+
 			// Additional UI for statistical data
 			ImGui::EndTabItem();
 		}
@@ -282,8 +327,8 @@ void update(const blt::gfx::window_data& data)
 			renderer_2d.drawRectangle({
 										w / 2,
 										h / 2,
-										std::min(w, static_cast<float>(IMAGE_DIMENSIONS)),
-										std::min(h, static_cast<float>(IMAGE_DIMENSIONS))
+										std::min(w, static_cast<float>(image_dimensions())),
+										std::min(h, static_cast<float>(image_dimensions()))
 									}, "reference");
 			ImGui::EndTabItem();
 		}
@@ -322,17 +367,41 @@ void update(const blt::gfx::window_data& data)
 
 	if (ImGui::Begin("Debug"))
 	{
-		const auto allocated_blocks = g_allocated_blocks.load(std::memory_order_relaxed);
-		const auto deallocated_blocks = g_deallocated_blocks.load(std::memory_order_relaxed);
-		ImGui::Text("Allocated Blocks / Deallocated Blocks: (%ld / %ld) (%ld / %ld) (Total: %ld)", allocated_blocks, deallocated_blocks,
-					g_image_list.images.size(), allocated_blocks - deallocated_blocks,
-					g_image_list.images.size() + (allocated_blocks - deallocated_blocks));
+		const auto stats = get_image_pool_stats();
+		const auto live_blocks = stats.allocated - stats.deallocated;
+		ImGui::Text("Allocated Blocks / Deallocated Blocks: (%ld / %ld) (%ld / %ld) (Total: %ld)", stats.allocated, stats.deallocated,
+					stats.thread_cached + stats.global_free, live_blocks, stats.thread_cached + stats.global_free + live_blocks);
+		ImGui::Text("Pool Hits / Refills / Misses: (%ld / %ld / %ld)", stats.hits, stats.refills, stats.misses);
+		ImGui::Text("Cross Thread Returns: %ld, Reused In Place: %ld", stats.cross_thread_returns, stats.reused);
+		ImGui::Text("Free Blocks (Thread Cached / Global): (%ld / %ld)", stats.thread_cached, stats.global_free);
+		ImGui::Text("High-water Mark: %ld blocks (%.2f MiB)", stats.blocks_created,
+					static_cast<double>(stats.blocks_created * image_size_bytes()) / (1024.0 * 1024.0));
+
+		const auto cache = get_eval_cache_stats();
+		const auto lookups = cache.hits + cache.misses;
+		ImGui::Separator();
+		ImGui::Text("Eval Cache Hits / Misses: (%ld / %ld) (%.1f%%)", cache.hits, cache.misses,
+					lookups == 0 ? 0.0 : 100.0 * static_cast<double>(cache.hits) / static_cast<double>(lookups));
+		ImGui::Text("Eval Cache Entries: %ld (%.1f / %.1f MiB), Evictions: %ld", cache.entries,
+					static_cast<double>(cache.bytes) / (1024.0 * 1024.0), static_cast<double>(cache.budget_bytes) / (1024.0 * 1024.0),
+					cache.evictions);
+
+		const auto screening = get_screening_stats();
+		ImGui::Separator();
+		ImGui::Text("Fitness Screened / Exact: (%ld / %ld)", screening.screened, screening.full);
+
+		const auto expressions = get_image_expr_stats();
+		ImGui::Text("Fused Expressions: %ld (%.2f ops each)", expressions.materialized,
+					expressions.materialized == 0 ? 0.0 : static_cast<double>(expressions.operations) / static_cast<double>(expressions.materialized));
 	}
 	ImGui::End();
 
-	for (blt::size_t i = 0; i < population_size; i++)
+	// textures only change when a generation has finished, and the snapshot is immutable so there is nothing to race with
+	if (const auto snapshot = acquire_preview_snapshot())
 	{
-		gl_images[i]->upload(get_image(i).data(), IMAGE_DIMENSIONS, IMAGE_DIMENSIONS, GL_RGB, GL_UNSIGNED_INT);
+		for (blt::size_t i = 0; i < std::min(snapshot->count, gl_images.size()); i++)
+			gl_images[i]->upload(snapshot->image(i), snapshot->dimensions, snapshot->dimensions, GL_RGBA, GL_UNSIGNED_BYTE);
+		best_image->upload(snapshot->best_image(), snapshot->dimensions, snapshot->dimensions, GL_RGBA, GL_UNSIGNED_BYTE);
 	}
 
 	if ((blt::gfx::isMousePressed(0) && blt::gfx::mousePressedLastFrame() && !clicked_on_image) || (blt::gfx::isKeyPressed(GLFW_KEY_ESCAPE) &&
@@ -341,14 +410,10 @@ void update(const blt::gfx::window_data& data)
 
 	if (show_best)
 	{
-		auto best_images = get_best_image_index();
-		for (const auto [i, best_image] : blt::enumerate(best_images))
-		{
-			const auto width = std::min(static_cast<float>(data.width) - side_bar_width, static_cast<float>(256) * 3) / 3;
-			const auto height = std::min(static_cast<float>(data.height) - top_bar_height, static_cast<float>(256) * 3) / 3;
-			renderer_2d.drawRectangle(blt::gfx::rectangle2d_t{blt::gfx::anchor_t::BOTTOM_LEFT, side_bar_width + 256 + i * width, 64, width, height},
-									std::to_string(best_image), 1);
-		}
+		// the channels' best individuals are different trees, so they are shown composed the way they are exported
+		const auto width = std::min(static_cast<float>(data.width) - side_bar_width, static_cast<float>(256) * 3) / 3;
+		const auto height = std::min(static_cast<float>(data.height) - top_bar_height, static_cast<float>(256) * 3) / 3;
+		renderer_2d.drawRectangle(blt::gfx::rectangle2d_t{blt::gfx::anchor_t::BOTTOM_LEFT, side_bar_width + 256, 64, width, height}, "best", 1);
 	}
 
 	if (image_to_enlarge != -1)
@@ -376,10 +441,36 @@ void destroy(const blt::gfx::window_data&)
 	blt::gfx::cleanup();
 }
 
-int main()
+int main(const int argc, const char** argv)
 {
-	setup_gp_system(population_size);
-	auto run_gp_thread = run_gp();
+	const auto options = parse_run_options(argc, argv);
+	if (options.report_approximation)
+	{
+		set_transcendental_accuracy(options.transcendental_table_bits);
+		report_approximation_error();
+		return EXIT_SUCCESS;
+	}
+	if (options.eval_worker_index >= 0)
+		return run_eval_worker(options);
+	if (options.headless)
+		return run_headless(options);
+	if (options.islands > 1)
+		BLT_WARN("Islands are only supported by headless runs, the window evolves a single population");
+	if (options.eval_workers > 0)
+		BLT_WARN("Evaluation workers are only supported by headless runs, the window evaluates in process");
+
+	population_size = options.population_size;
+	if (!configure_gp_system(options))
+		return EXIT_FAILURE;
+	if (!options.resume_path.empty() && !load_checkpoint(options.resume_path))
+	{
+		cleanup();
+		return EXIT_FAILURE;
+	}
+	set_checkpointing(options.checkpoint_path, options.checkpoint_interval);
+	set_image_export(options.export_directory, options.export_interval);
+	set_preview_snapshots(true);
+	auto run_gp_thread = run_gp(options.checkpoint_path);
 	blt::gfx::init(blt::gfx::window_data{"Image GP", init, update, destroy}.setSyncInterval(1));
 	should_exit = true;
 	run_gp_thread.join();
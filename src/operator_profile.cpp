@@ -0,0 +1,332 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <operator_profile.h>
+#include <image_pool.h>
+#include <blt/logging/logging.h>
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+std::atomic_bool detail::operator_profiling = false;
+
+namespace
+{
+	constexpr blt::size_t OP_COUNT = static_cast<blt::size_t>(profiled_op_t::count);
+	// durations below 2^LINEAR_BITS ns get a bucket each, above that every power of two is split into 2^SUB_BITS buckets
+	constexpr blt::u32 SUB_BITS = 3;
+	constexpr blt::u32 LINEAR_BITS = SUB_BITS + 1;
+	constexpr blt::size_t BUCKETS = (1u << LINEAR_BITS) + (64 - LINEAR_BITS) * (1u << SUB_BITS);
+
+	blt::size_t bucket_of(const blt::u64 ns)
+	{
+		if (ns < (1u << LINEAR_BITS))
+			return ns;
+		const auto exponent = 63u - static_cast<blt::u32>(__builtin_clzll(ns));
+		const auto sub = (ns >> (exponent - SUB_BITS)) & ((1u << SUB_BITS) - 1);
+		return (1u << LINEAR_BITS) + (exponent - LINEAR_BITS) * (1u << SUB_BITS) + sub;
+	}
+
+	// the middle of the range of durations a bucket holds
+	blt::u64 bucket_value(const blt::size_t bucket)
+	{
+		if (bucket < (1u << LINEAR_BITS))
+			return bucket;
+		const auto exponent = static_cast<blt::u32>((bucket - (1u << LINEAR_BITS)) >> SUB_BITS) + LINEAR_BITS;
+		const auto sub = (bucket - (1u << LINEAR_BITS)) & ((1u << SUB_BITS) - 1);
+		const auto low = (1ull << exponent) + (sub << (exponent - SUB_BITS));
+		return low + (1ull << (exponent - SUB_BITS)) / 2;
+	}
+
+	struct op_counters_t
+	{
+		blt::u64 calls = 0;
+		blt::u64 total_ns = 0;
+		blt::u64 image_acquisitions = 0;
+		std::array<blt::u64, BUCKETS> histogram{};
+
+		op_counters_t& operator+=(const op_counters_t& other)
+		{
+			calls += other.calls;
+			total_ns += other.total_ns;
+			image_acquisitions += other.image_acquisitions;
+			for (blt::size_t i = 0; i < BUCKETS; ++i)
+				histogram[i] += other.histogram[i];
+			return *this;
+		}
+	};
+
+	using profile_counters_t = std::array<op_counters_t, OP_COUNT>;
+
+	// written only by the owning thread, relaxed load + store keeps the increments free of locked instructions. never reset,
+	// merges take the difference to what they saw last time
+	struct thread_profile_t
+	{
+		static void bump(std::atomic_uint64_t& counter, const blt::u64 amount = 1)
+		{
+			counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+		}
+
+		struct counters_t
+		{
+			std::atomic_uint64_t calls = 0;
+			std::atomic_uint64_t total_ns = 0;
+			std::atomic_uint64_t image_acquisitions = 0;
+			std::array<std::atomic_uint64_t, BUCKETS> histogram{};
+		};
+
+		thread_profile_t();
+
+		~thread_profile_t();
+
+		void read(profile_counters_t& out) const
+		{
+			for (blt::size_t op = 0; op < OP_COUNT; ++op)
+			{
+				out[op].calls = counters[op].calls.load(std::memory_order_relaxed);
+				out[op].total_ns = counters[op].total_ns.load(std::memory_order_relaxed);
+				out[op].image_acquisitions = counters[op].image_acquisitions.load(std::memory_order_relaxed);
+				for (blt::size_t i = 0; i < BUCKETS; ++i)
+					out[op].histogram[i] = counters[op].histogram[i].load(std::memory_order_relaxed);
+			}
+		}
+
+		std::array<counters_t, OP_COUNT> counters;
+		operator_timer_t* current = nullptr;
+	};
+
+	std::mutex profile_mutex;
+	std::vector<thread_profile_t*> registered_threads;
+	// counters of threads that have exited, folded in by the next merge
+	profile_counters_t retired;
+	// the sum over every thread at the last merge
+	profile_counters_t last_total;
+	profile_counters_t last_generation;
+	profile_counters_t run_total;
+	blt::u32 merged_generation = 0;
+	blt::u32 merged_generations = 0;
+	std::ofstream csv_stream;
+
+	thread_profile_t::thread_profile_t()
+	{
+		std::scoped_lock lock(profile_mutex);
+		registered_threads.push_back(this);
+	}
+
+	thread_profile_t::~thread_profile_t()
+	{
+		profile_counters_t mine;
+		read(mine);
+		std::scoped_lock lock(profile_mutex);
+		for (blt::size_t op = 0; op < OP_COUNT; ++op)
+			retired[op] += mine[op];
+		registered_threads.erase(std::remove(registered_threads.begin(), registered_threads.end(), this), registered_threads.end());
+	}
+
+	// heap allocated, a profile_counters_t per thread is too large for thread_local storage of every thread that never profiles
+	thread_local std::unique_ptr<thread_profile_t> thread_profile;
+
+	thread_profile_t& get_thread_profile()
+	{
+		if (!thread_profile)
+			thread_profile = std::make_unique<thread_profile_t>();
+		return *thread_profile;
+	}
+
+	blt::u64 percentile(const op_counters_t& counters, const double fraction)
+	{
+		const auto rank = static_cast<blt::u64>(fraction * static_cast<double>(counters.calls - 1));
+		blt::u64 seen = 0;
+		for (blt::size_t i = 0; i < BUCKETS; ++i)
+		{
+			seen += counters.histogram[i];
+			if (seen > rank)
+				return bucket_value(i);
+		}
+		return 0;
+	}
+
+	operator_profile_t to_profile(const profile_counters_t& counters, const blt::u32 generation, const blt::u32 generations)
+	{
+		operator_profile_t profile;
+		profile.generation = generation;
+		profile.generations = generations;
+		for (blt::size_t op = 0; op < OP_COUNT; ++op)
+		{
+			const auto& entry = counters[op];
+			if (entry.calls == 0)
+				continue;
+			profile.operators.push_back({
+				static_cast<profiled_op_t>(op), entry.calls, entry.total_ns, percentile(entry, 0.5), percentile(entry, 0.99),
+				entry.image_acquisitions
+			});
+		}
+		std::sort(profile.operators.begin(), profile.operators.end(), [](const auto& a, const auto& b) {
+			return a.total_ns > b.total_ns;
+		});
+		return profile;
+	}
+
+	void write_csv_header(std::ostream& out)
+	{
+		out << "generation,operator,calls,total_ms,mean_us,p50_us,p99_us,image_acquisitions\n";
+	}
+
+	void write_csv_rows(std::ostream& out, const std::string& generation, const operator_profile_t& profile)
+	{
+		for (const auto& entry : profile.operators)
+		{
+			out << generation << ',' << profiled_op_name(entry.op) << ',' << entry.calls << ',' << static_cast<double>(entry.total_ns) / 1e6
+				<< ',' << static_cast<double>(entry.total_ns) / 1e3 / static_cast<double>(entry.calls) << ','
+				<< static_cast<double>(entry.p50_ns) / 1e3 << ',' << static_cast<double>(entry.p99_ns) / 1e3 << ',' << entry.
+				image_acquisitions << '\n';
+		}
+	}
+}
+
+const char* profiled_op_name(const profiled_op_t op)
+{
+	static constexpr std::array<const char*, OP_COUNT> names{
+		"image_x", "image_y", "random_image", "image_noise", "image_ephemeral", "add_image", "sub_image", "mul_image", "div_image",
+		"sin_image", "sin_image_off", "cos_image", "cos_image_off", "log_image", "exp_image", "abs_image", "mod_image",
+		"bit_or_image", "bit_and_image", "bit_xor_image", "bit_not_image", "srgb_image", "linear_image", "gt_image", "lt_image",
+		"grad_image", "perlin_image", "perlin_image_eph", "perlin_image_eph_oct", "passthrough", "erode_image", "dilate_image",
+		"band_pass", "fused_expression"
+	};
+	return op < profiled_op_t::count ? names[static_cast<blt::size_t>(op)] : "unknown";
+}
+
+void operator_timer_t::begin(const profiled_op_t op)
+{
+	auto& profile = get_thread_profile();
+	active = true;
+	this->op = op;
+	parent = profile.current;
+	profile.current = this;
+	start_acquisitions = thread_image_acquisitions();
+	start = std::chrono::steady_clock::now();
+}
+
+void operator_timer_t::end()
+{
+	const auto elapsed = static_cast<blt::u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - start).count());
+	const auto acquisitions = thread_image_acquisitions() - start_acquisitions;
+	auto& profile = *thread_profile;
+	profile.current = parent;
+	if (parent)
+	{
+		parent->nested_ns += elapsed;
+		parent->nested_acquisitions += acquisitions;
+	}
+
+	const auto own_ns = elapsed - std::min(elapsed, nested_ns);
+	auto& counters = profile.counters[static_cast<blt::size_t>(op)];
+	thread_profile_t::bump(counters.calls);
+	thread_profile_t::bump(counters.total_ns, own_ns);
+	thread_profile_t::bump(counters.image_acquisitions, acquisitions - std::min(acquisitions, nested_acquisitions));
+	thread_profile_t::bump(counters.histogram[bucket_of(own_ns)]);
+}
+
+void set_operator_profiling(const bool enabled)
+{
+	detail::operator_profiling.store(enabled, std::memory_order_relaxed);
+}
+
+bool is_operator_profiling()
+{
+	return detail::operator_profiling.load(std::memory_order_relaxed);
+}
+
+void merge_operator_profile(const blt::u32 generation)
+{
+	std::scoped_lock lock(profile_mutex);
+	profile_counters_t total = retired;
+	profile_counters_t thread;
+	for (const auto registered : registered_threads)
+	{
+		registered->read(thread);
+		for (blt::size_t op = 0; op < OP_COUNT; ++op)
+			total[op] += thread[op];
+	}
+
+	bool any = false;
+	for (blt::size_t op = 0; op < OP_COUNT; ++op)
+	{
+		auto& delta = last_generation[op];
+		delta.calls = total[op].calls - last_total[op].calls;
+		delta.total_ns = total[op].total_ns - last_total[op].total_ns;
+		delta.image_acquisitions = total[op].image_acquisitions - last_total[op].image_acquisitions;
+		for (blt::size_t i = 0; i < BUCKETS; ++i)
+			delta.histogram[i] = total[op].histogram[i] - last_total[op].histogram[i];
+		run_total[op] += delta;
+		any |= delta.calls != 0;
+	}
+	last_total = total;
+	if (!any)
+		return;
+	merged_generation = generation;
+	++merged_generations;
+	if (csv_stream.is_open())
+	{
+		write_csv_rows(csv_stream, std::to_string(generation), to_profile(last_generation, generation, 1));
+		csv_stream.flush();
+	}
+}
+
+operator_profile_t get_operator_profile(const bool cumulative)
+{
+	std::scoped_lock lock(profile_mutex);
+	if (cumulative)
+		return to_profile(run_total, merged_generation, merged_generations);
+	return to_profile(last_generation, merged_generation, merged_generations == 0 ? 0 : 1);
+}
+
+bool set_operator_profile_csv(const std::string& path)
+{
+	std::scoped_lock lock(profile_mutex);
+	if (csv_stream.is_open())
+	{
+		write_csv_rows(csv_stream, "total", to_profile(run_total, merged_generation, merged_generations));
+		csv_stream.close();
+	}
+	if (path.empty())
+		return true;
+	csv_stream.open(path, std::ios::out | std::ios::trunc);
+	if (!csv_stream)
+	{
+		BLT_ERROR("Unable to open operator profile '{}' for writing", path);
+		return false;
+	}
+	write_csv_header(csv_stream);
+	return true;
+}
+
+bool write_operator_profile_csv(const std::string& path)
+{
+	std::ofstream out(path, std::ios::out | std::ios::trunc);
+	if (!out)
+	{
+		BLT_ERROR("Unable to open operator profile '{}' for writing", path);
+		return false;
+	}
+	write_csv_header(out);
+	write_csv_rows(out, "total", get_operator_profile(true));
+	return static_cast<bool>(out);
+}
@@ -0,0 +1,61 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <preview_store.h>
+#include <algorithm>
+#include <limits>
+
+void preview_store_t::resize(const blt::size_t displayed, const blt::size_t pixels)
+{
+	displayed_count = displayed;
+	pixel_count = pixels;
+	rgb.assign(displayed * pixels * 3, 0);
+	rgb.shrink_to_fit();
+	for (auto& best : bests)
+	{
+		best.fitness = -std::numeric_limits<double>::infinity();
+		best.pixels.assign(pixels, 0);
+	}
+}
+
+void preview_store_t::reset_best(const blt::size_t channel)
+{
+	bests[channel].fitness.store(-std::numeric_limits<double>::infinity(), std::memory_order_relaxed);
+}
+
+void preview_store_t::capture(const blt::size_t channel, const blt::size_t index, const image_ipixel_t* output,
+							const double adjusted_fitness)
+{
+	if (index < displayed_count)
+	{
+		// channels only ever write their own byte of each pixel, so concurrent channels don't touch the same memory
+		const auto out = rgb.data() + index * pixel_count * 3 + channel;
+		for (blt::size_t i = 0; i < pixel_count; ++i)
+			out[i * 3] = output ? static_cast<blt::u8>(output[i] >> 24) : 0;
+	}
+
+	// the best rarely changes once a few individuals have been seen, so nearly every call stops at this load
+	auto& best = bests[channel];
+	if (output == nullptr || adjusted_fitness <= best.fitness.load(std::memory_order_relaxed))
+		return;
+	std::scoped_lock lock(best.mutex);
+	if (adjusted_fitness <= best.fitness.load(std::memory_order_relaxed))
+		return;
+	for (blt::size_t i = 0; i < pixel_count; ++i)
+		best.pixels[i] = static_cast<blt::u8>(output[i] >> 24);
+	best.fitness.store(adjusted_fitness, std::memory_order_relaxed);
+}
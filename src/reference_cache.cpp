@@ -0,0 +1,192 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <reference_cache.h>
+#include <checkpoint.h>
+#include <eval_cache.h>
+#include <blt/logging/logging.h>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <stb_image.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+	// bump when the way planes are produced changes, so stale cache entries are never read
+	constexpr blt::u64 REFERENCE_FORMAT = 1;
+
+	enum reference_section_id_t : blt::u32
+	{
+		REFERENCE_INFO = 1,
+		REFERENCE_PLANES = 2
+	};
+
+	struct reference_info_t
+	{
+		blt::u64 source_hash;
+		blt::u64 format;
+		blt::i32 dimensions;
+		blt::u32 channels;
+	};
+
+	std::optional<std::string> cache_directory;
+
+	const std::string& get_cache_directory()
+	{
+		if (!cache_directory)
+		{
+			if (const auto xdg = std::getenv("XDG_CACHE_HOME"); xdg != nullptr && *xdg != '\0')
+				cache_directory = std::string(xdg) + "/image-gp";
+			else if (const auto home = std::getenv("HOME"); home != nullptr && *home != '\0')
+				cache_directory = std::string(home) + "/.cache/image-gp";
+			else
+				cache_directory = std::string{};
+		}
+		return *cache_directory;
+	}
+
+	std::optional<blt::u64> hash_file(const std::string& path)
+	{
+		const auto fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return {};
+		struct stat info{};
+		if (fstat(fd, &info) != 0)
+		{
+			close(fd);
+			return {};
+		}
+		const auto size = static_cast<blt::size_t>(info.st_size);
+		if (size == 0)
+		{
+			close(fd);
+			return hash_bytes(nullptr, 0);
+		}
+		const auto mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (mapped == MAP_FAILED)
+			return {};
+		const auto hash = hash_bytes(static_cast<const unsigned char*>(mapped), size);
+		munmap(mapped, size);
+		return hash;
+	}
+
+	std::string cache_path(const blt::u64 hash)
+	{
+		char name[64];
+		std::snprintf(name, sizeof(name), "/%016llx-%d.igpref", static_cast<unsigned long long>(hash), image_dimensions());
+		return get_cache_directory() + name;
+	}
+
+	std::optional<std::array<image_storage_t, 3>> read_cached(const std::string& cached, const blt::u64 hash)
+	{
+		std::error_code error;
+		if (!std::filesystem::exists(cached, error))
+			return {};
+		checkpoint_file_t file;
+		if (!file.open(cached))
+			return {};
+		reference_info_t info{};
+		const auto planes = file.section(REFERENCE_PLANES);
+		if (!file.read_value(REFERENCE_INFO, info) || info.source_hash != hash || info.format != REFERENCE_FORMAT ||
+			info.dimensions != image_dimensions() || info.channels != 3 || planes.size() != 3 * image_size() * sizeof(float))
+			return {};
+		std::array<image_storage_t, 3> image;
+		for (blt::size_t channel = 0; channel < 3; ++channel)
+			std::memcpy(image[channel].data.data(), planes.data() + channel * image_size() * sizeof(float), image_size() * sizeof(float));
+		return image;
+	}
+
+	void write_cached(const std::string& cached, const blt::u64 hash, const std::array<image_storage_t, 3>& image)
+	{
+		std::error_code error;
+		std::filesystem::create_directories(get_cache_directory(), error);
+		if (error)
+		{
+			BLT_WARN("Unable to create reference cache '{}': {}", get_cache_directory(), error.message());
+			return;
+		}
+		checkpoint_builder_t builder;
+		const reference_info_t info{hash, REFERENCE_FORMAT, image_dimensions(), 3};
+		builder.add_section(REFERENCE_INFO, &info, sizeof(info));
+		builder.begin_section(REFERENCE_PLANES);
+		for (const auto& plane : image)
+			builder.write(reinterpret_cast<const char*>(plane.data.data()), plane.data.size() * sizeof(float));
+		builder.end_section();
+		// small enough to write in place, and the async writer only keeps the newest of several queued files
+		if (!write_checkpoint_file(cached, builder.finish()))
+			BLT_WARN("Unable to write reference cache '{}'", cached);
+	}
+}
+
+// four independent lanes so the hash isn't one long dependency chain through mix_key
+blt::u64 hash_bytes(const unsigned char* bytes, const blt::size_t size)
+{
+	blt::u64 lanes[4] = {size, 0x9e3779b97f4a7c15ull, 0xbf58476d1ce4e5b9ull, 0x94d049bb133111ebull};
+	blt::size_t i = 0;
+	for (; i + 32 <= size; i += 32)
+	{
+		for (blt::size_t lane = 0; lane < 4; ++lane)
+		{
+			blt::u64 word;
+			std::memcpy(&word, bytes + i + lane * 8, sizeof(word));
+			lanes[lane] = mix_key(lanes[lane] ^ word);
+		}
+	}
+	blt::u64 hash = lanes[0];
+	for (blt::size_t lane = 1; lane < 4; ++lane)
+		hash = mix_key(hash ^ lanes[lane]);
+	for (; i < size; ++i)
+		hash = mix_key(hash ^ bytes[i]);
+	return hash;
+}
+
+void set_reference_cache_directory(const std::string& directory)
+{
+	cache_directory = directory;
+}
+
+std::optional<std::array<image_storage_t, 3>> load_reference_image(const std::string& path)
+{
+	const auto hash = hash_file(path);
+	if (!hash)
+	{
+		BLT_ERROR("Unable to read reference '{}'", path);
+		return {};
+	}
+	const bool cached = !get_cache_directory().empty();
+	if (cached)
+	{
+		if (auto image = read_cached(cache_path(*hash), *hash))
+			return image;
+	}
+
+	int x, y, channels;
+	if (!stbi_info(path.c_str(), &x, &y, &channels))
+	{
+		BLT_ERROR("Reference '{}' isn't an image stb can decode", path);
+		return {};
+	}
+	auto image = image_storage_t::from_file(path);
+	if (cached)
+		write_cached(cache_path(*hash), *hash, image);
+	return image;
+}
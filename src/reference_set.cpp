@@ -0,0 +1,97 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <reference_set.h>
+#include <blt/logging/logging.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <reference_cache.h>
+
+namespace
+{
+	void add_path(const std::string& path, std::vector<std::string>& files)
+	{
+		std::error_code error;
+		if (!std::filesystem::is_directory(path, error))
+		{
+			files.push_back(path);
+			return;
+		}
+		std::vector<std::string> contents;
+		for (const auto& entry : std::filesystem::directory_iterator(path, error))
+		{
+			if (entry.is_regular_file())
+				contents.push_back(entry.path().string());
+		}
+		std::sort(contents.begin(), contents.end());
+		files.insert(files.end(), contents.begin(), contents.end());
+	}
+}
+
+reference_set_t reference_set_t::load(const std::vector<std::string>& paths)
+{
+	std::vector<std::string> files;
+	for (const auto& path : paths)
+		add_path(path, files);
+
+	std::vector<std::array<image_storage_t, 3>> decoded;
+	for (const auto& file : files)
+	{
+		auto image = load_reference_image(file);
+		if (!image)
+		{
+			BLT_ERROR("Skipping reference '{}'", file);
+			continue;
+		}
+		decoded.push_back(std::move(*image));
+		BLT_INFO("Loaded reference {} '{}'", decoded.size() - 1, file);
+	}
+
+	reference_set_t set;
+	set.targets = decoded.size();
+	set.data.resize(3 * set.targets * image_size());
+	for (blt::size_t channel = 0; channel < 3; ++channel)
+	{
+		for (blt::size_t target = 0; target < set.targets; ++target)
+			std::memcpy(set.data.data() + (channel * set.targets + target) * image_size(), decoded[target][channel].data.data(),
+						image_size() * sizeof(float));
+	}
+	return set;
+}
+
+reference_set_t reference_set_t::from_pixels(std::vector<float> pixels)
+{
+	reference_set_t set;
+	set.targets = pixels.size() / (3 * image_size());
+	set.data = std::move(pixels);
+	set.data.resize(3 * set.targets * image_size());
+	return set;
+}
+
+blt::u64 reference_set_t::hash() const
+{
+	return hash_bytes(reinterpret_cast<const unsigned char*>(data.data()), data.size() * sizeof(float));
+}
+
+std::array<image_storage_t, 3> reference_set_t::target_image(const blt::size_t target) const
+{
+	std::array<image_storage_t, 3> image;
+	for (blt::size_t c = 0; c < 3; ++c)
+		std::memcpy(image[c].data.data(), channel(c, target), image_size() * sizeof(float));
+	return image;
+}
@@ -0,0 +1,114 @@
+/*
+ *  <Short Description>
+ *  Copyright (C) 2025  Brett Terpstra
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <tree_io.h>
+#include <ephemeral_image.h>
+#include <image_storage.h>
+#include <vector>
+
+namespace
+{
+	template <typename T>
+	void write_value(blt::fs::writer_t& writer, const T& value)
+	{
+		writer.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	bool read_value(blt::fs::reader_t& reader, T& value)
+	{
+		return reader.read(reinterpret_cast<char*>(&value), sizeof(T)) == static_cast<blt::i64>(sizeof(T));
+	}
+
+	struct portable_op_t
+	{
+		blt::gp::operator_id id;
+		blt::u32 is_value;
+		ephemeral_recipe_t recipe;
+	};
+}
+
+void write_tree(blt::fs::writer_t& writer, const blt::gp::tree_t& tree)
+{
+	static_assert(std::is_trivially_copyable_v<portable_op_t>, "operators are stored as raw bytes");
+	const auto& operations = tree.get_operations();
+	const auto& values = tree.get_values();
+
+	// the value stack holds the ephemeral images in operator order, so the last one is at the top
+	std::vector<portable_op_t> ops(operations.size());
+	blt::size_t bytes_from_head = 0;
+	for (blt::size_t i = operations.size(); i-- > 0;)
+	{
+		const auto& op = operations[i];
+		ops[i] = {op.id(), op.is_value(), {}};
+		if (!op.is_value())
+			continue;
+		bytes_from_head += op.type_size();
+		ops[i].recipe = values.from<image_t>(bytes_from_head).get_recipe();
+	}
+
+	write_value(writer, static_cast<blt::u32>(ops.size()));
+	writer.write(reinterpret_cast<const char*>(ops.data()), ops.size() * sizeof(portable_op_t));
+}
+
+bool read_tree(blt::fs::reader_t& reader, blt::gp::tree_t& tree, blt::gp::gp_program& program, const blt::size_t operator_count)
+{
+	tree.clear(program);
+	blt::u32 count = 0;
+	if (!read_value(reader, count) || count == 0)
+		return false;
+	thread_local std::vector<portable_op_t> ops;
+	ops.clear();
+	for (blt::u32 i = 0; i < count; ++i)
+	{
+		portable_op_t op{};
+		if (!read_value(reader, op) || op.id >= operator_count || (op.is_value != 0) != program.is_operator_ephemeral(op.id) ||
+			op.recipe.kind > ephemeral_kind_t::perlin_fbm)
+			return false;
+		ops.push_back(op);
+	}
+
+	// operators are stored root first, so walking them backwards every argument is on the stack before its operator, the
+	// first argument on top
+	thread_local std::vector<blt::gp::type_id> types;
+	types.clear();
+	for (blt::size_t i = ops.size(); i-- > 0;)
+	{
+		const auto& info = program.get_operator_info(ops[i].id);
+		if (types.size() < info.argument_types.size())
+			return false;
+		for (const auto argument : info.argument_types)
+		{
+			if (types.back() != argument)
+				return false;
+			types.pop_back();
+		}
+		types.push_back(info.return_type);
+	}
+	if (types.size() != 1 || types.front() != program.get_typesystem().get_type<image_t>().id())
+		return false;
+
+	for (const auto& op : ops)
+	{
+		const auto& info = program.get_operator_info(op.id);
+		// blt::gp calls the ephemeral operator as it is inserted, which picks the recipe up instead of drawing new parameters
+		const ephemeral_replay_t replay{op.recipe};
+		tree.emplace_operator(program.get_typesystem().get_type(info.return_type).size(), op.id, op.is_value != 0,
+							program.get_operator_flags(op.id));
+	}
+	return true;
+}